@@ -0,0 +1,49 @@
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+#include "rafgl.h"
+#include "game_constants.h"
+#include <stdint.h>
+
+/// Procedural rasters are stored on disk under a hash of everything that
+/// determines their content, so a warm start can load them instead of
+/// regenerating. Eviction is LRU, using file modification time as the clock.
+
+typedef enum {
+    ASSET_GENERATOR_PERLIN,
+    ASSET_GENERATOR_PERLIN_COLOR,
+    ASSET_GENERATOR_GALAXY
+} asset_generator_t;
+
+typedef struct {
+    asset_generator_t generator;
+    int octaves;
+    double persistence;
+    rafgl_pixel_rgb_t tint;
+    int width, height;
+    unsigned int seed;
+} asset_key_t;
+
+/// variants bounds the seeds asset_cache_seed() hands out per generator, so relaunches
+/// keep drawing textures that are already on disk; 0 gives every texture its own seed.
+void asset_cache_init(const char *directory, long max_bytes, int variants);
+
+/// Seed for the next cached texture. Always takes exactly one rand() draw, so a world
+/// seed still picks the same textures whatever the variant count.
+unsigned int asset_cache_seed(void);
+
+uint64_t asset_cache_hash(asset_key_t key);
+
+rafgl_raster_t asset_cache_get(asset_key_t key);
+
+/// Runs the key's generator exactly as asset_cache_get would, without reading or writing
+/// the disk, for keys that are not expected to come up again.
+rafgl_raster_t asset_cache_generate(asset_key_t key);
+
+rafgl_raster_t cached_perlin(int octaves, double persistence, unsigned int seed);
+
+rafgl_raster_t cached_perlin_with_color(int width, int height, int octaves, double persistence, unsigned int seed);
+
+rafgl_raster_t cached_galaxy_texture(int width, int height, int octaves, double persistence, rafgl_pixel_rgb_t tint, unsigned int seed);
+
+#endif //ASSET_CACHE_H
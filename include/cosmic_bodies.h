@@ -3,6 +3,8 @@
 
 #include "rafgl.h"
 #include "game_constants.h"
+#include "quality.h"
+#include "display_list.h"
 #include <math.h>
 
 typedef struct {
@@ -50,17 +52,6 @@ typedef struct {
     int curr_particle;
 } spaceship;
 
-typedef struct {
-    int pos_x, pos_y;
-    double smoke_lifespan;
-    int frame;
-} smoke_particle_t;
-
-typedef struct {
-    float x, y, z;
-    float speed;
-} star_t;
-
 typedef struct {
     float x;
     float y;
@@ -73,7 +64,8 @@ extern const double sun_surface_noise_factor;
 
 extern rafgl_pixel_rgb_t sky_color;
 
-void draw_realistic_sun(rafgl_raster_t raster, int x, int y, int radius);
+/// Records the sun; its surface noise is drawn from rand() right away.
+void draw_realistic_sun(display_list_t *list, int x, int y, int radius);
 
 void draw_realistic_sun_with_texture(rafgl_raster_t raster, int x, int y, int radius, rafgl_raster_t sun_texture, double smooth_factor);
 
@@ -83,9 +75,17 @@ solar_system_t generate_solar_system(int num_planets, int sun_radius, int sun_x,
 
 void set_background(rafgl_raster_t raster, rafgl_raster_t background, rafgl_pixel_rgb_t bg_color);
 
-void render_planets(rafgl_raster_t raster, rafgl_spritesheet_t black_hole_spritesheet, solar_system_t *solar_system);
+/// Records the sun, the planets, the black hole's lens and the black hole itself.
+void render_planets(display_list_t *list, rafgl_spritesheet_t *black_hole_spritesheet, const solar_system_t *solar_system);
 
-void draw_rocket(rafgl_raster_t raster, spaceship *ship, rafgl_spritesheet_t smoke_spritesheet, float delta_time, int moved);
+/// Advances the orbits and the black hole animation by one simulation step.
+void update_planets(solar_system_t *solar_system, float delta_time);
+
+/// Emits exhaust behind the ship if it moved this step, and ages the smoke.
+void update_rocket_exhaust(const spaceship *ship, float delta_time, int moved);
+
+/// Records the hull and the smoke trail.
+void draw_rocket(display_list_t *list, const spaceship *ship);
 
 void move_rocket(spaceship *ship, float thrust, float angle_control, float delta_time);
 
@@ -93,15 +93,37 @@ spaceship init_spaceship(cosmic_body_t black_hole, float angle, float speed, int
 
 void link_rocket(spaceship* ship, int smoke_effects);
 
+/// Applies a quality rung: smoke particle cap and black hole lens size.
+void set_render_quality(const quality_level_t *level);
+
+/// World size in window pixels and the scale rasters are rendered at relative to it.
+void set_view(int world_width, int world_height, float scale);
+
+void init_particles(rafgl_spritesheet_t smoke_spritesheet);
+
+int smoke_particle_count();
+
+int hyper_star_count();
+
+int background_star_count();
+
+void cleanup_particles();
+
 void apply_vignette_with_tint(rafgl_raster_t raster, rafgl_pixel_rgb_t tint_color);
 
 solar_system_t generate_next_solar_system(rafgl_pixel_rgb_t system_color);
 
+void cleanup_solar_system(solar_system_t *solar_system);
+
 void stabilize_rocket(spaceship *ship, cosmic_body_t black_hole);
 
-void init_stars();
+void init_stars(int count);
+
+void cleanup_stars();
+
+void set_hyper_star_count(int count);
 
-void render_stars(rafgl_raster_t *raster, int width, int height);
+void render_stars(rafgl_raster_t *raster);
 
 void update_stars(float delta_time, int width, int height);
 
@@ -111,11 +133,11 @@ void draw_background_stars(rafgl_raster_t raster);
 
 void add_stars_to_background(rafgl_raster_t background_raster, int new_stars);
 
-void render_stars_with_shaking(rafgl_raster_t *raster, int width, int height, float delta_time, rafgl_pixel_rgb_t next_system_color, int ending);
+void render_hyperdrive_stars(rafgl_raster_t *raster, rafgl_pixel_rgb_t next_system_color, int trail_decay);
 
 void draw_hyperspeed_rocket(rafgl_raster_t *raster, int width, int height, float delta_time);
 
-void handle_rocket_out_of_bounds(rafgl_raster_t raster, spaceship *rocket, rafgl_spritesheet_t arrows_spritesheet, int rocket_diff_x, int rocket_diff_y);
+void handle_rocket_out_of_bounds(display_list_t *list, spaceship *rocket, rafgl_spritesheet_t *arrows_spritesheet, int rocket_diff_x, int rocket_diff_y);
 
 void apply_fisheye_lens(rafgl_raster_t *raster, int cx, int cy, int radius);
 
@@ -0,0 +1,68 @@
+#ifndef DISPLAY_LIST_H
+#define DISPLAY_LIST_H
+
+#include "rafgl.h"
+#include "game_constants.h"
+#include <stddef.h>
+
+/// World draws are recorded as commands instead of drawn on the spot. Executing the list
+/// bins every command into DISPLAY_TILE_SIZE square screen tiles by its bounding box, then
+/// runs the tiles side by side, each replaying its own commands in record order clipped to
+/// the tile. No two threads write the same pixel, and a tile stays in cache while its
+/// commands are drawn. A barrier, a command that reads pixels other tiles write, runs on
+/// its own over the whole raster once everything recorded before it is drawn.
+
+/// Draws the part of a command inside [x0, x1) x [y0, y1), which is never empty and lies
+/// within both the raster and the bounds the command was recorded with.
+typedef void (*display_draw_fn_t)(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, const void *params);
+
+#define DISPLAY_BARRIER 1
+
+typedef struct {
+    display_draw_fn_t draw;
+    size_t params;                  /// offset of the copied params in the list's params buffer
+    int x0, y0, x1, y1;             /// bounds, clipped to the list's size
+    int flags;
+} display_command_t;
+
+typedef struct {
+    int width, height;
+    display_command_t *commands;
+    int count, capacity;
+    unsigned char *params;
+    size_t params_used, params_capacity;
+    int *bin_start, bin_capacity;   /// commands of tile t are bin_items[bin_start[t]] to bin_items[bin_start[t + 1] - 1]
+    int *bin_items, item_capacity;
+    int *busy_tiles;                /// tiles with at least one command, bin_capacity of them
+} display_list_t;
+
+void display_list_init(display_list_t *list);
+
+void display_list_cleanup(display_list_t *list);
+
+/// Empties the list for a width x height raster.
+void display_list_begin(display_list_t *list, int width, int height);
+
+/// Records a draw over [x0, x1) x [y0, y1). The params are copied, so they can live on the
+/// caller's stack; anything they point to has to outlive the execute. Draws entirely off
+/// the raster are dropped.
+void display_list_draw(display_list_t *list, display_draw_fn_t draw, const void *params, size_t params_size, int x0, int y0, int x1, int y1);
+
+/// Records a draw that runs alone over the whole raster, after everything recorded before it.
+void display_list_barrier(display_list_t *list, display_draw_fn_t draw, const void *params, size_t params_size);
+
+/// One command per segment, drawn as rafgl_raster_draw_lines would.
+void display_list_lines(display_list_t *list, const rafgl_line_t *lines, int count);
+
+/// Drawn as rafgl_raster_draw_spritesheet_scaled would.
+void display_list_sprite(display_list_t *list, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y, float scale);
+
+/// Drawn as rafgl_raster_draw_spritesheet_color_insteadof would. The recoloured frame is looked
+/// up when recorded, rafgl's recolour cache is not safe to touch from the tiles.
+void display_list_sprite_recoloured(display_list_t *list, rafgl_spritesheet_t *spritesheet, rafgl_pixel_rgb_t insteadof_color, rafgl_pixel_rgb_t new_color, int sheet_x, int sheet_y, int x, int y);
+
+/// Draws the list into raster, which has to be the size the list was begun with. The
+/// commands stay recorded, so the list can be executed again until the next begin.
+void display_list_execute(display_list_t *list, rafgl_raster_t *raster);
+
+#endif //DISPLAY_LIST_H
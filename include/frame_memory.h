@@ -0,0 +1,66 @@
+#ifndef FRAME_MEMORY_H
+#define FRAME_MEMORY_H
+
+#include "rafgl.h"
+#include "game_constants.h"
+#include <stddef.h>
+
+/// Buffers that are borrowed for one call and given back before it returns.
+/// Freed buffers are kept in power-of-two size classes, so a full-frame
+/// temporary costs a list pop instead of a calloc of several megabytes.
+/// Not thread safe: borrow before a parallel loop, not inside one.
+typedef struct _pool_block_t pool_block_t;
+
+typedef struct {
+    pool_block_t *free_lists[FRAME_POOL_CLASSES];
+    size_t retained_bytes;      /// held in the free lists, capped at FRAME_POOL_MAX_RETAINED
+    int outstanding;            /// borrowed and not yet released
+    long long hits, misses;
+} raster_pool_t;
+
+typedef struct _scratch_chunk_t scratch_chunk_t;
+
+/// Bump allocator for temporaries that may live until the end of the frame.
+/// Nothing is freed on its own; scratch_reset drops everything at once.
+typedef struct {
+    unsigned char *base;
+    size_t capacity;
+    size_t used;
+    size_t high_water;          /// most a frame has asked for, the next reset grows to it
+    scratch_chunk_t *overflow;  /// asked for past capacity this frame, freed on reset
+} scratch_arena_t;
+
+extern raster_pool_t frame_pool;
+extern scratch_arena_t frame_scratch;
+
+/// Contents are undefined, as with malloc.
+void *raster_pool_acquire(raster_pool_t *pool, size_t bytes);
+
+void raster_pool_release(raster_pool_t *pool, void *buffer);
+
+/// Borrows a width x height raster; release it with raster_pool_release_raster, never rafgl_raster_cleanup.
+void raster_pool_acquire_raster(raster_pool_t *pool, rafgl_raster_t *raster, int width, int height);
+
+void raster_pool_release_raster(raster_pool_t *pool, rafgl_raster_t *raster);
+
+void raster_pool_cleanup(raster_pool_t *pool);
+
+void scratch_init(scratch_arena_t *arena, size_t capacity);
+
+/// Aligned to FRAME_MEMORY_ALIGNMENT. Contents are undefined.
+void *scratch_alloc(scratch_arena_t *arena, size_t bytes);
+
+/// A width x height raster in scratch, gone at the next reset.
+void scratch_alloc_raster(scratch_arena_t *arena, rafgl_raster_t *raster, int width, int height);
+
+void scratch_reset(scratch_arena_t *arena);
+
+void scratch_cleanup(scratch_arena_t *arena);
+
+/// Called at the top of every frame: drops last frame's scratch and, in debug
+/// builds, asserts that every pooled buffer borrowed since was given back.
+void frame_memory_begin_frame();
+
+void frame_memory_cleanup();
+
+#endif //FRAME_MEMORY_H
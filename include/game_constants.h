@@ -1,7 +1,7 @@
 #ifndef GAME_CONSTANTS_H_INCLUDED
 #define GAME_CONSTANTS_H_INCLUDED
 
-#define RASTER_WIDTH (1080)
+#define RASTER_WIDTH (1080)     /// default window size, everything else follows the actual window
 #define RASTER_HEIGHT (1080)
 
 /// SMOKE PARTICLES
@@ -9,6 +9,13 @@
 #define SMOKE_SPRITE_WIDTH 32
 #define SMOKE_SPRITE_HEIGHT 32
 #define MAX_SMOKE_PARTICLES 250
+#define SMOKE_LIFESPAN 5.0
+
+/// PARTICLE ENGINE
+
+#define PARTICLE_POOL_CAPACITY (1 << 18)
+#define PARTICLE_MAX_EMITTERS 16
+#define PARTICLE_PARALLEL_THRESHOLD 16384
 
 /// BACKGROUND STARS
 
@@ -25,8 +32,101 @@
 #define FARTHEST_STAR_COUNT 300
 
 /// HYPERSPEED STARS
-#define MAX_HYPER_STARS 2000
+#define MAX_HYPER_STARS 100000      /// starfield capacity, the live count is picked at runtime
+#define HYPER_STAR_COUNT 2000       /// default count, streak brightness is tuned for it
 #define HYPER_STAR_SPEED 1.0
+#define HYPER_STAR_MAX_DEPTH 101.0f
+#define HYPER_STREAK_MIN_INTENSITY 0.25f
+#define HYPER_TRAIL_DECAY 200   /// trails keep 200/256 of their brightness each frame
+#define HYPER_STAR_BAND_HEIGHT 32
+#define HYPER_SHAKE_GROWTH 2.0f     /// camera shake amplitude gained per second of hyperdrive, in pixels
+#define HYPER_SHAKE_MAX 10.0f
+#define HYPER_STAR_PARALLEL_THRESHOLD 16384
+
+/// SIMULATION
+#define SIM_STEP (1.0 / 60.0)           /// seconds per simulation step, gameplay was tuned at 60 updates a second
+#define SIM_MAX_STEPS_PER_FRAME 8       /// a longer stall is dropped instead of replayed
+#define ORBIT_TIME_SCALE 3.0f           /// orbit advance per second for the innermost planet, outer ones scale with their index
+
+/// REPLAY
+#define REPLAY_KEY_RANGE 400            /// size of rafgl's key state arrays
+#define REPLAY_MAX_KEYS 16              /// keys logged per frame, further keys are dropped
+#define REPLAY_KEY_DOWN 0x8000          /// flags in the top bits of a logged key
+#define REPLAY_KEY_PRESSED 0x4000
+#define REPLAY_KEY_MASK 0x3fff
+
+/// FRAME BUDGET
+#define TARGET_FPS 60.0f
+#define FRAME_BUDGET 0.85f              /// share of the frame the work may take, the rest is left to the driver
+
+/// QUALITY GOVERNOR
+#define QUALITY_LEVELS 5
+#define QUALITY_SMOOTHING 0.1f          /// weight of the newest frame in the smoothed frame time
+#define QUALITY_UPGRADE_RATIO 0.7f      /// step up only while under this share of the budget
+#define QUALITY_UPGRADE_DELAY 2.0f      /// seconds that have to pass under it first
+#define QUALITY_SETTLE_TIME 0.25f       /// seconds of frame time to let the smoothed time settle after a step
+#define QUALITY_DECISION_LOG 64
+
+/// DYNAMIC RESOLUTION
+#define RESOLUTION_MIN_SCALE 0.25f
+#define RESOLUTION_MAX_SCALE 1.0f
+#define RESOLUTION_SCALE_STEP 0.0625f
+#define RESOLUTION_SMOOTHING 0.1f       /// weight of the newest frame in the smoothed frame time
+#define RESOLUTION_HEADROOM 0.9f        /// a step up must be predicted to land under this share of the budget
+#define RESOLUTION_COOLDOWN 0.5f        /// seconds of frame time to let the smoothed time settle after a change
+
+/// PERFORMANCE HUD
+#define HUD_LINES 7
+#define HUD_COLUMNS 32
+#define HUD_REFRESH_TIME 0.25f          /// seconds samples are averaged over before the text is refreshed
+#define HUD_TEXT_R 170
+#define HUD_TEXT_G 255
+#define HUD_TEXT_B 170
+#define HUD_BACKGROUND_R 8
+#define HUD_BACKGROUND_G 10
+#define HUD_BACKGROUND_B 24
+
+/// DISPLAY LIST
+#define DISPLAY_TILE_SIZE 64            /// commands are binned into square screen tiles this wide, 16 KB of pixels each
+#define DISPLAY_LIST_INITIAL 256        /// commands a list has room for before it first grows
+
+/// PIXEL KERNELS
+#define KERNEL_LANES 4                  /// pixels per inner group, one 128-bit vector of rgba
+#define KERNEL_PARALLEL_PIXELS 65536    /// smaller passes stay on one thread
+
+/// RADIAL BLUR
+#define RADIAL_BLUR_TAP_BITS 2                      /// each pass averages 2^2 samples
+#define RADIAL_BLUR_TAPS (1 << RADIAL_BLUR_TAP_BITS)
+#define RADIAL_BLUR_MAX_ZOOM 0.25f                  /// streak length at the height of the black hole entry, as a share of the distance to the hole
+
+/// BLOOM
+#define BLOOM_MAX_LEVELS 6              /// the deepest level is 1/64 of the frame across
+#define BLOOM_THRESHOLD 160             /// brightest channel a pixel needs before it starts to glow
+#define BLOOM_BLUR_RADIUS 2             /// gaussian radius at every level past the first
+#define BLOOM_LEVEL_KEEP 32             /// share of its own light a level keeps when the next is folded in, out of 256
+#define BLOOM_STRENGTH 4.0f             /// light added, as a share of what was extracted
+
+/// POST PROCESSING
+#define POST_MAX_EFFECTS 8
+
+/// RENDER GRAPH
+#define RENDER_MAX_PASSES 16
+#define RENDER_MAX_RESOURCES 16
+#define RENDER_MAX_PASS_IO 4            /// rasters one pass may read, and as many it may write
+#define RENDER_MAX_SLOTS 8
+
+/// FRAME MEMORY
+#define FRAME_MEMORY_ALIGNMENT 64                   /// one cache line
+#define FRAME_POOL_MIN_CLASS 12                     /// smallest pooled block is 2^12 bytes
+#define FRAME_POOL_CLASSES 20                       /// largest is 2^31
+#define FRAME_POOL_MAX_RETAINED (96u << 20)         /// bytes kept for reuse, released blocks past it are freed
+#define FRAME_SCRATCH_INITIAL (256u << 10)
+#define MEMORY_BUDGET (512ll << 20)                 /// peak raster memory a run may reach, checked at exit
+
+/// ASSET CACHE
+#define ASSET_CACHE_DIR "cache"
+#define ASSET_CACHE_VARIANTS 32                          /// default for texture_variants
+#define ASSET_CACHE_MAX_BYTES (ASSET_CACHE_VARIANTS * (18L << 20))   /// a 1080p galaxy and planet per variant, so the pool never churns
 
 
 
@@ -0,0 +1,54 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include "rafgl.h"
+#include "game_constants.h"
+
+/// What the HUD shows; the game fills one in every frame.
+typedef struct {
+    float frame_time;
+    float sim_time, draw_time, upload_time, swap_time;
+    int sim_steps;
+    int particles;
+    int hyper_stars;
+    int background_stars;
+    double allocated_bytes;     /// bytes allocated during the frame
+    double live_bytes;          /// raster memory held at the end of it
+    int quality_level;
+    float resolution_scale;
+} hud_sample_t;
+
+/// Performance overlay. Samples are averaged over HUD_REFRESH_TIME and the text is
+/// kept in a small raster of its own, so a line is only redrawn when its text changes
+/// and a frame with the HUD on costs two small copies, the HUD in and the pixels under it back.
+typedef struct {
+    rafgl_raster_t raster;
+    rafgl_raster_t under;       /// the frame pixels the HUD covers while it is drawn
+    rafgl_raster_t *covered;    /// frame the HUD is drawn on, until hud_erase
+    int covered_width, covered_height;
+    char lines[HUD_LINES][HUD_COLUMNS + 1];
+    hud_sample_t sum;
+    float worst_frame_time;
+    int samples;
+    float refresh_timer;
+    int visible;
+    int redraws;                /// lines redrawn since init
+} hud_t;
+
+void hud_init(hud_t *hud);
+
+void hud_cleanup(hud_t *hud);
+
+/// Accumulates a frame's sample and refreshes the text once HUD_REFRESH_TIME has passed.
+void hud_update(hud_t *hud, const hud_sample_t *sample, float delta_time);
+
+/// Copies the HUD into the top left corner of the frame, pixel for pixel. It is not scaled
+/// with the frame: a frame rendered below window size is stretched, and the HUD with it.
+/// The pixels it covers are kept, and have to be put back with hud_erase once the frame is uploaded.
+void hud_draw(hud_t *hud, rafgl_raster_t *frame);
+
+/// Puts back what the last hud_draw covered, so a frame that stays up, like the game over
+/// one, never carries the HUD into the next frame.
+void hud_erase(hud_t *hud);
+
+#endif //HUD_H
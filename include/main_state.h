@@ -9,4 +9,15 @@ void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *
 void main_state_render(GLFWwindow *window, void *args);
 void main_state_cleanup(GLFWwindow *window, void *args);
 
+/// Logs this session's input to path, to be played back with main_state_replay_from.
+void main_state_record_to(const char *path);
+
+/// Plays a logged session back instead of live input. The window must be made at
+/// the width and height it was recorded at; returns 0 if path isn't a replay.
+int main_state_replay_from(const char *path, int *width, int *height);
+
+/// Runs the simulation for steps fixed steps without a window, as fast as it goes.
+/// Returns 1 if the run ended in a crash, 2 if raster memory peaked over MEMORY_BUDGET.
+int main_state_run_headless(int width, int height, long long steps, unsigned int seed);
+
 #endif // MAIN_STATE_H_INCLUDED
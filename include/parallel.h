@@ -0,0 +1,41 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+
+/// Thread parallelism is opt-in: build with OPENMP=1 (-fopenmp) to spread the
+/// marked loops across cores. Without it the pragmas expand to nothing.
+
+#define PARALLEL_PRAGMA(x) _Pragma(#x)
+
+#ifdef _OPENMP
+#include <omp.h>
+#define PARALLEL_FOR PARALLEL_PRAGMA(omp parallel for schedule(static))
+#define PARALLEL_FOR_IF(cond) PARALLEL_PRAGMA(omp parallel for schedule(static) if(cond))
+#define PARALLEL_FOR_DYNAMIC PARALLEL_PRAGMA(omp parallel for schedule(dynamic, 1))
+#define parallel_thread_count() omp_get_max_threads()
+#define parallel_thread_id() omp_get_thread_num()
+#else
+#define PARALLEL_FOR
+#define PARALLEL_FOR_IF(cond)
+#define PARALLEL_FOR_DYNAMIC
+#define parallel_thread_count() 1
+#define parallel_thread_id() 0
+#endif
+
+/// integer hash used in place of rand(), so parallel loops have no shared state
+static inline uint32_t parallel_hash(uint32_t v) {
+    v ^= v >> 16;
+    v *= 0x7feb352dU;
+    v ^= v >> 15;
+    v *= 0x846ca68bU;
+    v ^= v >> 16;
+    return v;
+}
+
+/// the top 24 bits of a hash as a float in [0, 1)
+static inline float hash_to_unit(uint32_t h) {
+    return (float)(h >> 8) * (1.0f / 16777216.0f);
+}
+
+#endif //PARALLEL_H
@@ -0,0 +1,76 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include "rafgl.h"
+#include "game_constants.h"
+#include "display_list.h"
+#include <stdint.h>
+
+/// Sprite sheet converted to premultiplied alpha at load time.
+/// Colour-keyed pixels become fully transparent.
+typedef struct {
+    int frame_width, frame_height;
+    int width, height;
+    rafgl_pixel_rgb_t *pixels;
+} particle_sprite_t;
+
+/// Structure-of-arrays particle storage shared by every emitter.
+/// Dead particles are removed by a stable compaction, so index order
+/// is always spawn order.
+typedef struct {
+    int capacity;
+    int count;
+
+    float *x, *y;
+    float *vx, *vy;
+    float *life;
+    float *lifespan;
+    float *jitter;
+    uint8_t *frame;
+    uint8_t *emitter;
+
+    int num_emitters;
+    struct _particle_emitter_t *emitters[PARTICLE_MAX_EMITTERS];
+    int emitter_alive[PARTICLE_MAX_EMITTERS];
+
+    uint32_t rng;
+    uint32_t tick;
+} particle_pool_t;
+
+typedef struct _particle_emitter_t {
+    particle_pool_t *pool;
+    int id;
+
+    float lifespan;
+    float speed;
+    float spread;           /// angular spread of the initial velocity, in radians
+    float spawn_radius;     /// particles spawn within +-spawn_radius of the emission point
+    float jitter;           /// random walk per update, in pixels
+    int max_alive;
+
+    particle_sprite_t *sprite;
+    int sprite_row;
+    int frame_count;
+} particle_emitter_t;
+
+void particle_sprite_init(particle_sprite_t *sprite, rafgl_spritesheet_t *sheet);
+
+void particle_sprite_cleanup(particle_sprite_t *sprite);
+
+void particle_pool_init(particle_pool_t *pool, int capacity);
+
+void particle_pool_cleanup(particle_pool_t *pool);
+
+void particle_pool_clear(particle_pool_t *pool);
+
+void particle_emitter_init(particle_emitter_t *emitter, particle_pool_t *pool, particle_sprite_t *sprite, int sprite_row, int frame_count, float lifespan, int max_alive);
+
+void particle_emit(particle_emitter_t *emitter, float x, float y, float angle, int count);
+
+void particle_pool_update(particle_pool_t *pool, float delta_time);
+
+/// Records one blended sprite per live particle. Positions are in world units and are
+/// multiplied by scale to land on the raster; sprites keep their native size.
+void particle_pool_draw(particle_pool_t *pool, display_list_t *list, float scale);
+
+#endif //PARTICLES_H
@@ -0,0 +1,97 @@
+#ifndef PIXEL_KERNEL_H
+#define PIXEL_KERNEL_H
+
+#include "rafgl.h"
+#include "game_constants.h"
+#include "parallel.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#if KERNEL_LANES != 4
+#error "the SSE2 lanes hold one 128-bit vector of rgba"
+#endif
+#endif
+
+/// Row-major per-pixel passes. A pass is written as one function of a pixel,
+///
+///     KERNEL_INLINE void fn(const params_t *params, rafgl_pixel_rgb_t *pixel, int x, int y)
+///
+/// and PIXEL_KERNEL generates the loop around it: rows outermost with the row pointer
+/// fetched once per row, each row walked in KERNEL_LANES wide groups and a scalar tail.
+/// A threaded pass splits its rows across cores once the rectangle reaches
+/// KERNEL_PARALLEL_PIXELS; a pass that calls rand() or reads pixels it has already
+/// written has to stay on one thread to keep its output.
+///
+/// A hot pass can also be written for a whole group,
+///
+///     KERNEL_INLINE void fn_lanes(const params_t *params, rafgl_pixel_rgb_t *pixels, int x, int y)
+///
+/// doing pixels[0] to pixels[KERNEL_LANES - 1] at x to x + KERNEL_LANES - 1 with SSE2, bit
+/// for bit as fn would. PIXEL_KERNEL_LANES runs the groups through it in SSE2 builds and
+/// is PIXEL_KERNEL elsewhere, so fn_lanes only has to exist under __SSE2__.
+
+/// inlined even in unoptimised builds, or every pixel would pay for a call
+#ifdef __GNUC__
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE static inline
+#endif
+
+/// the loop every kernel shares, with group doing the pixels at x to x + KERNEL_LANES - 1
+#define PIXEL_KERNEL_LOOP(name, params_t, fn, group, threaded)                                      \
+static void name(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, const params_t *params) { \
+    x0 = rafgl_max_m(x0, 0);                                                                        \
+    y0 = rafgl_max_m(y0, 0);                                                                        \
+    x1 = rafgl_min_m(x1, raster->width);                                                            \
+    y1 = rafgl_min_m(y1, raster->height);                                                           \
+    if (x0 >= x1 || y0 >= y1) return;                                                               \
+                                                                                                    \
+    PARALLEL_FOR_IF((threaded) && (x1 - x0) * (y1 - y0) >= KERNEL_PARALLEL_PIXELS)                  \
+    for (int y = y0; y < y1; y++) {                                                                 \
+        rafgl_pixel_rgb_t *row = rafgl_row_pm(raster, y);                                           \
+        int x = x0;                                                                                 \
+        for (; x + KERNEL_LANES <= x1; x += KERNEL_LANES) {                                         \
+            group;                                                                                  \
+        }                                                                                           \
+        for (; x < x1; x++) fn(params, &row[x], x, y);                                              \
+    }                                                                                               \
+}
+
+#define KERNEL_GROUP_SCALAR(fn) for (int lane = 0; lane < KERNEL_LANES; lane++) fn(params, &row[x + lane], x + lane, y)
+
+/// Defines static void name(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, const params_t *params),
+/// running fn over [x0, x1) x [y0, y1) clipped to the raster.
+#define PIXEL_KERNEL(name, params_t, fn, threaded) PIXEL_KERNEL_LOOP(name, params_t, fn, KERNEL_GROUP_SCALAR(fn), threaded)
+
+/// PIXEL_KERNEL with the groups done by fn_lanes in SSE2 builds.
+#ifdef __SSE2__
+#define PIXEL_KERNEL_LANES(name, params_t, fn, fn_lanes, threaded) PIXEL_KERNEL_LOOP(name, params_t, fn, fn_lanes(params, &row[x], x, y), threaded)
+#else
+#define PIXEL_KERNEL_LANES(name, params_t, fn, fn_lanes, threaded) PIXEL_KERNEL(name, params_t, fn, threaded)
+#endif
+
+/// the rectangle arguments of a pass over the whole raster
+#define KERNEL_WHOLE(raster) 0, 0, (raster)->width, (raster)->height
+
+#ifdef __SSE2__
+#define KERNEL_RGB_MASK _mm_set1_epi32(0x00ffffff)
+
+/// the four channels of each of the four pixels as floats, pixel i in out[i]
+KERNEL_INLINE void kernel_unpack_ps(__m128i pixels, __m128 *out) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(pixels, zero), hi = _mm_unpackhi_epi8(pixels, zero);
+    out[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+    out[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+    out[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+    out[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+}
+
+/// back to bytes, truncated and clamped to 0-255 as a cast of a float channel would be
+KERNEL_INLINE __m128i kernel_pack_ps(const __m128 *in) {
+    __m128i lo = _mm_packs_epi32(_mm_cvttps_epi32(in[0]), _mm_cvttps_epi32(in[1]));
+    __m128i hi = _mm_packs_epi32(_mm_cvttps_epi32(in[2]), _mm_cvttps_epi32(in[3]));
+    return _mm_packus_epi16(lo, hi);
+}
+#endif
+
+#endif //PIXEL_KERNEL_H
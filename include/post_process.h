@@ -0,0 +1,85 @@
+#ifndef POST_PROCESS_H
+#define POST_PROCESS_H
+
+#include "rafgl.h"
+#include "game_constants.h"
+
+/// Full-screen effects are pushed onto a stack instead of run one after another. Each is
+/// either a colour op, a function of one pixel and where it sits, or a gather op, which
+/// only picks the pixel a destination pixel is read from. Compiling the stack chains the
+/// gathers into one source coordinate and places every colour op at the coordinate its
+/// input had, so the whole stack costs one read and one write of the frame.
+typedef enum {
+    POST_COLOUR,
+    POST_GATHER
+} post_kind_t;
+
+typedef enum {
+    POST_VIGNETTE,
+    POST_WHITEOUT,
+    POST_DISTORTION
+} post_op_t;
+
+typedef struct {
+    int cx, cy;
+    float r;
+    float vignette_factor;
+    float proximity_factor;
+    int tinted;                         /// close to the sun or the hole, blend towards its colour
+    float vignette_r, vignette_g, vignette_b;
+    int step;                           /// tint computed once per step x step block
+    const float *block_tint;            /// filled in by compile when step > 1
+    const int *block_column, *block_row;
+} post_vignette_t;
+
+typedef struct {
+    float white_factor;
+} post_whiteout_t;
+
+typedef struct {
+    float distortion_factor;
+    int step;                           /// displacement sampled once per step x step block
+    int width, height;                  /// the rest is filled in by compile
+    const float *offset_x, *offset_y;
+    const int *origin_x, *origin_y;
+} post_distortion_t;
+
+typedef struct {
+    post_op_t op;
+    post_kind_t kind;
+    int stage;                          /// gathers after this op; a colour op runs at that coordinate
+    union {
+        post_vignette_t vignette;
+        post_whiteout_t whiteout;
+        post_distortion_t distortion;
+    };
+} post_effect_t;
+
+typedef struct {
+    post_effect_t effects[POST_MAX_EFFECTS];
+    int count;
+    int gathers;
+    int compiled_width, compiled_height;    /// 0 until compiled
+} post_stack_t;
+
+void post_stack_clear(post_stack_t *stack);
+
+/// step 0 leaves the vignette out.
+void post_push_vignette(post_stack_t *stack, int cx, int cy, float vignette_factor, float rocket_sun_dist, float vignette_r, float vignette_g, float vignette_b, float r, int step);
+
+void post_push_whiteout(post_stack_t *stack, float white_factor);
+
+void post_push_distortion(post_stack_t *stack, float distortion_factor, int step);
+
+/// Drops effects that would change nothing and builds the lookup tables for a width x height
+/// frame. The tables live in frame scratch, so a compiled stack is good for one frame.
+void post_stack_compile(post_stack_t *stack, int width, int height);
+
+/// Runs the compiled stack from src into dst in one pass. dst may be src only when the stack has no gathers.
+void post_stack_run(const post_stack_t *stack, rafgl_raster_t *dst, const rafgl_raster_t *src);
+
+/// Compiles and runs the stack over frame. With a gather in it the result is written to spare,
+/// which must be the frame's size, and the two are swapped; otherwise frame is changed in place.
+void post_stack_apply(post_stack_t *stack, rafgl_raster_t *frame, rafgl_raster_t *spare);
+
+#endif //POST_PROCESS_H
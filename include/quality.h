@@ -0,0 +1,66 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+#include "rafgl.h"
+#include "game_constants.h"
+
+/// One rung of the quality ladder. Rung 0 is full quality.
+typedef struct {
+    int vignette_step;          /// vignette tint is computed once per step x step block, 0 turns it off
+    int blur_radius;
+    int particle_cap;           /// live smoke particles, 0 turns smoke off
+    float hyper_star_fraction;  /// share of hyper_stars that is simulated
+    float fisheye_radius;       /// lens radius in black hole radii
+    int distortion_step;        /// screen distortion samples once per step x step block
+    int radial_blur_passes;     /// black hole zoom blur passes, each multiplies its samples by RADIAL_BLUR_TAPS
+    int bloom_levels;           /// glow pyramid depth, 0 turns bloom off
+} quality_level_t;
+
+typedef struct {
+    int frame;                  /// frame the decision was taken on
+    int from_level, to_level;
+    float frame_time;           /// smoothed frame time that triggered it
+} quality_decision_t;
+
+typedef struct {
+    int frames;
+    int frames_over_budget;
+    int downgrades, upgrades;
+    float worst_frame_time;
+    int frames_at_level[QUALITY_LEVELS];
+    int decision_count;         /// every decision taken, the log keeps the last QUALITY_DECISION_LOG
+} quality_stats_t;
+
+/// Steps through the ladder to keep the smoothed frame time under budget.
+/// It steps down as soon as the budget is exceeded. It steps up only after
+/// frames have stayed under QUALITY_UPGRADE_RATIO of the budget for
+/// QUALITY_UPGRADE_DELAY without a break, so it cannot flap between two rungs.
+typedef struct {
+    int level;
+    float budget;               /// seconds of work allowed per frame
+    float frame_time;           /// smoothed work time of recent frames
+    float cooldown;             /// seconds of frame time left for the last step to settle
+    float comfortable;          /// seconds spent under the upgrade line without a break
+    int enabled;
+
+    quality_stats_t stats;
+    quality_decision_t decisions[QUALITY_DECISION_LOG];
+} quality_governor_t;
+
+void quality_init(quality_governor_t *governor, float budget, int enabled);
+
+/// Feeds the work time of the last frame, returns 1 when the level changed.
+int quality_update(quality_governor_t *governor, float frame_time);
+
+const quality_level_t *quality_current(const quality_governor_t *governor);
+
+int quality_is_lowest(const quality_governor_t *governor);
+
+void quality_get_stats(const quality_governor_t *governor, quality_stats_t *stats);
+
+/// Copies up to max of the most recent decisions into out, oldest first, and returns how many were copied.
+int quality_get_decisions(const quality_governor_t *governor, quality_decision_t *out, int max);
+
+void quality_print_stats(const quality_governor_t *governor);
+
+#endif //QUALITY_H
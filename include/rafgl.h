@@ -5,6 +5,10 @@
 #include <stdio.h>
 #include <math.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
@@ -32,9 +36,42 @@
 
 #define RAFGL_LINE_SIZE 7
 
+/* frame passes timed by rafgl_game_start; events is input polling and whatever else falls between the others */
+#define RAFGL_PASS_EVENTS   0
+#define RAFGL_PASS_UPDATE   1
+#define RAFGL_PASS_RENDER   2
+#define RAFGL_PASS_SWAP     3
+#define RAFGL_PASS_TOTAL    4
+#define RAFGL_PASS_COUNT    5
+
+/* log-linear buckets: exact below 64 us, then 32 buckets per power of two (about 3%), up to 2^24 us */
+#define RAFGL_HISTOGRAM_SUB_BITS 5
+#define RAFGL_HISTOGRAM_MAX_BITS 24
+#define RAFGL_HISTOGRAM_BUCKETS ((RAFGL_HISTOGRAM_MAX_BITS - RAFGL_HISTOGRAM_SUB_BITS + 1) << RAFGL_HISTOGRAM_SUB_BITS)
+#define RAFGL_STUTTER_FACTOR 2.0f
+#define RAFGL_STUTTER_WARMUP 60
+#define RAFGL_STUTTER_LOG 64
+
+/* raster memory is charged to the tag current at allocation; 0 and 1 are predefined, the rest are named by the game */
+#define RAFGL_MEMORY_MAX_TAGS 16
+#define RAFGL_MEMORY_UNTAGGED 0
+#define RAFGL_MEMORY_LIBRARY 1      /* rafgl's own rasters (fonts), released with the library and not reported as leaks */
+#define RAFGL_MEMORY_ALL -1
+
+/* rafgl_raster_init_aligned starts every row on a cache line, so rows are padded to a multiple of 16 pixels */
+#define RAFGL_RASTER_ALIGNMENT 64
 
-#define pixel_at_m(r, x, y) (*(r.data + (y) * r.width + (x)))
-#define pixel_at_pm(r, x, y) (*(r->data + (y) * r->width + (x)))
+#define RAFGL_RASTER_ALIGNED    1
+#define RAFGL_RASTER_VIEW       2   /* data belongs to another raster, cleanup leaves it alone */
+
+#define RAFGL_RECOLOUR_CACHE_SIZE 16
+#define RAFGL_RECOLOUR_VARIANTS 4
+
+
+#define pixel_at_m(r, x, y) (*(r.data + (y) * r.stride + (x)))
+#define pixel_at_pm(r, x, y) (*(r->data + (y) * r->stride + (x)))
+/* first pixel of row y */
+#define rafgl_row_pm(r, y) ((r)->data + (y) * (r)->stride)
 
 
 #define rafgl_abs_m(x) ((x) >= 0 ? (x) : -(x))
@@ -96,14 +133,40 @@ typedef struct _rafgl_raster
 {
     int width, height;
     rafgl_pixel_rgb_t *data;
+    int stride;             /* pixels from the start of one row to the next, at least width */
+    int tag;                /* memory tag the pixels are charged to */
+    int flags;              /* RAFGL_RASTER_* */
 } rafgl_raster_t;
 
+typedef struct _rafgl_line_t
+{
+    int x0, y0, x1, y1;
+    uint32_t colour;
+} rafgl_line_t;
+
+typedef struct _rafgl_streak_t
+{
+    float x0, y0;       /* head, drawn at full intensity */
+    float x1, y1;       /* tail, fades out to nothing */
+    uint32_t colour;
+    float intensity;    /* [0, 1] */
+} rafgl_streak_t;
+
+typedef struct _rafgl_sprite_span_t
+{
+    uint16_t y, x, length;
+} rafgl_sprite_span_t;
+
 typedef struct _rafgl_spritesheet_t
 {
     rafgl_raster_t sheet;
     int sheet_width, sheet_height;
     int frame_width, frame_height;
 
+    /* opaque runs of every frame, NULL until rafgl_spritesheet_compile is called */
+    rafgl_sprite_span_t *spans;
+    int *frame_span_start;
+
 } rafgl_spritesheet_t;
 
 typedef struct _rafgl_texture_t
@@ -141,6 +204,39 @@ typedef struct _rafgl_game_data_t
 
 } rafgl_game_data_t;
 
+typedef struct _rafgl_histogram_t
+{
+    uint32_t counts[RAFGL_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    double sum, max;
+} rafgl_histogram_t;
+
+/* all times in seconds */
+typedef struct _rafgl_frame_stats_t
+{
+    uint64_t count;
+    double mean, p50, p90, p99, p999, max;
+} rafgl_frame_stats_t;
+
+typedef struct _rafgl_stutter_t
+{
+    uint64_t frame;
+    float total, median;
+    int pass;               /* the pass furthest over its own median */
+    float pass_time, pass_median;
+} rafgl_stutter_t;
+
+typedef struct _rafgl_memory_stats_t
+{
+    const char *name;
+    int64_t live_bytes, peak_bytes;
+    int live_count;
+    uint64_t allocations, frees;
+    uint64_t allocated_bytes;       /* running total */
+    int frame_allocations;          /* during the last finished frame */
+    int64_t frame_bytes;
+} rafgl_memory_stats_t;
+
 typedef struct _rafgl_game_state_t
 {
     int id;
@@ -197,18 +293,55 @@ void rafgl_window_set_title(const char *name);
 
 /* allocates and NULLs the needed memory for the raster */
 int rafgl_raster_init(rafgl_raster_t *raster, int width, int height);
+/* like rafgl_raster_init, but data and every row start on a RAFGL_RASTER_ALIGNMENT boundary; stride is padded to fit */
+int rafgl_raster_init_aligned(rafgl_raster_t *raster, int width, int height);
+/* a non-owning window (x, y, width, height) into parent, clipped to it; drawing into the view draws into the parent */
+void rafgl_raster_view(rafgl_raster_t *view, const rafgl_raster_t *parent, int x, int y, int width, int height);
+/* copies the pixels of a raster of the same size, row by row, so either side may be padded or a view */
+void rafgl_raster_copy_pixels(rafgl_raster_t *to, const rafgl_raster_t *from);
+/* sets every pixel, padding excluded */
+void rafgl_raster_fill(rafgl_raster_t *raster, uint32_t colour);
+/* alignment must be a power of two; memory from it is released with rafgl_aligned_free only */
+void *rafgl_aligned_alloc(size_t alignment, size_t bytes);
+void rafgl_aligned_free(void *p);
 /* copies the raster (resizes destination raster to fit the source raster) */
 int rafgl_raster_copy(rafgl_raster_t *raster_to, rafgl_raster_t *raster_from);
 /* reads an image from the disk and loads it into the raster (raster should NOT BE "inited" beforehand */
 int rafgl_raster_load_from_image(rafgl_raster_t *raster, const char *image_path);
 /* */
 int rafgl_raster_save_to_png(rafgl_raster_t *raster, const char *image_path);
-/* free */
+/* free, data is left NULL so a second cleanup is harmless */
 int rafgl_raster_cleanup(rafgl_raster_t *raster);
 
+/* id of the named tag, registered on first use; name must outlive the program (a literal) */
+int rafgl_memory_tag(const char *name);
+/* rasters allocated from now on are charged to tag, returns the tag that was current */
+int rafgl_memory_set_tag(int tag);
+/* charges bytes (negative when freed) to tag, for allocators outside rafgl that want to show up in the report */
+void rafgl_memory_track(int tag, int64_t bytes);
+/* closes the per-frame counters; rafgl_game_start calls it after every frame */
+void rafgl_memory_end_frame(void);
+int rafgl_memory_tag_count(void);
+/* tag or RAFGL_MEMORY_ALL for the totals, whose peak is the peak of the sum */
+void rafgl_memory_stats(int tag, rafgl_memory_stats_t *stats);
+void rafgl_memory_report(void);
+/* logs every tag still holding memory, except RAFGL_MEMORY_LIBRARY, and returns the bytes they hold */
+int64_t rafgl_memory_leak_report(void);
+
 void rafgl_spritesheet_init(rafgl_spritesheet_t *spritesheet, const char *sheet_path, int sheet_width, int sheet_height);
+/* precompiles every frame into run-length spans of non colour-keyed pixels, spritesheet draws then become span copies */
+int rafgl_spritesheet_compile(rafgl_spritesheet_t *spritesheet);
+/* free */
+void rafgl_spritesheet_cleanup(rafgl_spritesheet_t *spritesheet);
+/* drops every cached recoloured frame built by rafgl_raster_draw_spritesheet_color_insteadof */
+void rafgl_recolour_cache_clear(void);
 void rafgl_raster_draw_spritesheet(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y);
+/* draws the frame resized by scale with nearest sampling, (x, y) is the top left corner on the raster */
+void rafgl_raster_draw_spritesheet_scaled(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y, float scale);
 void rafgl_raster_draw_spritesheet_color_insteadof(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, rafgl_pixel_rgb_t insteadof_color, rafgl_pixel_rgb_t new_color, int sheet_x, int sheet_y, int x, int y);
+/* the frame as rafgl_raster_draw_spritesheet_color_insteadof would draw it, frame_width x frame_height with colour-keyed
+   pixels left keyed; it lives in the recolour cache, so it is only good until the cache is next used */
+const rafgl_pixel_rgb_t* rafgl_spritesheet_recoloured_frame(rafgl_spritesheet_t *spritesheet, rafgl_pixel_rgb_t insteadof_color, rafgl_pixel_rgb_t new_color, int sheet_x, int sheet_y);
 
 
 void rafgl_log(int level, const char *format, ...);
@@ -296,15 +429,49 @@ int rafgl_raster_draw_raster(rafgl_raster_t *to, rafgl_raster_t *from, int x, in
 
 void rafgl_raster_draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour);
 void rafgl_raster_draw_line_custom(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour);
+/* draws count segments, clipping them all up front; horizontal and vertical ones become straight fills */
+void rafgl_raster_draw_lines(rafgl_raster_t *raster, const rafgl_line_t *lines, int count);
+/* same as rafgl_raster_draw_lines, but with a size x size brush anchored at the top left of every point */
+void rafgl_raster_draw_lines_thick(rafgl_raster_t *raster, const rafgl_line_t *lines, int count, int size);
+/* same as rafgl_raster_draw_lines, but only pixels inside [x0, x1) x [y0, y1) are written; every segment
+   still rasterises exactly as it would without the rectangle, so drawing it piecewise gives the same pixels */
+void rafgl_raster_draw_lines_rect(rafgl_raster_t *raster, const rafgl_line_t *lines, int count, int x0, int y0, int x1, int y1);
+/* fills row y from x0 to x1 (both inclusive, in any order), clipped to the raster */
+void rafgl_raster_draw_span(rafgl_raster_t *raster, int x0, int x1, int y, uint32_t colour);
+/* additively blends anti-aliased (Wu) streaks that fade from head to tail, clipped to the raster */
+void rafgl_raster_draw_streaks(rafgl_raster_t *raster, const rafgl_streak_t *streaks, int count);
+/* scales the colour of every pixel by factor / 256, alpha is left alone */
+void rafgl_raster_fade(rafgl_raster_t *raster, int factor);
+/* copies from into to (same size) moved by a sub-pixel offset (dx, dy); uncovered pixels get edge_colour */
+void rafgl_raster_offset_blit(rafgl_raster_t *to, rafgl_raster_t *from, float dx, float dy, uint32_t edge_colour);
 void rafgl_raster_draw_circle(rafgl_raster_t *raster, int cx, int cy, int r, uint32_t colour);
 void rafgl_raster_draw_rectangle(rafgl_raster_t *raster, int x0, int y0, int w, int h, uint32_t colour);
 
+/* stretches from over the whole of to, sampling at pixel centres with 8-bit bilinear weights */
 void rafgl_raster_bilinear_upsample(rafgl_raster_t *to, rafgl_raster_t *from);
+/* halves from into to, which must be (width + 1) / 2 x (height + 1) / 2; every pixel is the mean of a
+   2x2 block, and the blocks on an odd edge repeat its last row or column */
+void rafgl_raster_box_downsample(rafgl_raster_t *to, const rafgl_raster_t *from);
 
 int rafgl_raster_draw_string(rafgl_raster_t *raster, const char *s, int x, int y, uint32_t colour, int font_size);
 
 void rafgl_log_fps(int b);
 
+void rafgl_histogram_reset(rafgl_histogram_t *histogram);
+void rafgl_histogram_record(rafgl_histogram_t *histogram, double seconds);
+/* p in [0, 1], the answer is within a bucket's width of the true value */
+double rafgl_histogram_percentile(const rafgl_histogram_t *histogram, double p);
+
+/* frame times since rafgl_game_start, per RAFGL_PASS_* */
+void rafgl_frame_stats(int pass, rafgl_frame_stats_t *stats);
+/* pass times of the last finished frame, RAFGL_PASS_COUNT of them */
+void rafgl_frame_last(double *times);
+/* copies up to max of the latest stutters, oldest first, and returns how many were copied */
+int rafgl_frame_stutters(rafgl_stutter_t *stutters, int max);
+/* interval > 0 logs the frame times of every interval seconds and stutters as they happen; at_exit logs the totals once the window closes */
+void rafgl_log_frame_stats(float interval, int at_exit);
+void rafgl_frame_stats_dump(void);
+
 void rafgl_meshPUN_init(rafgl_meshPUN_t *m);
 void rafgl_meshPUN_load_from_OBJ(rafgl_meshPUN_t *m, const char *obj_path);
 void rafgl_meshPUN_load_from_OBJ_offset(rafgl_meshPUN_t *m, const char *obj_path, vec3_t position_offset);
@@ -397,8 +564,8 @@ static float __raster_corners[] = {
 void __key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
     /* printf("%c %d\n", key, action); */
+    /* a press stays set until the frame clears it, so a tap released in the same poll still counts */
     if(__keys_down[key] == 0 && action != 0) __keys_pressed[key] = 1;
-        else __keys_pressed[key] = 0;
     __keys_down[key] = action;
 
 }
@@ -414,8 +581,10 @@ FILE *__log_files[RAFGL_LOG_LEVELS];
 static float __rafgl_time_from_init = 0;
 void rafgl_log(int level, const char *format, ...)
 {
-    va_list args;
+    va_list args, file_args;
     va_start(args, format);
+    /* a va_list is spent once printed, the log file gets its own copy */
+    va_copy(file_args, args);
     FILE* fd = __log_files[level];
     if(level == RAFGL_ERROR)
     {
@@ -429,7 +598,10 @@ void rafgl_log(int level, const char *format, ...)
         vprintf(format, args);
     }
 
-    vfprintf(fd, format, args);
+    /* there are no log files without rafgl_game_init, e.g. in a headless run */
+    if(fd)
+        vfprintf(fd, format, file_args);
+    va_end(file_args);
     va_end(args);
 }
 
@@ -440,7 +612,7 @@ int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int
     __done = 1;
 
 
-    int i;
+    int i, tag;
     char fnames[255];
     for(i = 0; i < RAFGL_LOG_LEVELS; i++)
     {
@@ -531,9 +703,11 @@ int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int
     glfwSetKeyCallback(__window, __key_callback);
 
     RAFGL_COLOUR_KEY.rgba = rafgl_RGB(255, 0, 249);
+    tag = rafgl_memory_set_tag(RAFGL_MEMORY_LIBRARY);
     rafgl_spritesheet_init(&__mono_char_sheet[0], "res/fonts/chars-small.png", __countx, __county);
     rafgl_spritesheet_init(&__mono_char_sheet[1], "res/fonts/chars.png", __countx, __county);
     rafgl_spritesheet_init(&__mono_char_sheet[2], "res/fonts/chars-large.png", __countx, __county);
+    rafgl_memory_set_tag(tag);
 
     return 0;
 }
@@ -608,19 +782,242 @@ int rafgl_raster_draw_string(rafgl_raster_t *raster, const char *s, int x, int y
 }
 
 
+static rafgl_memory_stats_t __rafgl_memory_tags[RAFGL_MEMORY_MAX_TAGS] = {{"untagged"}, {"rafgl"}};
+static int __rafgl_memory_tag_count = 2;
+static int __rafgl_memory_current_tag = RAFGL_MEMORY_UNTAGGED;
+static int64_t __rafgl_memory_live_bytes = 0, __rafgl_memory_peak_bytes = 0;
+static int __rafgl_memory_frame_allocations[RAFGL_MEMORY_MAX_TAGS];
+static int64_t __rafgl_memory_frame_bytes[RAFGL_MEMORY_MAX_TAGS];
+
+int rafgl_memory_tag(const char *name)
+{
+    int i;
+    for(i = 0; i < __rafgl_memory_tag_count; i++)
+    {
+        if(strcmp(__rafgl_memory_tags[i].name, name) == 0)
+            return i;
+    }
+
+    if(__rafgl_memory_tag_count == RAFGL_MEMORY_MAX_TAGS)
+    {
+        rafgl_log(RAFGL_WARNING, "Out of memory tags, \"%s\" is counted as untagged\n", name);
+        return RAFGL_MEMORY_UNTAGGED;
+    }
+
+    __rafgl_memory_tags[__rafgl_memory_tag_count].name = name;
+    return __rafgl_memory_tag_count++;
+}
+
+int rafgl_memory_set_tag(int tag)
+{
+    int previous = __rafgl_memory_current_tag;
+    __rafgl_memory_current_tag = (tag >= 0 && tag < __rafgl_memory_tag_count) ? tag : RAFGL_MEMORY_UNTAGGED;
+    return previous;
+}
+
+void rafgl_memory_track(int tag, int64_t bytes)
+{
+    rafgl_memory_stats_t *stats;
+
+    if(tag < 0 || tag >= __rafgl_memory_tag_count)
+        tag = RAFGL_MEMORY_UNTAGGED;
+    stats = &__rafgl_memory_tags[tag];
+
+    stats->live_bytes += bytes;
+    __rafgl_memory_live_bytes += bytes;
+
+    if(bytes > 0)
+    {
+        stats->allocations++;
+        stats->allocated_bytes += bytes;
+        stats->live_count++;
+        __rafgl_memory_frame_allocations[tag]++;
+        __rafgl_memory_frame_bytes[tag] += bytes;
+        if(stats->live_bytes > stats->peak_bytes)
+            stats->peak_bytes = stats->live_bytes;
+        if(__rafgl_memory_live_bytes > __rafgl_memory_peak_bytes)
+            __rafgl_memory_peak_bytes = __rafgl_memory_live_bytes;
+    }
+    else if(bytes < 0)
+    {
+        stats->frees++;
+        stats->live_count--;
+    }
+}
+
+void rafgl_memory_end_frame(void)
+{
+    int i;
+    for(i = 0; i < __rafgl_memory_tag_count; i++)
+    {
+        __rafgl_memory_tags[i].frame_allocations = __rafgl_memory_frame_allocations[i];
+        __rafgl_memory_tags[i].frame_bytes = __rafgl_memory_frame_bytes[i];
+        __rafgl_memory_frame_allocations[i] = 0;
+        __rafgl_memory_frame_bytes[i] = 0;
+    }
+}
+
+int rafgl_memory_tag_count(void)
+{
+    return __rafgl_memory_tag_count;
+}
+
+void rafgl_memory_stats(int tag, rafgl_memory_stats_t *stats)
+{
+    const rafgl_memory_stats_t *t;
+    int i;
+
+    if(tag != RAFGL_MEMORY_ALL)
+    {
+        *stats = __rafgl_memory_tags[(tag >= 0 && tag < __rafgl_memory_tag_count) ? tag : RAFGL_MEMORY_UNTAGGED];
+        return;
+    }
+
+    memset(stats, 0, sizeof(rafgl_memory_stats_t));
+    stats->name = "all";
+    for(i = 0; i < __rafgl_memory_tag_count; i++)
+    {
+        t = &__rafgl_memory_tags[i];
+        stats->live_count += t->live_count;
+        stats->allocations += t->allocations;
+        stats->frees += t->frees;
+        stats->allocated_bytes += t->allocated_bytes;
+        stats->frame_allocations += t->frame_allocations;
+        stats->frame_bytes += t->frame_bytes;
+    }
+    stats->live_bytes = __rafgl_memory_live_bytes;
+    stats->peak_bytes = __rafgl_memory_peak_bytes;
+}
+
+static void __rafgl_memory_log(int level, const rafgl_memory_stats_t *stats)
+{
+    rafgl_log(level, "  %-16s %4d %10.2f %10.2f %8llu %8llu\n", stats->name, stats->live_count,
+              stats->live_bytes / (1024.0 * 1024.0), stats->peak_bytes / (1024.0 * 1024.0),
+              (unsigned long long)stats->allocations, (unsigned long long)stats->frees);
+}
+
+void rafgl_memory_report(void)
+{
+    rafgl_memory_stats_t stats;
+    int i;
+
+    rafgl_log(RAFGL_INFO, "[MEMORY: tag, live rasters, live MB, peak MB, allocations, frees]\n");
+    for(i = 0; i < __rafgl_memory_tag_count; i++)
+    {
+        if(__rafgl_memory_tags[i].allocations > 0)
+            __rafgl_memory_log(RAFGL_INFO, &__rafgl_memory_tags[i]);
+    }
+    rafgl_memory_stats(RAFGL_MEMORY_ALL, &stats);
+    __rafgl_memory_log(RAFGL_INFO, &stats);
+}
+
+int64_t rafgl_memory_leak_report(void)
+{
+    int64_t leaked = 0;
+    int i;
+
+    for(i = 0; i < __rafgl_memory_tag_count; i++)
+    {
+        if(i == RAFGL_MEMORY_LIBRARY || __rafgl_memory_tags[i].live_count == 0)
+            continue;
+        if(leaked == 0)
+            rafgl_log(RAFGL_WARNING, "[LEAKS: tag, live rasters, live MB, peak MB, allocations, frees]\n");
+        __rafgl_memory_log(RAFGL_WARNING, &__rafgl_memory_tags[i]);
+        leaked += __rafgl_memory_tags[i].live_bytes;
+    }
+    return leaked;
+}
+
 int rafgl_raster_init(rafgl_raster_t *raster, int width, int height)
 {
     raster->data = calloc(width * height, sizeof(rafgl_pixel_rgb_t));
     raster->width = width;
     raster->height = height;
+    raster->stride = width;
+    raster->flags = 0;
+    raster->tag = __rafgl_memory_current_tag;
+    rafgl_memory_track(raster->tag, (int64_t)width * height * sizeof(rafgl_pixel_rgb_t));
+    return 0;
+}
+
+void *rafgl_aligned_alloc(size_t alignment, size_t bytes)
+{
+#ifdef _WIN32
+    return _aligned_malloc(bytes, alignment);
+#else
+    void *p;
+    return posix_memalign(&p, alignment, bytes) == 0 ? p : NULL;
+#endif
+}
+
+void rafgl_aligned_free(void *p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+int rafgl_raster_init_aligned(rafgl_raster_t *raster, int width, int height)
+{
+    int row_pixels = RAFGL_RASTER_ALIGNMENT / sizeof(rafgl_pixel_rgb_t);
+    size_t bytes;
+
+    raster->stride = (width + row_pixels - 1) / row_pixels * row_pixels;
+    bytes = (size_t)raster->stride * height * sizeof(rafgl_pixel_rgb_t);
+    raster->data = rafgl_aligned_alloc(RAFGL_RASTER_ALIGNMENT, bytes);
+    memset(raster->data, 0, bytes);
+    raster->width = width;
+    raster->height = height;
+    raster->flags = RAFGL_RASTER_ALIGNED;
+    raster->tag = __rafgl_memory_current_tag;
+    rafgl_memory_track(raster->tag, (int64_t)bytes);
     return 0;
 }
 
+void rafgl_raster_view(rafgl_raster_t *view, const rafgl_raster_t *parent, int x, int y, int width, int height)
+{
+    int x0 = rafgl_max_m(x, 0), y0 = rafgl_max_m(y, 0);
+    int x1 = rafgl_min_m(x + width, parent->width), y1 = rafgl_min_m(y + height, parent->height);
+
+    view->width = rafgl_max_m(x1 - x0, 0);
+    view->height = rafgl_max_m(y1 - y0, 0);
+    view->stride = parent->stride;
+    view->data = (view->width && view->height) ? parent->data + y0 * parent->stride + x0 : parent->data;
+    view->tag = parent->tag;
+    view->flags = RAFGL_RASTER_VIEW;
+}
+
+void rafgl_raster_copy_pixels(rafgl_raster_t *to, const rafgl_raster_t *from)
+{
+    int y;
+
+    if(to->stride == from->stride && to->width == to->stride)
+    {
+        memcpy(to->data, from->data, (size_t)to->stride * to->height * sizeof(rafgl_pixel_rgb_t));
+        return;
+    }
+
+    for(y = 0; y < to->height; y++)
+        memcpy(rafgl_row_pm(to, y), rafgl_row_pm(from, y), to->width * sizeof(rafgl_pixel_rgb_t));
+}
+
 int rafgl_raster_cleanup(rafgl_raster_t *raster)
 {
-    free(raster->data);
+    if(raster->data && !(raster->flags & RAFGL_RASTER_VIEW))
+    {
+        rafgl_memory_track(raster->tag, -(int64_t)raster->stride * raster->height * sizeof(rafgl_pixel_rgb_t));
+        if(raster->flags & RAFGL_RASTER_ALIGNED)
+            rafgl_aligned_free(raster->data);
+        else
+            free(raster->data);
+    }
+    raster->data = NULL;
     raster->height = 0;
     raster->width = 0;
+    raster->stride = 0;
+    raster->flags = 0;
     return 0;
 }
 
@@ -632,6 +1029,147 @@ void rafgl_spritesheet_init(rafgl_spritesheet_t *spritesheet, const char *sheet_
     spritesheet->sheet_height = sheet_height;
     spritesheet->frame_width = spritesheet->sheet.width / sheet_width;
     spritesheet->frame_height = spritesheet->sheet.height / sheet_height;
+    spritesheet->spans = NULL;
+    spritesheet->frame_span_start = NULL;
+}
+
+int rafgl_spritesheet_compile(rafgl_spritesheet_t *spritesheet)
+{
+    int frame_count = spritesheet->sheet_width * spritesheet->sheet_height;
+    int fw = spritesheet->frame_width, fh = spritesheet->frame_height;
+    int frame, pass, xi, yi, run, span_count = 0;
+    rafgl_pixel_rgb_t *row;
+
+    free(spritesheet->spans);
+    free(spritesheet->frame_span_start);
+    spritesheet->spans = NULL;
+    spritesheet->frame_span_start = malloc((frame_count + 1) * sizeof(int));
+
+    /* first pass counts the runs, second pass records them */
+    for(pass = 0; pass < 2; pass++)
+    {
+        span_count = 0;
+        for(frame = 0; frame < frame_count; frame++)
+        {
+            spritesheet->frame_span_start[frame] = span_count;
+            for(yi = 0; yi < fh; yi++)
+            {
+                row = &pixel_at_m(spritesheet->sheet, (frame % spritesheet->sheet_width) * fw, (frame / spritesheet->sheet_width) * fh + yi);
+                for(xi = 0; xi < fw; xi++)
+                {
+                    if(row[xi].rgba == RAFGL_COLOUR_KEY.rgba) continue;
+
+                    for(run = xi; run < fw && row[run].rgba != RAFGL_COLOUR_KEY.rgba; run++);
+
+                    if(pass == 1)
+                    {
+                        spritesheet->spans[span_count].y = yi;
+                        spritesheet->spans[span_count].x = xi;
+                        spritesheet->spans[span_count].length = run - xi;
+                    }
+                    span_count++;
+                    xi = run;
+                }
+            }
+        }
+        spritesheet->frame_span_start[frame_count] = span_count;
+
+        if(pass == 0)
+        {
+            spritesheet->spans = malloc(rafgl_max_m(span_count, 1) * sizeof(rafgl_sprite_span_t));
+        }
+    }
+
+    return span_count;
+}
+
+/* recolour cache: one replacement mask per (sheet, frame, insteadof colour),
+   plus a few ready-to-blit frames for the last used new colours */
+typedef struct _rafgl_recolour_variant_t
+{
+    uint32_t new_colour;
+    rafgl_pixel_rgb_t *pixels;
+    unsigned int last_used;
+} __rafgl_recolour_variant_t;
+
+typedef struct _rafgl_recolour_entry_t
+{
+    rafgl_pixel_rgb_t *sheet_data;
+    int sheet_x, sheet_y;
+    uint32_t insteadof_colour;
+    /* 0 - colour key, 1 - keep, 2 - replace */
+    uint8_t *mask;
+    __rafgl_recolour_variant_t variants[RAFGL_RECOLOUR_VARIANTS];
+    unsigned int last_used;
+} __rafgl_recolour_entry_t;
+
+static __rafgl_recolour_entry_t __recolour_cache[RAFGL_RECOLOUR_CACHE_SIZE];
+static unsigned int __recolour_clock = 0;
+
+static void __rafgl_recolour_entry_free(__rafgl_recolour_entry_t *entry)
+{
+    int i;
+    free(entry->mask);
+    for(i = 0; i < RAFGL_RECOLOUR_VARIANTS; i++)
+    {
+        free(entry->variants[i].pixels);
+    }
+    memset(entry, 0, sizeof(__rafgl_recolour_entry_t));
+}
+
+void rafgl_recolour_cache_clear(void)
+{
+    int i;
+    for(i = 0; i < RAFGL_RECOLOUR_CACHE_SIZE; i++)
+    {
+        __rafgl_recolour_entry_free(&__recolour_cache[i]);
+    }
+}
+
+void rafgl_spritesheet_cleanup(rafgl_spritesheet_t *spritesheet)
+{
+    int i;
+    for(i = 0; i < RAFGL_RECOLOUR_CACHE_SIZE; i++)
+    {
+        if(__recolour_cache[i].sheet_data == spritesheet->sheet.data)
+            __rafgl_recolour_entry_free(&__recolour_cache[i]);
+    }
+
+    rafgl_raster_cleanup(&spritesheet->sheet);
+    free(spritesheet->spans);
+    free(spritesheet->frame_span_start);
+    spritesheet->spans = NULL;
+    spritesheet->frame_span_start = NULL;
+}
+
+/* copies the compiled spans of a frame, clipping each one against the raster */
+static void __rafgl_raster_draw_spritesheet_spans(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y)
+{
+    int frame = sheet_y * spritesheet->sheet_width + sheet_x;
+    int src_x = sheet_x * spritesheet->frame_width;
+    int src_y = sheet_y * spritesheet->frame_height;
+    int i, yi, x0, x1, cx0, cx1;
+    rafgl_sprite_span_t *span;
+
+    if(x >= raster->width || y >= raster->height || x + spritesheet->frame_width <= 0 || y + spritesheet->frame_height <= 0)
+        return;
+
+    for(i = spritesheet->frame_span_start[frame]; i < spritesheet->frame_span_start[frame + 1]; i++)
+    {
+        span = &spritesheet->spans[i];
+        yi = y + span->y;
+        if(yi < 0) continue;
+        /* spans are stored top to bottom */
+        if(yi >= raster->height) break;
+
+        x0 = x + span->x;
+        x1 = x0 + span->length;
+        cx0 = rafgl_max_m(x0, 0);
+        cx1 = rafgl_min_m(x1, raster->width);
+        if(cx0 >= cx1) continue;
+
+        memcpy(&pixel_at_pm(raster, cx0, yi), &pixel_at_m(spritesheet->sheet, src_x + span->x + cx0 - x0, src_y + span->y), (cx1 - cx0) * sizeof(rafgl_pixel_rgb_t));
+    }
 }
 
 
@@ -644,6 +1182,12 @@ void rafgl_raster_draw_spritesheet(rafgl_raster_t *raster, rafgl_spritesheet_t *
 
     rafgl_pixel_rgb_t sampled;
 
+    if(spritesheet->spans)
+    {
+        __rafgl_raster_draw_spritesheet_spans(raster, spritesheet, sheet_x, sheet_y, x, y);
+        return;
+    }
+
     fl = x;
     fr = x + spritesheet->frame_width;
     fu = y;
@@ -668,116 +1212,276 @@ void rafgl_raster_draw_spritesheet(rafgl_raster_t *raster, rafgl_spritesheet_t *
 
 }
 
-void rafgl_raster_draw_spritesheet_color_insteadof(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, rafgl_pixel_rgb_t insteadof_color, rafgl_pixel_rgb_t new_color, int sheet_x, int sheet_y, int x, int y)
+void rafgl_raster_draw_spritesheet_scaled(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y, float scale)
 {
-    int fl, fr, fu, fd;
+    int fw = spritesheet->frame_width, fh = spritesheet->frame_height;
+    int w = (int)(fw * scale + 0.5f), h = (int)(fh * scale + 0.5f);
     int flc, frc, fuc, fdc;
-    int xi, yi;
+    int xi, yi, sx, sy;
+    int step_x, step_y;
 
     rafgl_pixel_rgb_t sampled;
 
-    fl = x;
-    fr = x + spritesheet->frame_width;
-    fu = y;
-    fd = y + spritesheet->frame_height;
+    if(scale == 1.0f)
+    {
+        rafgl_raster_draw_spritesheet(raster, spritesheet, sheet_x, sheet_y, x, y);
+        return;
+    }
 
-    flc = rafgl_max_m(fl, 0);
-    frc = rafgl_min_m(fr, raster->width);
-    fuc = rafgl_max_m(fu, 0);
-    fdc = rafgl_min_m(fd, raster->height);
+    if(w <= 0 || h <= 0) return;
+
+    /* 16.16 source steps, so the inner loop has no division */
+    step_x = (fw << 16) / w;
+    step_y = (fh << 16) / h;
+
+    flc = rafgl_max_m(x, 0);
+    frc = rafgl_min_m(x + w, raster->width);
+    fuc = rafgl_max_m(y, 0);
+    fdc = rafgl_min_m(y + h, raster->height);
 
     for(yi = fuc; yi < fdc; yi++)
     {
+        sy = sheet_y * fh + (((yi - y) * step_y) >> 16);
         for(xi = flc; xi < frc; xi++)
         {
-            sampled = pixel_at_m(spritesheet->sheet, sheet_x * spritesheet->frame_width + xi - fl, sheet_y * spritesheet->frame_height + yi - fu);
+            sx = sheet_x * fw + (((xi - x) * step_x) >> 16);
+            sampled = pixel_at_m(spritesheet->sheet, sx, sy);
             if(sampled.rgba != RAFGL_COLOUR_KEY.rgba)
             {
-                int not_same = 1;
-                for (int i = 0; i < 3; i++)
-                {
-                    for (int j = -3; j < 3; j++)
-                    {
-                        if (sampled.r == insteadof_color.r + j && sampled.g == insteadof_color.g + j)
-                        {
-                            not_same = 0;
-                            break;
-                        }
-                        if (sampled.b == insteadof_color.b + j && sampled.g == insteadof_color.g + j)
-                        {
-                            not_same = 0;
-                            break;
-                        }
-                        if (sampled.r == insteadof_color.r + j && sampled.b == insteadof_color.b + j)
-                        {
-                            not_same = 0;
-                            break;
-                        }
-                    }
-                }
-                if (!not_same)
-                {
-                    pixel_at_pm(raster, xi, yi) = new_color;
-                }
-                else
-                {
-                    pixel_at_pm(raster, xi, yi) = sampled;
-                }
+                pixel_at_pm(raster, xi, yi) = sampled;
             }
         }
     }
-
 }
 
-
-int rafgl_raster_copy(rafgl_raster_t *raster_to, rafgl_raster_t *raster_from)
+/* a pixel is recoloured when two of its channels are within [-3, 2] of the insteadof colour */
+static int __rafgl_is_insteadof_colour(rafgl_pixel_rgb_t sampled, rafgl_pixel_rgb_t insteadof_color)
 {
-
-    if(raster_to->data == NULL)
+    int j;
+    for (j = -3; j < 3; j++)
     {
-        /* new raster */
-        rafgl_raster_init(raster_to, raster_from->width, raster_from->height);
-    }
-    else if(raster_to -> width != raster_from -> width || raster_to -> height != raster_from -> height)
-    {
-        /* resize */
-        rafgl_raster_cleanup(raster_to);
-        rafgl_raster_init(raster_to, raster_from->width, raster_from->height);
+        if (sampled.r == insteadof_color.r + j && sampled.g == insteadof_color.g + j)
+            return 1;
+        if (sampled.b == insteadof_color.b + j && sampled.g == insteadof_color.g + j)
+            return 1;
+        if (sampled.r == insteadof_color.r + j && sampled.b == insteadof_color.b + j)
+            return 1;
     }
-
-    /* just copy */
-    memcpy(raster_to->data, raster_from->data, raster_from->width * raster_from->height * sizeof(rafgl_pixel_rgb_t));
     return 0;
 }
 
-int rafgl_raster_load_from_image(rafgl_raster_t *raster, const char *image_path)
+/* finds (or builds) the replacement mask of a frame; the sheet is identified by its pixel data,
+   since callers pass copies of the spritesheet struct around */
+static __rafgl_recolour_entry_t* __rafgl_recolour_lookup(rafgl_spritesheet_t *spritesheet, rafgl_pixel_rgb_t insteadof_color, int sheet_x, int sheet_y)
 {
-    int width, height, channels;
-    raster->data = (rafgl_pixel_rgb_t *) stbi_load(image_path, &width, &height, &channels, 4);
-    raster->width = width;
-    raster->height = height;
-    return 0;
-}
+    int i, xi, yi;
+    int fw = spritesheet->frame_width, fh = spritesheet->frame_height;
+    __rafgl_recolour_entry_t *entry, *oldest = &__recolour_cache[0];
+    rafgl_pixel_rgb_t sampled;
 
-int rafgl_raster_save_to_png(rafgl_raster_t *raster, const char *image_path)
-{
-    return stbi_write_png(image_path, raster->width, raster->height, 4, raster->data, 0);
+    for(i = 0; i < RAFGL_RECOLOUR_CACHE_SIZE; i++)
+    {
+        entry = &__recolour_cache[i];
+        if(entry->mask && entry->sheet_data == spritesheet->sheet.data && entry->sheet_x == sheet_x && entry->sheet_y == sheet_y && entry->insteadof_colour == insteadof_color.rgba)
+        {
+            entry->last_used = ++__recolour_clock;
+            return entry;
+        }
+        if(entry->last_used < oldest->last_used)
+            oldest = entry;
+    }
+
+    entry = oldest;
+    __rafgl_recolour_entry_free(entry);
+    entry->sheet_data = spritesheet->sheet.data;
+    entry->sheet_x = sheet_x;
+    entry->sheet_y = sheet_y;
+    entry->insteadof_colour = insteadof_color.rgba;
+    entry->last_used = ++__recolour_clock;
+    entry->mask = malloc(fw * fh);
+
+    for(yi = 0; yi < fh; yi++)
+    {
+        for(xi = 0; xi < fw; xi++)
+        {
+            sampled = pixel_at_m(spritesheet->sheet, sheet_x * fw + xi, sheet_y * fh + yi);
+            if(sampled.rgba == RAFGL_COLOUR_KEY.rgba)
+                entry->mask[yi * fw + xi] = 0;
+            else
+                entry->mask[yi * fw + xi] = __rafgl_is_insteadof_colour(sampled, insteadof_color) ? 2 : 1;
+        }
+    }
+
+    return entry;
 }
 
-void rafgl_raster_box_blur(rafgl_raster_t *result, rafgl_raster_t *tmp, rafgl_raster_t *from, int radius)
+/* returns the frame with the replaced pixels already painted in new_color */
+static rafgl_pixel_rgb_t* __rafgl_recolour_variant(__rafgl_recolour_entry_t *entry, rafgl_spritesheet_t *spritesheet, rafgl_pixel_rgb_t new_color)
 {
-    int x, y;
-    float xn, yn, offset;
-    int sample_count = 2 * radius + 1;
-
-    rafgl_pixel_rgb_t sampled, resulting;
+    int i, xi, yi;
+    int fw = spritesheet->frame_width, fh = spritesheet->frame_height;
+    __rafgl_recolour_variant_t *variant, *oldest = &entry->variants[0];
+    rafgl_pixel_rgb_t *src, *dst;
+    uint8_t *mask;
 
-    int r, g, b;
+    for(i = 0; i < RAFGL_RECOLOUR_VARIANTS; i++)
+    {
+        variant = &entry->variants[i];
+        if(variant->pixels && variant->new_colour == new_color.rgba)
+        {
+            variant->last_used = entry->last_used;
+            return variant->pixels;
+        }
+        if(variant->last_used < oldest->last_used)
+            oldest = variant;
+    }
 
+    variant = oldest;
+    if(!variant->pixels)
+        variant->pixels = malloc(fw * fh * sizeof(rafgl_pixel_rgb_t));
+    variant->new_colour = new_color.rgba;
+    variant->last_used = entry->last_used;
 
-    for(y = 0; y < tmp->height; y++)
+    /* masked select, no comparisons against the insteadof colour any more */
+    for(yi = 0; yi < fh; yi++)
     {
-        for(x = 0; x < tmp->width; x++)
+        src = &pixel_at_m(spritesheet->sheet, entry->sheet_x * fw, entry->sheet_y * fh + yi);
+        dst = variant->pixels + yi * fw;
+        mask = entry->mask + yi * fw;
+        for(xi = 0; xi < fw; xi++)
+        {
+            dst[xi] = mask[xi] == 2 ? new_color : src[xi];
+        }
+    }
+
+    return variant->pixels;
+}
+
+void rafgl_raster_draw_spritesheet_color_insteadof(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, rafgl_pixel_rgb_t insteadof_color, rafgl_pixel_rgb_t new_color, int sheet_x, int sheet_y, int x, int y)
+{
+    int fl, fr, fu, fd;
+    int flc, frc, fuc, fdc;
+    int xi, yi;
+    int fw = spritesheet->frame_width, fh = spritesheet->frame_height;
+
+    __rafgl_recolour_entry_t *entry;
+    rafgl_pixel_rgb_t *frame;
+    uint8_t *mask;
+
+    fl = x;
+    fr = x + fw;
+    fu = y;
+    fd = y + fh;
+
+    flc = rafgl_max_m(fl, 0);
+    frc = rafgl_min_m(fr, raster->width);
+    fuc = rafgl_max_m(fu, 0);
+    fdc = rafgl_min_m(fd, raster->height);
+
+    if(flc >= frc || fuc >= fdc)
+        return;
+
+    entry = __rafgl_recolour_lookup(spritesheet, insteadof_color, sheet_x, sheet_y);
+    frame = __rafgl_recolour_variant(entry, spritesheet, new_color);
+
+    if(spritesheet->spans)
+    {
+        int i, x0, cx0, cx1;
+        int span_frame = sheet_y * spritesheet->sheet_width + sheet_x;
+        rafgl_sprite_span_t *span;
+
+        for(i = spritesheet->frame_span_start[span_frame]; i < spritesheet->frame_span_start[span_frame + 1]; i++)
+        {
+            span = &spritesheet->spans[i];
+            yi = y + span->y;
+            if(yi < 0) continue;
+            if(yi >= raster->height) break;
+
+            x0 = x + span->x;
+            cx0 = rafgl_max_m(x0, 0);
+            cx1 = rafgl_min_m(x0 + span->length, raster->width);
+            if(cx0 >= cx1) continue;
+
+            memcpy(&pixel_at_pm(raster, cx0, yi), frame + span->y * fw + span->x + cx0 - x0, (cx1 - cx0) * sizeof(rafgl_pixel_rgb_t));
+        }
+        return;
+    }
+
+    for(yi = fuc; yi < fdc; yi++)
+    {
+        mask = entry->mask + (yi - fu) * fw;
+        for(xi = flc; xi < frc; xi++)
+        {
+            if(mask[xi - fl])
+            {
+                pixel_at_pm(raster, xi, yi) = frame[(yi - fu) * fw + xi - fl];
+            }
+        }
+    }
+
+}
+
+
+const rafgl_pixel_rgb_t* rafgl_spritesheet_recoloured_frame(rafgl_spritesheet_t *spritesheet, rafgl_pixel_rgb_t insteadof_color, rafgl_pixel_rgb_t new_color, int sheet_x, int sheet_y)
+{
+    __rafgl_recolour_entry_t *entry = __rafgl_recolour_lookup(spritesheet, insteadof_color, sheet_x, sheet_y);
+    return __rafgl_recolour_variant(entry, spritesheet, new_color);
+}
+
+
+int rafgl_raster_copy(rafgl_raster_t *raster_to, rafgl_raster_t *raster_from)
+{
+
+    if(raster_to->data == NULL)
+    {
+        /* new raster */
+        rafgl_raster_init(raster_to, raster_from->width, raster_from->height);
+    }
+    else if(raster_to -> width != raster_from -> width || raster_to -> height != raster_from -> height)
+    {
+        /* resize */
+        rafgl_raster_cleanup(raster_to);
+        rafgl_raster_init(raster_to, raster_from->width, raster_from->height);
+    }
+
+    /* just copy */
+    rafgl_raster_copy_pixels(raster_to, raster_from);
+    return 0;
+}
+
+int rafgl_raster_load_from_image(rafgl_raster_t *raster, const char *image_path)
+{
+    int width, height, channels;
+    raster->data = (rafgl_pixel_rgb_t *) stbi_load(image_path, &width, &height, &channels, 4);
+    raster->width = raster->data ? width : 0;
+    raster->height = raster->data ? height : 0;
+    raster->stride = raster->width;
+    raster->flags = 0;
+    raster->tag = __rafgl_memory_current_tag;
+    if(raster->data)
+        rafgl_memory_track(raster->tag, (int64_t)width * height * sizeof(rafgl_pixel_rgb_t));
+    return 0;
+}
+
+int rafgl_raster_save_to_png(rafgl_raster_t *raster, const char *image_path)
+{
+    return stbi_write_png(image_path, raster->width, raster->height, 4, raster->data, 0);
+}
+
+void rafgl_raster_box_blur(rafgl_raster_t *result, rafgl_raster_t *tmp, rafgl_raster_t *from, int radius)
+{
+    int x, y;
+    float xn, yn, offset;
+    int sample_count = 2 * radius + 1;
+
+    rafgl_pixel_rgb_t sampled, resulting;
+
+    int r, g, b;
+
+
+    for(y = 0; y < tmp->height; y++)
+    {
+        for(x = 0; x < tmp->width; x++)
         {
 
             r = 0;
@@ -887,10 +1591,11 @@ static int __compute_outcode(int x, int y, rafgl_raster_t *raster)
     return code;
 }
 
-void rafgl_raster_draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour)
+/* Cohen-Sutherland: moves the endpoints onto the raster, returns 0 if nothing of the segment is visible */
+static int __rafgl_clip_line(rafgl_raster_t *raster, int *px0, int *py0, int *px1, int *py1)
 {
-
     int xmin = 0, ymin = 0, xmax = raster->width - 1, ymax = raster->height - 1;
+    int x0 = *px0, y0 = *py0, x1 = *px1, y1 = *py1;
     int outcode0 = __compute_outcode(x0, y0, raster);
     int outcode1 = __compute_outcode(x1, y1, raster);
     int accept = 0;
@@ -922,20 +1627,20 @@ void rafgl_raster_draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int
             else if(outside_outcode & __cohsuth_BOTTOM)
             {
                 xnew = x0 + (x1 - x0) * (ymin - y0) / (y1 - y0);
-				ynew = ymin;
+                ynew = ymin;
             }
             else if (outside_outcode & __cohsuth_RIGHT)
             {
-				ynew = y0 + (y1 - y0) * (xmax - x0) / (x1 - x0);
-				xnew = xmax;
-			}
-			else if (outside_outcode & __cohsuth_LEFT)
+                ynew = y0 + (y1 - y0) * (xmax - x0) / (x1 - x0);
+                xnew = xmax;
+            }
+            else
             {
-				ynew = y0 + (y1 - y0) * (xmin - x0) / (x1 - x0);
-				xnew = xmin;
-			}
+                ynew = y0 + (y1 - y0) * (xmin - x0) / (x1 - x0);
+                xnew = xmin;
+            }
 
-			if(outside_outcode == outcode0)
+            if(outside_outcode == outcode0)
             {
                 x0 = xnew;
                 y0 = ynew;
@@ -954,15 +1659,108 @@ void rafgl_raster_draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int
 
 
     if(!accept)
+        return 0;
+
+    *px0 = rafgl_clampi(x0, 0, xmax);
+    *py0 = rafgl_clampi(y0, 0, ymax);
+    *px1 = rafgl_clampi(x1, 0, xmax);
+    *py1 = rafgl_clampi(y1, 0, ymax);
+
+    return 1;
+}
+
+/* fills n consecutive pixels; long runs double up through memcpy instead of storing one pixel at a time */
+static void __rafgl_fill_pixels(uint32_t *p, uint32_t colour, int n)
+{
+    int i, filled;
+
+    if(n < 16)
+    {
+        for(i = 0; i < n; i++)
+            p[i] = colour;
+        return;
+    }
+
+    if((colour & 0xff) * 0x01010101u == colour)
+    {
+        memset(p, colour & 0xff, n * sizeof(uint32_t));
+        return;
+    }
+
+    for(i = 0; i < 16; i++)
+        p[i] = colour;
+
+    for(filled = 16; filled < n; filled <<= 1)
+        memcpy(p + filled, p, rafgl_min_m(filled, n - filled) * sizeof(uint32_t));
+}
+
+void rafgl_raster_fill(rafgl_raster_t *raster, uint32_t colour)
+{
+    int y;
+
+    if(raster->stride == raster->width)
+    {
+        __rafgl_fill_pixels(&raster->data[0].rgba, colour, raster->width * raster->height);
+        return;
+    }
+
+    for(y = 0; y < raster->height; y++)
+        __rafgl_fill_pixels(&rafgl_row_pm(raster, y)->rgba, colour, raster->width);
+}
+
+/* endpoints must already be on the raster */
+static void __rafgl_raster_draw_clipped_line(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour)
+{
+    int width = raster->stride;
+    uint32_t *p, *end;
+    int n, tmp;
+
+    if(y0 == y1)
+    {
+        if(x0 > x1)
+        {
+            tmp = x0; x0 = x1; x1 = tmp;
+        }
+        __rafgl_fill_pixels(&raster->data[y0 * width + x0].rgba, colour, x1 - x0 + 1);
+        return;
+    }
+
+    if(x0 == x1)
+    {
+        if(y0 > y1)
+        {
+            tmp = y0; y0 = y1; y1 = tmp;
+        }
+        p = &raster->data[y0 * width + x0].rgba;
+        for(n = y1 - y0 + 1; n > 0; n--, p += width)
+            *p = colour;
         return;
+    }
 
-    x0 = rafgl_clampi(x0, 0, xmax);
-    y0 = rafgl_clampi(y0, 0, ymax);
-    x1 = rafgl_clampi(x1, 0, xmax);
-    y1 = rafgl_clampi(y1, 0, ymax);
+    /* Bresenham, stepping the destination pointer instead of recomputing y * width + x */
+    int dx =  rafgl_abs_m((x1-x0)), sx = x0<x1 ? 1 : -1;
+    int dy = -rafgl_abs_m((y1-y0)), sy = y0<y1 ? width : -width;
+    int err = dx+dy, e2; /* error value e_xy */
+
+    p = &raster->data[y0 * width + x0].rgba;
+    end = &raster->data[y1 * width + x1].rgba;
 
+    while(1)
+    {
+        *p = colour;
+        if (p == end) break;
+        e2 = 2*err;
+        if (e2 >= dy) { err += dy; p += sx; } /* e_xy+e_x > 0 */
+        if (e2 <= dx) { err += dx; p += sy; } /* e_xy+e_y < 0 */
+    }
+}
 
-    /* printf("---\nx0: %d\ny0: %d\nx1: %d\ny1: %d\n", x0, y0, x1, y1); */
+/* endpoints must already be on the raster, the brush itself is clipped here */
+static void __rafgl_raster_draw_clipped_thick_line(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour, int size)
+{
+    int width = raster->width, height = raster->height, stride = raster->stride;
+    int j, brush_w, brush_h;
+    uint32_t *row;
 
     int dx =  rafgl_abs_m((x1-x0)), sx = x0<x1 ? 1 : -1;
     int dy = -rafgl_abs_m((y1-y0)), sy = y0<y1 ? 1 : -1;
@@ -970,110 +1768,397 @@ void rafgl_raster_draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int
 
     while(1)
     {
-        pixel_at_pm(raster, x0, y0).rgba = colour;
+        brush_w = rafgl_min_m(size, width - x0);
+        brush_h = rafgl_min_m(size, height - y0);
+        row = &raster->data[y0 * stride + x0].rgba;
+        for(j = 0; j < brush_h; j++, row += stride)
+            __rafgl_fill_pixels(row, colour, brush_w);
+
         if (x0==x1 && y0==y1) break;
         e2 = 2*err;
         if (e2 >= dy) { err += dy; x0 += sx; } /* e_xy+e_x > 0 */
         if (e2 <= dx) { err += dx; y0 += sy; } /* e_xy+e_y < 0 */
     }
+}
 
+void rafgl_raster_draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour)
+{
+    if(__rafgl_clip_line(raster, &x0, &y0, &x1, &y1))
+        __rafgl_raster_draw_clipped_line(raster, x0, y0, x1, y1, colour);
 }
 
 /// crta debelu liniju
 void rafgl_raster_draw_line_custom(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour)
 {
+    if(__rafgl_clip_line(raster, &x0, &y0, &x1, &y1))
+        __rafgl_raster_draw_clipped_thick_line(raster, x0, y0, x1, y1, colour, RAFGL_LINE_SIZE);
+}
 
-    int xmin = 0, ymin = 0, xmax = raster->width - 1, ymax = raster->height - 1;
-    int outcode0 = __compute_outcode(x0, y0, raster);
-    int outcode1 = __compute_outcode(x1, y1, raster);
-    int accept = 0;
-    int xnew, ynew;
-    int outside_outcode;
+void rafgl_raster_draw_lines(rafgl_raster_t *raster, const rafgl_line_t *lines, int count)
+{
+    unsigned int w = raster->width, h = raster->height;
+    int i, x0, y0, x1, y1;
+
+    for(i = 0; i < count; i++)
+    {
+        x0 = lines[i].x0; y0 = lines[i].y0;
+        x1 = lines[i].x1; y1 = lines[i].y1;
+
+        /* most segments of a batch lie fully on screen, the unsigned compare sends them
+           straight to the rasteriser and only the rest go through the clipper */
+        if(((unsigned int)x0 < w) & ((unsigned int)x1 < w) & ((unsigned int)y0 < h) & ((unsigned int)y1 < h))
+            __rafgl_raster_draw_clipped_line(raster, x0, y0, x1, y1, lines[i].colour);
+        else if(__rafgl_clip_line(raster, &x0, &y0, &x1, &y1))
+            __rafgl_raster_draw_clipped_line(raster, x0, y0, x1, y1, lines[i].colour);
+    }
+}
+
+void rafgl_raster_draw_lines_thick(rafgl_raster_t *raster, const rafgl_line_t *lines, int count, int size)
+{
+    int i, x0, y0, x1, y1;
+
+    for(i = 0; i < count; i++)
+    {
+        x0 = lines[i].x0; y0 = lines[i].y0;
+        x1 = lines[i].x1; y1 = lines[i].y1;
+
+        if(__rafgl_clip_line(raster, &x0, &y0, &x1, &y1))
+            __rafgl_raster_draw_clipped_thick_line(raster, x0, y0, x1, y1, lines[i].colour, size);
+    }
+}
+
+/* endpoints must already be on the raster; walks the same pixels as __rafgl_raster_draw_clipped_line */
+static void __rafgl_raster_draw_clipped_line_rect(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour, int rx0, int ry0, int rx1, int ry1)
+{
+    int stride = raster->stride;
+
+    int dx =  rafgl_abs_m((x1-x0)), sx = x0<x1 ? 1 : -1;
+    int dy = -rafgl_abs_m((y1-y0)), sy = y0<y1 ? 1 : -1;
+    int err = dx+dy, e2; /* error value e_xy */
 
     while(1)
     {
+        if(x0 >= rx0 && x0 < rx1 && y0 >= ry0 && y0 < ry1)
+            raster->data[y0 * stride + x0].rgba = colour;
 
-        if(!(outcode0 | outcode1))
-        {
-            /* trivijalno prihvatanje */
-            accept = 1;
-            break;
-        }
-        else if(outcode0 & outcode1)
-        {
-            /* trivijalno odbacivanje */
-            break;
-        }
+        if (x0==x1 && y0==y1) break;
+        e2 = 2*err;
+        if (e2 >= dy) { err += dy; x0 += sx; } /* e_xy+e_x > 0 */
+        if (e2 <= dx) { err += dx; y0 += sy; } /* e_xy+e_y < 0 */
+    }
+}
+
+void rafgl_raster_draw_lines_rect(rafgl_raster_t *raster, const rafgl_line_t *lines, int count, int x0, int y0, int x1, int y1)
+{
+    unsigned int w = raster->width, h = raster->height;
+    int i, lx0, ly0, lx1, ly1;
+
+    for(i = 0; i < count; i++)
+    {
+        lx0 = lines[i].x0; ly0 = lines[i].y0;
+        lx1 = lines[i].x1; ly1 = lines[i].y1;
+
+        /* clipped against the raster the way rafgl_raster_draw_lines does it, so the endpoints match */
+        if(!(((unsigned int)lx0 < w) & ((unsigned int)lx1 < w) & ((unsigned int)ly0 < h) & ((unsigned int)ly1 < h)) && !__rafgl_clip_line(raster, &lx0, &ly0, &lx1, &ly1))
+            continue;
+
+        if(rafgl_min_m(lx0, lx1) >= x0 && rafgl_max_m(lx0, lx1) < x1 && rafgl_min_m(ly0, ly1) >= y0 && rafgl_max_m(ly0, ly1) < y1)
+            __rafgl_raster_draw_clipped_line(raster, lx0, ly0, lx1, ly1, lines[i].colour);
         else
-        {
-            outside_outcode = outcode0 ? outcode0 : outcode1;
-            if(outside_outcode & __cohsuth_TOP)
-            {
-                xnew = x0 + (x1 - x0) * (ymax - y0) / (y1 - y0);
-                ynew = ymax;
-            }
-            else if(outside_outcode & __cohsuth_BOTTOM)
-            {
-                xnew = x0 + (x1 - x0) * (ymin - y0) / (y1 - y0);
-				ynew = ymin;
-            }
-            else if (outside_outcode & __cohsuth_RIGHT)
-            {
-				ynew = y0 + (y1 - y0) * (xmax - x0) / (x1 - x0);
-				xnew = xmax;
-			}
-			else if (outside_outcode & __cohsuth_LEFT)
-            {
-				ynew = y0 + (y1 - y0) * (xmin - x0) / (x1 - x0);
-				xnew = xmin;
-			}
+            __rafgl_raster_draw_clipped_line_rect(raster, lx0, ly0, lx1, ly1, lines[i].colour, x0, y0, x1, y1);
+    }
+}
+
+void rafgl_raster_draw_span(rafgl_raster_t *raster, int x0, int x1, int y, uint32_t colour)
+{
+    int tmp;
+
+    if(y < 0 || y >= raster->height)
+        return;
+
+    if(x0 > x1)
+    {
+        tmp = x0; x0 = x1; x1 = tmp;
+    }
+
+    x0 = rafgl_max_m(x0, 0);
+    x1 = rafgl_min_m(x1, raster->width - 1);
+
+    if(x0 <= x1)
+        __rafgl_fill_pixels(&raster->data[y * raster->stride + x0].rgba, colour, x1 - x0 + 1);
+}
+
+/* colour * w / 256 for w in [0, 256], both channel pairs at once; alpha comes out as 0 */
+static inline uint32_t __rafgl_scale_colour(uint32_t colour, uint32_t w)
+{
+    uint32_t rb = (((colour & 0x00ff00ffu) * w) >> 8) & 0x00ff00ffu;
+    uint32_t g  = (((colour & 0x0000ff00u) * w) >> 8) & 0x0000ff00u;
+    return rb | g;
+}
+
+/* per byte saturating a + b */
+static inline uint32_t __rafgl_add_saturate(uint32_t a, uint32_t b)
+{
+    uint32_t t0 = (a ^ b) & 0x80808080u;
+    uint32_t t1 = (a & b) & 0x80808080u;
+    a &= 0x7f7f7f7fu;
+    b &= 0x7f7f7f7fu;
+    a += b;
+    t1 |= t0 & a;
+    t1 = (t1 << 1) - (t1 >> 7);
+    return (a ^ t0) | t1;
+}
+
+static void __rafgl_raster_draw_streak(rafgl_raster_t *raster, const rafgl_streak_t *streak)
+{
+    int width = raster->width, height = raster->height;
+    float x0 = streak->x0, y0 = streak->y0, x1 = streak->x1, y1 = streak->y1;
+    float dx = x1 - x0, dy = y1 - y0;
+    float t0 = 0.0f, t1 = 1.0f, r;
+    int k;
 
-			if(outside_outcode == outcode0)
+    /* too faint to move a single 8 bit channel */
+    if(streak->intensity * 256.0f < 1.0f)
+        return;
+
+    /* Liang-Barsky against the raster grown by a pixel, since Wu also covers the neighbour across the line;
+       streaks already inside skip the divisions */
+    if(!(x0 >= -1.0f && x0 <= width && x1 >= -1.0f && x1 <= width &&
+         y0 >= -1.0f && y0 <= height && y1 >= -1.0f && y1 <= height))
+    {
+        float p[4] = {-dx, dx, -dy, dy};
+        float q[4] = {x0 + 1.0f, width - x0, y0 + 1.0f, height - y0};
+
+        for(k = 0; k < 4; k++)
+        {
+            if(p[k] == 0.0f)
             {
-                x0 = xnew;
-                y0 = ynew;
-                outcode0 = __compute_outcode(x0, y0, raster);
+                if(q[k] < 0.0f) return;
             }
             else
             {
-                x1 = xnew;
-                y1 = ynew;
-                outcode1 = __compute_outcode(x1, y1, raster);
+                r = q[k] / p[k];
+                if(p[k] < 0.0f) t0 = rafgl_max_m(t0, r);
+                else t1 = rafgl_min_m(t1, r);
             }
         }
+        if(t0 > t1) return;
+    }
+
+    float i0 = streak->intensity * (1.0f - t0), i1 = streak->intensity * (1.0f - t1);
+    x1 = x0 + dx * t1; y1 = y0 + dy * t1;
+    x0 = x0 + dx * t0; y0 = y0 + dy * t0;
 
+    /* walk along the major axis, a and b are the major and minor coordinates */
+    int x_major = fabsf(dx) >= fabsf(dy);
+    float a0 = x_major ? x0 : y0, a1 = x_major ? x1 : y1;
+    float b0 = x_major ? y0 : x0, b1 = x_major ? y1 : x1;
+    int major_size = x_major ? width : height, minor_size = x_major ? height : width;
+    int major_stride = x_major ? 1 : raster->stride, minor_stride = x_major ? raster->stride : 1;
+    float tmp;
 
+    if(a0 > a1)
+    {
+        tmp = a0; a0 = a1; a1 = tmp;
+        tmp = b0; b0 = b1; b1 = tmp;
+        tmp = i0; i0 = i1; i1 = tmp;
     }
 
+    /* both ends are >= -1 after clipping, so truncating a + 2 floors without a libm call */
+    int floor_a0 = (int)(a0 + 2.0f) - 2;
+    int start = rafgl_max_m(floor_a0 + (floor_a0 < a0), 0);
+    int end = rafgl_min_m((int)(a1 + 2.0f) - 2, major_size - 1);
+    float span = a1 - a0;
+    float gradient = span > 0.0f ? (b1 - b0) / span : 0.0f;
+    float falloff = span > 0.0f ? (i1 - i0) / span : 0.0f;
 
-    if(!accept)
+    /* a streak shorter than a pixel still lights the pixel it sits on */
+    if(end < start)
+    {
+        start = end = (int)(a0 + 0.5f);
+        if(start < 0 || start >= major_size) return;
+    }
+
+    /* 16.16 fixed point; the minor coordinate is biased by 2 so the shift never sees a negative value */
+    int32_t b = (int32_t)((b0 + gradient * (start - a0) + 2.0f) * 65536.0f);
+    int32_t db = (int32_t)(gradient * 65536.0f);
+    int32_t intensity = (int32_t)((i0 + falloff * (start - a0)) * 256.0f * 65536.0f);
+    int32_t dintensity = (int32_t)(falloff * 256.0f * 65536.0f);
+
+    uint32_t colour = streak->colour;
+    uint32_t *data = &raster->data[0].rgba;
+    uint32_t *pixel;
+    int m, bi, frac, w;
+
+    for(m = start; m <= end; m++, b += db, intensity += dintensity)
+    {
+        bi = (b >> 16) - 2;
+        frac = (b >> 8) & 0xff;
+        w = rafgl_clampi(intensity >> 16, 0, 256);
+        pixel = data + m * major_stride + bi * minor_stride;
+
+        if((unsigned int)bi < (unsigned int)minor_size)
+            *pixel = __rafgl_add_saturate(*pixel, __rafgl_scale_colour(colour, (w * (256 - frac)) >> 8));
+        if((unsigned int)(bi + 1) < (unsigned int)minor_size)
+            pixel[minor_stride] = __rafgl_add_saturate(pixel[minor_stride], __rafgl_scale_colour(colour, (w * frac) >> 8));
+    }
+}
+
+void rafgl_raster_draw_streaks(rafgl_raster_t *raster, const rafgl_streak_t *streaks, int count)
+{
+    int i;
+    for(i = 0; i < count; i++)
+        __rafgl_raster_draw_streak(raster, &streaks[i]);
+}
+
+static void __rafgl_fade_row(uint32_t *p, int n, int factor)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    /* mulhi by factor << 8 is (channel * factor) >> 8, four pixels per iteration */
+    __m128i zero = _mm_setzero_si128();
+    __m128i scale = _mm_set1_epi16((short)(factor << 8));
+    __m128i alpha = _mm_set1_epi32((int)0xff000000u);
+    __m128i px, lo, hi;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        px = _mm_loadu_si128((__m128i *)(p + i));
+        lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(px, zero), scale);
+        hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(px, zero), scale);
+        lo = _mm_packus_epi16(lo, hi);
+        px = _mm_or_si128(_mm_andnot_si128(alpha, lo), _mm_and_si128(alpha, px));
+        _mm_storeu_si128((__m128i *)(p + i), px);
+    }
+#endif
+
+    for(; i < n; i++)
+        p[i] = __rafgl_scale_colour(p[i], factor) | (p[i] & 0xff000000u);
+}
+
+void rafgl_raster_fade(rafgl_raster_t *raster, int factor)
+{
+    int y;
+
+    if(factor >= 256)
+        return;
+
+    /* a tightly packed raster is one long row */
+    if(raster->stride == raster->width)
+    {
+        __rafgl_fade_row(&raster->data[0].rgba, raster->width * raster->height, factor);
         return;
+    }
 
-    x0 = rafgl_clampi(x0, 0, xmax);
-    y0 = rafgl_clampi(y0, 0, ymax);
-    x1 = rafgl_clampi(x1, 0, xmax);
-    y1 = rafgl_clampi(y1, 0, ymax);
+    for(y = 0; y < raster->height; y++)
+        __rafgl_fade_row(&rafgl_row_pm(raster, y)->rgba, raster->width, factor);
+}
 
+/* a + (b - a) * t / 256 on all four channels, t in [0, 256] */
+static inline uint32_t __rafgl_lerp_pixel(uint32_t a, uint32_t b, uint32_t t)
+{
+    uint32_t rb = ((a & 0x00ff00ffu) * (256 - t) + (b & 0x00ff00ffu) * t) >> 8;
+    uint32_t ag = (((a >> 8) & 0x00ff00ffu) * (256 - t) + ((b >> 8) & 0x00ff00ffu) * t) >> 8;
+    return (rb & 0x00ff00ffu) | ((ag & 0x00ff00ffu) << 8);
+}
 
-    /* printf("---\nx0: %d\ny0: %d\nx1: %d\ny1: %d\n", x0, y0, x1, y1); */
+static inline uint32_t __rafgl_fetch_or(rafgl_raster_t *raster, int x, int y, uint32_t edge_colour)
+{
+    if((unsigned int)x >= (unsigned int)raster->width || (unsigned int)y >= (unsigned int)raster->height)
+        return edge_colour;
+    return pixel_at_pm(raster, x, y).rgba;
+}
 
-    int dx =  rafgl_abs_m((x1-x0)), sx = x0<x1 ? 1 : -1;
-    int dy = -rafgl_abs_m((y1-y0)), sy = y0<y1 ? 1 : -1;
-    int err = dx+dy, e2; /* error value e_xy */
+void rafgl_raster_offset_blit(rafgl_raster_t *to, rafgl_raster_t *from, float dx, float dy, uint32_t edge_colour)
+{
+    int width = to->width, height = to->height, from_stride = from->stride;
+    int x, y, sy, inner_start, inner_end;
 
-    while(1)
+    /* the offset is the same for every pixel, so are the bilinear weights */
+    float src_x = -dx, src_y = -dy;
+    int ix = (int)floorf(src_x), iy = (int)floorf(src_y);
+    uint32_t fx = (uint32_t)((src_x - ix) * 256.0f), fy = (uint32_t)((src_y - iy) * 256.0f);
+    uint32_t *dst, *row0, *row1;
+    uint32_t top, bottom;
+
+    /* columns whose two taps are both inside the source */
+    inner_start = rafgl_clampi(-ix, 0, width);
+    inner_end = rafgl_clampi(width - 1 - ix, inner_start, width);
+
+    for(y = 0; y < height; y++)
     {
-        for (int i = 0; i < RAFGL_LINE_SIZE; i++) {
-            for (int j = 0; j < RAFGL_LINE_SIZE; j++) {
-                pixel_at_pm(raster, x0 + i, y0 + j).rgba = colour;
+        dst = &rafgl_row_pm(to, y)->rgba;
+        sy = y + iy;
+
+        if(sy < 0 || sy + 1 >= height)
+        {
+            for(x = 0; x < width; x++)
+            {
+                top = __rafgl_lerp_pixel(__rafgl_fetch_or(from, x + ix, sy, edge_colour), __rafgl_fetch_or(from, x + ix + 1, sy, edge_colour), fx);
+                bottom = __rafgl_lerp_pixel(__rafgl_fetch_or(from, x + ix, sy + 1, edge_colour), __rafgl_fetch_or(from, x + ix + 1, sy + 1, edge_colour), fx);
+                dst[x] = __rafgl_lerp_pixel(top, bottom, fy);
             }
+            continue;
         }
-        if (x0==x1 && y0==y1) break;
-        e2 = 2*err;
-        if (e2 >= dy) { err += dy; x0 += sx; } /* e_xy+e_x > 0 */
-        if (e2 <= dx) { err += dx; y0 += sy; } /* e_xy+e_y < 0 */
-    }
 
+        /* row pointers are offset by ix through the index, never by pointer arithmetic */
+        row0 = &from->data[sy * from_stride].rgba;
+        row1 = row0 + from_stride;
+
+        for(x = 0; x < inner_start; x++)
+        {
+            top = __rafgl_lerp_pixel(__rafgl_fetch_or(from, x + ix, sy, edge_colour), __rafgl_fetch_or(from, x + ix + 1, sy, edge_colour), fx);
+            bottom = __rafgl_lerp_pixel(__rafgl_fetch_or(from, x + ix, sy + 1, edge_colour), __rafgl_fetch_or(from, x + ix + 1, sy + 1, edge_colour), fx);
+            dst[x] = __rafgl_lerp_pixel(top, bottom, fy);
+        }
+
+        x = inner_start;
+#ifdef __SSE2__
+        {
+            __m128i zero = _mm_setzero_si128();
+            __m128i wx0 = _mm_set1_epi16((short)(256 - fx)), wx1 = _mm_set1_epi16((short)fx);
+            __m128i wy0 = _mm_set1_epi16((short)(256 - fy)), wy1 = _mm_set1_epi16((short)fy);
+            __m128i a, b, c, d, t, u;
+
+            /* the weights of each lerp add up to 256, so every 16 bit lane stays below 65536 */
+            #define __RAFGL_LERP_EPI16(p, q, w0, w1) _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(p, w0), _mm_mullo_epi16(q, w1)), 8)
+
+            for(; x + 4 <= inner_end; x += 4)
+            {
+                a = _mm_loadu_si128((__m128i *)&row0[x + ix]);
+                b = _mm_loadu_si128((__m128i *)&row0[x + ix + 1]);
+                c = _mm_loadu_si128((__m128i *)&row1[x + ix]);
+                d = _mm_loadu_si128((__m128i *)&row1[x + ix + 1]);
+
+                t = __RAFGL_LERP_EPI16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), wx0, wx1);
+                u = __RAFGL_LERP_EPI16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero), wx0, wx1);
+                __m128i lo = __RAFGL_LERP_EPI16(t, u, wy0, wy1);
+
+                t = __RAFGL_LERP_EPI16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), wx0, wx1);
+                u = __RAFGL_LERP_EPI16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero), wx0, wx1);
+                __m128i hi = __RAFGL_LERP_EPI16(t, u, wy0, wy1);
+
+                _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+            }
+
+            #undef __RAFGL_LERP_EPI16
+        }
+#endif
+        for(; x < inner_end; x++)
+        {
+            top = __rafgl_lerp_pixel(row0[x + ix], row0[x + ix + 1], fx);
+            bottom = __rafgl_lerp_pixel(row1[x + ix], row1[x + ix + 1], fx);
+            dst[x] = __rafgl_lerp_pixel(top, bottom, fy);
+        }
+
+        for(; x < width; x++)
+        {
+            top = __rafgl_lerp_pixel(__rafgl_fetch_or(from, x + ix, sy, edge_colour), __rafgl_fetch_or(from, x + ix + 1, sy, edge_colour), fx);
+            bottom = __rafgl_lerp_pixel(__rafgl_fetch_or(from, x + ix, sy + 1, edge_colour), __rafgl_fetch_or(from, x + ix + 1, sy + 1, edge_colour), fx);
+            dst[x] = __rafgl_lerp_pixel(top, bottom, fy);
+        }
+    }
 }
 
 /* DOES NOT DO CLIPPING! */
@@ -1093,29 +2178,82 @@ void rafgl_raster_draw_circle(rafgl_raster_t *raster, int cx, int cy, int r, uin
 
 void rafgl_raster_draw_rectangle(rafgl_raster_t *raster, int x0, int y0, int w, int h, uint32_t colour)
 {
-    rafgl_raster_draw_line(raster, x0, y0, x0 + w, y0, colour);
-    rafgl_raster_draw_line(raster, x0, y0 + h, x0 + w, y0 + h, colour);
-    rafgl_raster_draw_line(raster, x0, y0, x0, y0 + h, colour);
-    rafgl_raster_draw_line(raster, x0 + w, y0, x0 + w, y0 + h, colour);
+    rafgl_line_t edges[4] =
+    {
+        {x0, y0, x0 + w, y0, colour},
+        {x0, y0 + h, x0 + w, y0 + h, colour},
+        {x0, y0, x0, y0 + h, colour},
+        {x0 + w, y0, x0 + w, y0 + h, colour}
+    };
+    rafgl_raster_draw_lines(raster, edges, 4);
 }
 
 void rafgl_raster_bilinear_upsample(rafgl_raster_t *to, rafgl_raster_t *from)
 {
-    int x, y;
-    int w = to->width, h = to->height;
-    float xn, yn;
+    int x, y, u, v, sx0, sx1, sy0, sy1;
+    int w = to->width, h = to->height, sw = from->width, sh = from->height;
+    uint32_t *dst, *row0, *row1;
+    uint32_t top, bottom, fx, fy;
+
+    /* 16.16 source coordinates of the destination pixel centres, stepped instead of divided */
+    int step_x = (int)(((int64_t)sw << 16) / w), step_y = (int)(((int64_t)sh << 16) / h);
+    int max_x = (sw - 1) << 16, max_y = (sh - 1) << 16;
+    int v_start = step_y / 2 - 0x8000, u_start = step_x / 2 - 0x8000;
 
-    for(y = 0; y < h; y++)
+    for(y = 0, v = v_start; y < h; y++, v += step_y)
     {
-        yn = ((float)y) / h;
-        for(x = 0; x < w; x++)
+        sy0 = rafgl_clampi(v, 0, max_y);
+        fy = (sy0 >> 8) & 0xff;
+        sy0 >>= 16;
+        sy1 = rafgl_min_m(sy0 + 1, sh - 1);
+
+        row0 = &rafgl_row_pm(from, sy0)->rgba;
+        row1 = &rafgl_row_pm(from, sy1)->rgba;
+        dst = &rafgl_row_pm(to, y)->rgba;
+
+        for(x = 0, u = u_start; x < w; x++, u += step_x)
         {
-            xn = ((float)x) / w;
-            pixel_at_pm(to, x, y) = rafgl_bilinear_sample(from, xn, yn);
+            sx0 = rafgl_clampi(u, 0, max_x);
+            fx = (sx0 >> 8) & 0xff;
+            sx0 >>= 16;
+            sx1 = rafgl_min_m(sx0 + 1, sw - 1);
+
+            top = __rafgl_lerp_pixel(row0[sx0], row0[sx1], fx);
+            bottom = __rafgl_lerp_pixel(row1[sx0], row1[sx1], fx);
+            dst[x] = __rafgl_lerp_pixel(top, bottom, fy);
         }
     }
 }
 
+/* per-channel mean of four pixels, two channels at a time in 16-bit lanes */
+static inline uint32_t __rafgl_average4(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    uint32_t rb = (((a & 0x00ff00ffu) + (b & 0x00ff00ffu) + (c & 0x00ff00ffu) + (d & 0x00ff00ffu) + 0x00020002u) >> 2) & 0x00ff00ffu;
+    uint32_t ag = ((((a >> 8) & 0x00ff00ffu) + ((b >> 8) & 0x00ff00ffu) + ((c >> 8) & 0x00ff00ffu) + ((d >> 8) & 0x00ff00ffu) + 0x00020002u) >> 2) & 0x00ff00ffu;
+    return rb | (ag << 8);
+}
+
+void rafgl_raster_box_downsample(rafgl_raster_t *to, const rafgl_raster_t *from)
+{
+    int x, y, last_x = from->width - 1;
+    int pairs = from->width / 2;
+    const uint32_t *row0, *row1;
+    uint32_t *dst;
+
+    for(y = 0; y < to->height; y++)
+    {
+        row0 = &rafgl_row_pm(from, 2 * y)->rgba;
+        row1 = &rafgl_row_pm(from, rafgl_min_m(2 * y + 1, from->height - 1))->rgba;
+        dst = &rafgl_row_pm(to, y)->rgba;
+
+        for(x = 0; x < pairs; x++)
+            dst[x] = __rafgl_average4(row0[2 * x], row0[2 * x + 1], row1[2 * x], row1[2 * x + 1]);
+
+        if(x < to->width)
+            dst[x] = __rafgl_average4(row0[last_x], row0[last_x], row1[last_x], row1[last_x]);
+    }
+}
+
 
 void rafgl_game_add_game_state(rafgl_game_t *game, void (*init)(GLFWwindow *window, void *args), void (*update)(GLFWwindow *window, float delta_time, rafgl_game_data_t *game_data, void *args), void (*render)(GLFWwindow *window, void *args), void (*cleanup)(GLFWwindow *window, void *args))
 {
@@ -1138,6 +2276,187 @@ void rafgl_log_fps(int b)
     __rafgl_log_fps = b;
 }
 
+static const char *__rafgl_pass_names[RAFGL_PASS_COUNT] = {"events", "update", "render", "swap", "total"};
+static rafgl_histogram_t __rafgl_frame_histograms[RAFGL_PASS_COUNT];
+static rafgl_histogram_t __rafgl_interval_histograms[RAFGL_PASS_COUNT];
+static rafgl_stutter_t __rafgl_stutters[RAFGL_STUTTER_LOG];
+static uint64_t __rafgl_stutter_count = 0;
+static uint64_t __rafgl_frames_timed = 0;
+static double __rafgl_last_frame_times[RAFGL_PASS_COUNT];
+static float __rafgl_frame_stats_interval = 0.0f;
+static int __rafgl_frame_stats_at_exit = 1;
+
+static int __rafgl_histogram_bucket(double seconds)
+{
+    uint32_t us, shift = 0;
+
+    if(seconds <= 0.0) return 0;
+    if(seconds >= (1 << RAFGL_HISTOGRAM_MAX_BITS) * 1e-6) return RAFGL_HISTOGRAM_BUCKETS - 1;
+    us = (uint32_t)(seconds * 1e6);
+
+    /* below 2 << SUB_BITS every microsecond has a bucket, above it each octave is split SUB_BITS ways */
+    while((us >> shift) >= (2u << RAFGL_HISTOGRAM_SUB_BITS))
+        shift++;
+
+    return (shift << RAFGL_HISTOGRAM_SUB_BITS) + (us >> shift);
+}
+
+/* middle of the bucket, in seconds */
+static double __rafgl_histogram_value(int bucket)
+{
+    int shift = (bucket >> RAFGL_HISTOGRAM_SUB_BITS) - 1;
+    uint32_t low;
+
+    if(shift <= 0)
+        return bucket * 1e-6;
+
+    low = (uint32_t)(bucket - (shift << RAFGL_HISTOGRAM_SUB_BITS)) << shift;
+    return (low + ((1u << shift) - 1) * 0.5) * 1e-6;
+}
+
+void rafgl_histogram_reset(rafgl_histogram_t *histogram)
+{
+    memset(histogram, 0, sizeof(rafgl_histogram_t));
+}
+
+void rafgl_histogram_record(rafgl_histogram_t *histogram, double seconds)
+{
+    histogram->counts[__rafgl_histogram_bucket(seconds)]++;
+    histogram->count++;
+    histogram->sum += seconds;
+    if(seconds > histogram->max)
+        histogram->max = seconds;
+}
+
+double rafgl_histogram_percentile(const rafgl_histogram_t *histogram, double p)
+{
+    uint64_t rank, seen = 0;
+    int i;
+
+    if(histogram->count == 0) return 0.0;
+
+    rank = (uint64_t)ceil(p * histogram->count);
+    if(rank < 1) rank = 1;
+
+    for(i = 0; i < RAFGL_HISTOGRAM_BUCKETS; i++)
+    {
+        seen += histogram->counts[i];
+        if(seen >= rank)
+            return rafgl_min_m(__rafgl_histogram_value(i), histogram->max);
+    }
+    return histogram->max;
+}
+
+static void __rafgl_histogram_stats(const rafgl_histogram_t *histogram, rafgl_frame_stats_t *stats)
+{
+    stats->count = histogram->count;
+    stats->mean = histogram->count ? histogram->sum / histogram->count : 0.0;
+    stats->p50 = rafgl_histogram_percentile(histogram, 0.5);
+    stats->p90 = rafgl_histogram_percentile(histogram, 0.9);
+    stats->p99 = rafgl_histogram_percentile(histogram, 0.99);
+    stats->p999 = rafgl_histogram_percentile(histogram, 0.999);
+    stats->max = histogram->max;
+}
+
+void rafgl_frame_stats(int pass, rafgl_frame_stats_t *stats)
+{
+    __rafgl_histogram_stats(&__rafgl_frame_histograms[pass], stats);
+}
+
+void rafgl_frame_last(double *times)
+{
+    memcpy(times, __rafgl_last_frame_times, sizeof(__rafgl_last_frame_times));
+}
+
+int rafgl_frame_stutters(rafgl_stutter_t *stutters, int max)
+{
+    int kept = rafgl_min_m(__rafgl_stutter_count, RAFGL_STUTTER_LOG);
+    int n = rafgl_min_m(kept, max), i;
+
+    for(i = 0; i < n; i++)
+        stutters[i] = __rafgl_stutters[(__rafgl_stutter_count - n + i) % RAFGL_STUTTER_LOG];
+
+    return n;
+}
+
+void rafgl_log_frame_stats(float interval, int at_exit)
+{
+    __rafgl_frame_stats_interval = interval;
+    __rafgl_frame_stats_at_exit = at_exit;
+}
+
+static void __rafgl_log_histograms(const char *title, const rafgl_histogram_t *histograms)
+{
+    rafgl_frame_stats_t stats;
+    int pass;
+
+    rafgl_log(RAFGL_INFO, "[%s: %llu frames, ms: mean / p50 / p90 / p99 / p99.9 / max]\n", title, (unsigned long long)histograms[RAFGL_PASS_TOTAL].count);
+    for(pass = 0; pass < RAFGL_PASS_COUNT; pass++)
+    {
+        __rafgl_histogram_stats(&histograms[pass], &stats);
+        rafgl_log(RAFGL_INFO, "  %-6s %7.2f %7.2f %7.2f %7.2f %7.2f %7.2f\n", __rafgl_pass_names[pass],
+                  stats.mean * 1e3, stats.p50 * 1e3, stats.p90 * 1e3, stats.p99 * 1e3, stats.p999 * 1e3, stats.max * 1e3);
+    }
+}
+
+void rafgl_frame_stats_dump(void)
+{
+    rafgl_stutter_t stutters[RAFGL_STUTTER_LOG];
+    int n = rafgl_frame_stutters(stutters, RAFGL_STUTTER_LOG), i;
+
+    __rafgl_log_histograms("FRAME TIMES", __rafgl_frame_histograms);
+    rafgl_log(RAFGL_INFO, "  %llu stutters over %.1fx the median\n", (unsigned long long)__rafgl_stutter_count, RAFGL_STUTTER_FACTOR);
+    for(i = 0; i < n; i++)
+    {
+        rafgl_log(RAFGL_INFO, "  frame %llu: %.2f ms (median %.2f), %s %.2f ms (median %.2f)\n", (unsigned long long)stutters[i].frame,
+                  stutters[i].total * 1e3, stutters[i].median * 1e3, __rafgl_pass_names[stutters[i].pass],
+                  stutters[i].pass_time * 1e3, stutters[i].pass_median * 1e3);
+    }
+}
+
+/* times[] is indexed by RAFGL_PASS_*; a frame well over the running median is logged as a stutter and blamed on its slowest pass relative to usual */
+static void __rafgl_record_frame(const double *times)
+{
+    double median = rafgl_histogram_percentile(&__rafgl_frame_histograms[RAFGL_PASS_TOTAL], 0.5);
+    int pass;
+
+    if(__rafgl_frames_timed >= RAFGL_STUTTER_WARMUP && times[RAFGL_PASS_TOTAL] > RAFGL_STUTTER_FACTOR * median)
+    {
+        rafgl_stutter_t *stutter = &__rafgl_stutters[__rafgl_stutter_count % RAFGL_STUTTER_LOG];
+        double worst = -1.0, pass_median;
+
+        stutter->frame = __rafgl_frames_timed;
+        stutter->total = times[RAFGL_PASS_TOTAL];
+        stutter->median = median;
+        for(pass = 0; pass < RAFGL_PASS_TOTAL; pass++)
+        {
+            pass_median = rafgl_histogram_percentile(&__rafgl_frame_histograms[pass], 0.5);
+            if(times[pass] - pass_median > worst)
+            {
+                worst = times[pass] - pass_median;
+                stutter->pass = pass;
+                stutter->pass_time = times[pass];
+                stutter->pass_median = pass_median;
+            }
+        }
+        __rafgl_stutter_count++;
+
+        if(__rafgl_frame_stats_interval > 0.0f)
+        {
+            rafgl_log(RAFGL_WARNING, "[STUTTER frame %llu: %.2f ms, median %.2f ms, %s took %.2f ms]\n", (unsigned long long)stutter->frame,
+                      stutter->total * 1e3, stutter->median * 1e3, __rafgl_pass_names[stutter->pass], stutter->pass_time * 1e3);
+        }
+    }
+
+    for(pass = 0; pass < RAFGL_PASS_COUNT; pass++)
+    {
+        rafgl_histogram_record(&__rafgl_frame_histograms[pass], times[pass]);
+        rafgl_histogram_record(&__rafgl_interval_histograms[pass], times[pass]);
+        __rafgl_last_frame_times[pass] = times[pass];
+    }
+    __rafgl_frames_timed++;
+}
+
 void rafgl_game_request_state_change(int state_index, void *args)
 {
     __game_state_change_request = state_index;
@@ -1162,13 +2481,18 @@ void rafgl_game_start(rafgl_game_t *game, void *_args)
     float elapsed;
 
     double last_fps_frame;
+    double loop_start, update_start, render_start, swap_start, swap_end, last_stats_log;
+    double frame_times[RAFGL_PASS_COUNT];
+    char title[64];
 
-    last_fps_frame = last_frame = glfwGetTime();
+    last_stats_log = last_fps_frame = last_frame = glfwGetTime();
 
     int fbwidth, fbheight, fbwlast = 0, fbhlast = 0;
 
     while(!glfwWindowShouldClose(game->window))
     {
+        loop_start = glfwGetTime();
+
         for(i = 0; i < 400; i++)
         {
             __keys_pressed[i] = 0;
@@ -1209,12 +2533,32 @@ void rafgl_game_start(rafgl_game_t *game, void *_args)
         game_data.is_rmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_RIGHT);
         game_data.is_mmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_MIDDLE);
 
+        update_start = glfwGetTime();
         current_state->update(game->window, elapsed, &game_data, args);
 
-
+        render_start = glfwGetTime();
         current_state->render(game->window, args);
 
+        swap_start = glfwGetTime();
         glfwSwapBuffers(game->window);
+        swap_end = glfwGetTime();
+
+        frame_times[RAFGL_PASS_UPDATE] = render_start - update_start;
+        frame_times[RAFGL_PASS_RENDER] = swap_start - render_start;
+        frame_times[RAFGL_PASS_SWAP] = swap_end - swap_start;
+        frame_times[RAFGL_PASS_TOTAL] = swap_end - loop_start;
+        frame_times[RAFGL_PASS_EVENTS] = frame_times[RAFGL_PASS_TOTAL] - frame_times[RAFGL_PASS_UPDATE] - frame_times[RAFGL_PASS_RENDER] - frame_times[RAFGL_PASS_SWAP];
+        __rafgl_record_frame(frame_times);
+        rafgl_memory_end_frame();
+
+        if(__rafgl_frame_stats_interval > 0.0f && swap_end - last_stats_log >= __rafgl_frame_stats_interval)
+        {
+            sprintf(title, "FRAME TIMES, LAST %.1f s", swap_end - last_stats_log);
+            __rafgl_log_histograms(title, __rafgl_interval_histograms);
+            for(i = 0; i < RAFGL_PASS_COUNT; i++)
+                rafgl_histogram_reset(&__rafgl_interval_histograms[i]);
+            last_stats_log = swap_end;
+        }
 
         if(__game_state_change_request == current_game_state_index)
         {
@@ -1242,6 +2586,12 @@ void rafgl_game_start(rafgl_game_t *game, void *_args)
 
     }
 
+    /* the window was closed, the state still gets to release what it holds */
+    current_state->cleanup(game->window, args);
+
+    if(__rafgl_frame_stats_at_exit && __rafgl_frames_timed > 0)
+        rafgl_frame_stats_dump();
+
     for(i = 0; i < RAFGL_LOG_LEVELS; i++)
     {
         fclose(__log_files[i]);
@@ -1440,7 +2790,10 @@ void rafgl_texture_load_from_raster(rafgl_texture_t *texture, rafgl_raster_t *ra
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+    /* padded rows and views are uploaded in place, GL skips to the next row by itself */
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, raster->stride != raster->width ? raster->stride : 0);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, raster->width, raster->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, raster->data);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
     glBindTexture(GL_TEXTURE_2D, 0);
 
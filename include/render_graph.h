@@ -0,0 +1,77 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include "rafgl.h"
+#include "game_constants.h"
+#include <stdio.h>
+
+/// A frame as a list of passes that declare which rasters they read and write.
+/// Compiling a graph drops the passes nothing presented depends on, groups the rest
+/// into levels that only depend on earlier levels, and gives every transient raster
+/// a slot shared with transients whose levels don't overlap. Slots are shared by all
+/// graphs too, since only one graph runs in a frame.
+
+/// A pass gets its rasters in the order it declared them.
+typedef void (*render_pass_fn_t)(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes);
+
+/// calls rand() or touches other shared state, so never runs beside another pass
+#define RENDER_PASS_SERIAL 1
+
+typedef struct {
+    const char *name;
+    rafgl_raster_t *raster;         /// imported rasters point at the caller's, transients at their slot
+    int transient;
+    int first_level, last_level;    /// levels a transient is used in, from compile
+    int slot;
+} render_resource_t;
+
+typedef struct {
+    const char *name;
+    render_pass_fn_t run;
+    int flags;
+    int reads[RENDER_MAX_PASS_IO], read_count;
+    int writes[RENDER_MAX_PASS_IO], write_count;
+    int level;                      /// -1 when culled
+} render_pass_t;
+
+typedef struct {
+    const char *name;
+    render_resource_t resources[RENDER_MAX_RESOURCES];
+    int resource_count;
+    render_pass_t passes[RENDER_MAX_PASSES];
+    int pass_count;
+    int output;
+    int levels;
+    int slots;
+} render_graph_t;
+
+void render_graph_init(render_graph_t *graph, const char *name);
+
+/// A raster that outlives the frame; the graph only keeps the pointer.
+int render_graph_import(render_graph_t *graph, const char *name, rafgl_raster_t *raster);
+
+/// A frame-sized raster only the graph's passes use. Its contents are undefined until a pass writes it.
+int render_graph_transient(render_graph_t *graph, const char *name);
+
+int render_graph_pass(render_graph_t *graph, const char *name, render_pass_fn_t run, int flags);
+
+void render_graph_read(render_graph_t *graph, int pass, int resource);
+
+void render_graph_write(render_graph_t *graph, int pass, int resource);
+
+/// Culls, levels and aliases the graph for presenting output.
+void render_graph_compile(render_graph_t *graph, int output);
+
+/// Runs the live passes level by level. Under OPENMP=1 the passes of a level run side by side.
+void render_graph_execute(render_graph_t *graph);
+
+rafgl_raster_t *render_graph_output(render_graph_t *graph);
+
+void render_graph_dump(const render_graph_t *graph, FILE *out);
+
+/// Transient slots are reallocated at the new size; what they held is gone.
+void render_graph_resize(int width, int height);
+
+void render_graph_cleanup();
+
+#endif //RENDER_GRAPH_H
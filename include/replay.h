@@ -0,0 +1,61 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "rafgl.h"
+#include "game_constants.h"
+#include <stdio.h>
+#include <stdint.h>
+
+/// Input log of a play session. Every frame stores its delta time, the keys
+/// held or pressed, the mouse, the measured work time and a hash of the presented frame.
+/// Replaying one with the same seed and window size feeds the game the same
+/// frames, so the hashes must match; the first frame that differs is reported.
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t seed;
+    int32_t width, height;
+    double sim_step;
+} replay_header_t;
+
+typedef struct {
+    float delta_time;
+    float frame_time;       /// work time measured while recording, replayed into the frame budget controllers
+    uint32_t frame_hash;
+    float mouse_x, mouse_y;
+    uint8_t buttons;        /// bit 0 - left, 1 - right, 2 - middle
+    uint8_t key_count;
+    uint16_t keys[REPLAY_MAX_KEYS];  /// key code with REPLAY_KEY_DOWN and REPLAY_KEY_PRESSED
+} replay_frame_t;
+
+typedef struct {
+    FILE *file;
+    int recording;          /// 1 - writing a log, 0 - playing one back
+    replay_header_t header;
+    replay_frame_t frame;   /// the frame between update and render
+    uint8_t keys_down[REPLAY_KEY_RANGE];
+    uint8_t keys_pressed[REPLAY_KEY_RANGE];
+    long long frames;
+    long long mismatches;
+    long long first_mismatch;
+} replay_t;
+
+/// Both return 0 if the file can't be opened or isn't a replay.
+int replay_record(replay_t *replay, const char *path, uint32_t seed, int width, int height, double sim_step);
+
+int replay_open(replay_t *replay, const char *path);
+
+/// Recording: remembers this frame's input. Replaying: overwrites delta_time and the
+/// input in game_data with the next logged frame, returns 0 once the log runs out.
+int replay_input(replay_t *replay, float *delta_time, rafgl_game_data_t *game_data);
+
+/// Recording: writes the frame out. Replaying: swaps in the logged frame time and
+/// checks the hash of what was presented against the logged one.
+void replay_end_frame(replay_t *replay, float *frame_time, uint32_t frame_hash);
+
+void replay_close(replay_t *replay);
+
+uint32_t replay_hash_raster(const rafgl_raster_t *raster);
+
+#endif //REPLAY_H
@@ -0,0 +1,28 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include "rafgl.h"
+#include "game_constants.h"
+
+/// Picks the internal render resolution from how long recent frames took.
+/// The scale drops straight to what should fit the budget when frames run
+/// long, and climbs back one step at a time once the next step would fit too.
+typedef struct {
+    int display_width, display_height;
+    int width, height;          /// internal resolution the world is rendered at
+    float scale;
+    float min_scale, max_scale;
+    float target_frame_time;    /// seconds of work allowed per frame
+    float frame_time;           /// smoothed work time of recent frames
+    float cooldown;             /// seconds of frame time left before the scale may change again
+    int enabled;
+} resolution_controller_t;
+
+void resolution_init(resolution_controller_t *controller, int display_width, int display_height, float target_fps, int enabled);
+
+/// Feeds the work time of the last frame, returns 1 when the internal resolution changed.
+int resolution_update(resolution_controller_t *controller, float frame_time);
+
+void resolution_set_scale(resolution_controller_t *controller, float scale);
+
+#endif //RESOLUTION_H
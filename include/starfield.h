@@ -0,0 +1,47 @@
+#ifndef STARFIELD_H
+#define STARFIELD_H
+
+#include "rafgl.h"
+#include "game_constants.h"
+#include <stdint.h>
+
+/// Structure-of-arrays hyperdrive starfield. Depth is stored alongside its
+/// reciprocal, so projecting a star is a multiply instead of a divide.
+typedef struct {
+    int capacity;
+    int count;
+
+    float *x, *y, *z;
+    float *inv_z;
+    float *speed;
+    uint32_t *colour;
+
+    rafgl_streak_t *streaks;    /// projected streaks of the current frame
+    int16_t *first_band;        /// raster bands each streak touches, empty when off screen
+    int16_t *last_band;
+    int band_count;
+    int *band_start;            /// streak indices binned by the raster bands they touch
+    int *band_cursor;
+    int *band_items;
+    int band_items_capacity;
+
+    float brightness;           /// keeps the overall glow steady when the star count changes
+    uint32_t tick;
+} starfield_t;
+
+void starfield_init(starfield_t *field, int capacity);
+
+void starfield_cleanup(starfield_t *field);
+
+void starfield_reset(starfield_t *field, int count);
+
+/// Changes the live star count without disturbing the stars that stay.
+void starfield_set_count(starfield_t *field, int count);
+
+void starfield_update(starfield_t *field, float delta_time, int width, int height);
+
+/// Fades the raster by trail_decay / 256 and adds every star's streak on top.
+/// override_colour, when not NULL, paints all stars in that colour.
+void starfield_render(starfield_t *field, rafgl_raster_t *raster, float offset_x, float offset_y, const uint32_t *override_colour, int trail_decay);
+
+#endif //STARFIELD_H
@@ -4,6 +4,31 @@
 #ifndef UTILITY_H
 #define UTILITY_H
 
+/// Camera shake is applied once to the finished frame instead of to every piece of geometry.
+typedef struct {
+    float intensity;        /// current amplitude, in pixels
+    float max_intensity;
+    float growth;           /// amplitude gained per second
+    float offset_x, offset_y;
+} camera_shake_t;
+
+/// Fixed-step simulation clock. Frame time is banked and paid out in whole steps,
+/// whatever is left over becomes the interpolation factor for presentation.
+typedef struct {
+    double step;            /// seconds of simulation per step
+    double accumulator;     /// banked time not yet simulated
+    int max_steps;          /// steps one frame may pay out before the backlog is dropped
+    long long steps;        /// steps taken since init
+    float alpha;            /// progress into the next step, 0..1
+} sim_clock_t;
+
+/// A frame shrunk by 2^shift for effects with no fine detail to lose, such as blurs.
+/// The copy is borrowed from the frame pool between begin and end.
+typedef struct {
+    rafgl_raster_t raster;
+    int shift;
+} reduced_raster_t;
+
 
 double cosine_interpolationf(double a, double b, double s);
 
@@ -21,22 +46,45 @@ rafgl_raster_t generate_galaxy_texture(int width, int height, int octaves, doubl
 
 void update_ellipsoid_path_point(float *x, float *y, float cx, float cy, float a, float b, float *theta, float delta_time, float speed, int direction);
 
-rafgl_raster_t generate_perlin_with_color(int octaves, double persistence);
-
-void apply_distortion(rafgl_raster_t raster, float distortion_factor);
+rafgl_raster_t generate_perlin_with_color(int width, int height, int octaves, double persistence);
 
-void apply_screen_distortion(rafgl_raster_t raster, float delta_time_elapsed, float distortion_duration);
+/// Displacement amplitude, in pixels, of the screen distortion delta_time_elapsed into it.
+float screen_distortion_factor(float delta_time_elapsed, float distortion_duration);
 
 void whiteout(rafgl_raster_t raster, float white_factor);
 
+/// How far towards white the whiteout is, delta_time_elapsed into it.
+float whiteout_factor(float delta_time_elapsed, float whiteout_duration);
+
 void apply_whiteout(rafgl_raster_t raster, float delta_time_elapsed, float whiteout_duration);
 
+void camera_shake_init(camera_shake_t *shake, float growth, float max_intensity);
+
+void camera_shake_update(camera_shake_t *shake, float delta_time);
+
+void camera_shake_apply(camera_shake_t *shake, rafgl_raster_t *to, rafgl_raster_t *from, uint32_t edge_colour);
+
+void sim_clock_init(sim_clock_t *clock, double step, int max_steps);
+
+/// Banks delta_time and returns how many steps to simulate this frame.
+int sim_clock_advance(sim_clock_t *clock, double delta_time);
+
 void custom_rafgl_raster_draw_spritesheet(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int frame_x, int frame_y, int x, int y);
 
-void apply_radial_blur(rafgl_raster_t raster, rafgl_raster_t *output, float blur_strength);
+/// Zoom blur towards (center_x, center_y): each pixel becomes the mean of the frame along the
+/// last zoom share of the way from the centre to it. Runs at most max_passes passes.
+void apply_radial_blur(rafgl_raster_t raster, int center_x, int center_y, float zoom, int max_passes);
 
 void apply_gaussian_blur(rafgl_raster_t raster, int radius);
 
-void render_proximity_vignette(rafgl_raster_t raster, int cx, int cy, float vignette_factor, float rocket_sun_dist, float vignette_r, float vignette_g, float vignette_b, float r);
+/// Shrinks frame with shift 2x2 box downsamples; with shift 0 the reduced raster is frame itself.
+void reduced_raster_begin(reduced_raster_t *reduced, rafgl_raster_t *frame, int shift);
+
+/// Stretches the reduced copy back over frame with a bilinear upsample and gives it back to the pool.
+void reduced_raster_end(reduced_raster_t *reduced, rafgl_raster_t *frame);
+
+/// Adds a glow around everything brighter than BLOOM_THRESHOLD, built from a pyramid of levels
+/// halving from half size down. More levels spread it further; strength scales the light added.
+void apply_bloom(rafgl_raster_t raster, int levels, float strength);
 
 #endif //UTILITY_H
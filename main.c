@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -15,8 +16,31 @@ int main(int argc, char *argv[])
 {
 
     rafgl_game_t game;
-
-    rafgl_game_init(&game, "Orbit Shift", 1080, 1080, 0);
+    int width = RASTER_WIDTH, height = RASTER_HEIGHT;
+
+    /// ./main.out --headless steps [seed], simulates without a window and reports the speed
+    if (argc >= 3 && strcmp(argv[1], "--headless") == 0) {
+        unsigned int seed = argc >= 4 ? strtoul(argv[3], NULL, 10) : 1;
+        return main_state_run_headless(width, height, atoll(argv[2]), seed);
+    }
+
+    /// ./main.out --record file [width height] logs the session, ./main.out --replay file plays it back
+    int arg = 1;
+    if (argc >= 3 && strcmp(argv[1], "--record") == 0) {
+        main_state_record_to(argv[2]);
+        arg = 3;
+    } else if (argc >= 3 && strcmp(argv[1], "--replay") == 0) {
+        if (!main_state_replay_from(argv[2], &width, &height)) return 1;
+        arg = argc;
+    }
+
+    /// ./main.out [width height], e.g. ./main.out 3840 2160
+    if (argc >= arg + 2) {
+        width = atoi(argv[arg]);
+        height = atoi(argv[arg + 1]);
+    }
+
+    rafgl_game_init(&game, "Orbit Shift", width, height, 0);
     rafgl_game_add_named_game_state(&game, main_state);
     rafgl_game_start(&game, NULL);
 
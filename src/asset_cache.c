@@ -0,0 +1,282 @@
+#include <asset_cache.h>
+#include <rafgl.h>
+#include <utility.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define ASSET_CACHE_MAGIC "OSAC"
+#define ASSET_CACHE_VERSION 1
+#define ASSET_CACHE_EXTENSION ".ras"
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t key_hash;
+    int32_t width, height;
+} asset_cache_header_t;
+
+typedef struct {
+    char path[512];
+    long size;
+    time_t last_used;
+} asset_cache_entry_t;
+
+static char cache_directory[256] = ASSET_CACHE_DIR;
+static long cache_max_bytes = ASSET_CACHE_MAX_BYTES;
+static int cache_variants = ASSET_CACHE_VARIANTS;
+
+void asset_cache_init(const char *directory, long max_bytes, int variants) {
+    snprintf(cache_directory, sizeof(cache_directory), "%s", directory);
+    cache_max_bytes = max_bytes;
+    cache_variants = variants;
+
+#ifdef _WIN32
+    _mkdir(cache_directory);
+#else
+    mkdir(cache_directory, 0755);
+#endif
+}
+
+unsigned int asset_cache_seed(void) {
+    unsigned int seed = rand();
+    return cache_variants > 0 ? seed % cache_variants : seed;
+}
+
+/// FNV-1a over the key fields one by one, so struct padding never leaks into the hash
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t asset_cache_hash(asset_key_t key) {
+    uint64_t hash = 14695981039346656037ULL;
+    int32_t generator = key.generator;
+    hash = fnv1a(hash, &generator, sizeof(generator));
+    hash = fnv1a(hash, &key.octaves, sizeof(key.octaves));
+    hash = fnv1a(hash, &key.persistence, sizeof(key.persistence));
+    hash = fnv1a(hash, key.tint.components, 3);
+    hash = fnv1a(hash, &key.width, sizeof(key.width));
+    hash = fnv1a(hash, &key.height, sizeof(key.height));
+    hash = fnv1a(hash, &key.seed, sizeof(key.seed));
+    return hash;
+}
+
+static void asset_cache_path(char *path, size_t size, uint64_t hash) {
+    snprintf(path, size, "%s/%016llx%s", cache_directory, (unsigned long long)hash, ASSET_CACHE_EXTENSION);
+}
+
+static int header_matches(const asset_cache_header_t *header, uint64_t hash, int width, int height) {
+    return memcmp(header->magic, ASSET_CACHE_MAGIC, 4) == 0
+        && header->version == ASSET_CACHE_VERSION
+        && header->key_hash == hash
+        && header->width == width
+        && header->height == height;
+}
+
+static int asset_cache_load(const char *path, uint64_t hash, int width, int height, rafgl_raster_t *raster) {
+    size_t pixel_bytes = (size_t)width * height * sizeof(rafgl_pixel_rgb_t);
+    size_t file_bytes = sizeof(asset_cache_header_t) + pixel_bytes;
+
+#ifdef _WIN32
+    FILE *file = fopen(path, "rb");
+    if (!file) return 0;
+
+    asset_cache_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || !header_matches(&header, hash, width, height)) {
+        fclose(file);
+        return 0;
+    }
+
+    rafgl_raster_init(raster, width, height);
+    if (fread(raster->data, 1, pixel_bytes, file) != pixel_bytes) {
+        rafgl_raster_cleanup(raster);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != file_bytes) {
+        close(fd);
+        return 0;
+    }
+
+    void *mapping = mmap(NULL, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return 0;
+
+    if (!header_matches(mapping, hash, width, height)) {
+        munmap(mapping, file_bytes);
+        return 0;
+    }
+
+    /// rasters are released with free(), so the pixels are copied out of the mapping
+    rafgl_raster_init(raster, width, height);
+    memcpy(raster->data, (char *)mapping + sizeof(asset_cache_header_t), pixel_bytes);
+    munmap(mapping, file_bytes);
+#endif
+
+    /// bump the LRU clock
+    utime(path, NULL);
+    return 1;
+}
+
+static int compare_entries_by_age(const void *a, const void *b) {
+    const asset_cache_entry_t *ea = a;
+    const asset_cache_entry_t *eb = b;
+    if (ea->last_used < eb->last_used) return -1;
+    if (ea->last_used > eb->last_used) return 1;
+    return 0;
+}
+
+static void asset_cache_evict(void) {
+    DIR *dir = opendir(cache_directory);
+    if (!dir) return;
+
+    int count = 0, capacity = 64;
+    asset_cache_entry_t *entries = malloc(capacity * sizeof(asset_cache_entry_t));
+    long total_bytes = 0;
+
+    struct dirent *ent;
+    size_t extension_length = strlen(ASSET_CACHE_EXTENSION);
+    while ((ent = readdir(dir)) != NULL) {
+        size_t name_length = strlen(ent->d_name);
+        if (name_length <= extension_length || strcmp(ent->d_name + name_length - extension_length, ASSET_CACHE_EXTENSION) != 0)
+            continue;
+
+        if (count == capacity) {
+            capacity *= 2;
+            entries = realloc(entries, capacity * sizeof(asset_cache_entry_t));
+        }
+
+        asset_cache_entry_t *entry = &entries[count];
+        snprintf(entry->path, sizeof(entry->path), "%s/%s", cache_directory, ent->d_name);
+
+        struct stat st;
+        if (stat(entry->path, &st) != 0)
+            continue;
+
+        entry->size = st.st_size;
+        entry->last_used = st.st_mtime;
+        total_bytes += entry->size;
+        count++;
+    }
+    closedir(dir);
+
+    qsort(entries, count, sizeof(asset_cache_entry_t), compare_entries_by_age);
+
+    for (int i = 0; i < count && total_bytes > cache_max_bytes; i++) {
+        if (remove(entries[i].path) == 0) {
+            total_bytes -= entries[i].size;
+        }
+    }
+
+    free(entries);
+}
+
+static void asset_cache_store(const char *path, uint64_t hash, rafgl_raster_t raster) {
+    size_t pixel_bytes = (size_t)raster.width * raster.height * sizeof(rafgl_pixel_rgb_t);
+    if ((long)(sizeof(asset_cache_header_t) + pixel_bytes) > cache_max_bytes)
+        return;
+
+    char tmp_path[520];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        rafgl_log(RAFGL_WARNING, "Asset cache: cannot write %s\n", tmp_path);
+        return;
+    }
+
+    asset_cache_header_t header;
+    memcpy(header.magic, ASSET_CACHE_MAGIC, 4);
+    header.version = ASSET_CACHE_VERSION;
+    header.key_hash = hash;
+    header.width = raster.width;
+    header.height = raster.height;
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1
+          && fwrite(raster.data, 1, pixel_bytes, file) == pixel_bytes;
+    ok = (fclose(file) == 0) && ok;
+
+    /// write-then-rename so a crash never leaves a truncated entry behind
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return;
+    }
+
+    asset_cache_evict();
+}
+
+static rafgl_raster_t run_generator(asset_key_t key) {
+    switch (key.generator) {
+        case ASSET_GENERATOR_PERLIN:
+            return generate_perlin(key.octaves, key.persistence);
+        case ASSET_GENERATOR_PERLIN_COLOR:
+            return generate_perlin_with_color(key.width, key.height, key.octaves, key.persistence);
+        case ASSET_GENERATOR_GALAXY:
+        default:
+            return generate_galaxy_texture(key.width, key.height, key.octaves, key.persistence, key.tint);
+    }
+}
+
+rafgl_raster_t asset_cache_generate(asset_key_t key) {
+    /// generators draw from rand(), so they run under the key's seed and the global
+    /// stream continues from the same draw whether the asset was loaded or generated
+    unsigned int resume_seed = rand();
+    srand(key.seed);
+    rafgl_raster_t raster = run_generator(key);
+    srand(resume_seed);
+    return raster;
+}
+
+rafgl_raster_t asset_cache_get(asset_key_t key) {
+    rafgl_raster_t raster;
+    uint64_t hash = asset_cache_hash(key);
+    char path[512];
+    asset_cache_path(path, sizeof(path), hash);
+
+    if (asset_cache_load(path, hash, key.width, key.height, &raster)) {
+        srand(rand());  /// leaves the stream where asset_cache_generate would have
+        return raster;
+    }
+
+    raster = asset_cache_generate(key);
+    asset_cache_store(path, hash, raster);
+    return raster;
+}
+
+rafgl_raster_t cached_perlin(int octaves, double persistence, unsigned int seed) {
+    int size = 1 << octaves;
+    asset_key_t key = {ASSET_GENERATOR_PERLIN, octaves, persistence, {{0, 0, 0, 0}}, size, size, seed};
+    return asset_cache_get(key);
+}
+
+rafgl_raster_t cached_perlin_with_color(int width, int height, int octaves, double persistence, unsigned int seed) {
+    asset_key_t key = {ASSET_GENERATOR_PERLIN_COLOR, octaves, persistence, {{0, 0, 0, 0}}, width, height, seed};
+    return asset_cache_get(key);
+}
+
+rafgl_raster_t cached_galaxy_texture(int width, int height, int octaves, double persistence, rafgl_pixel_rgb_t tint, unsigned int seed) {
+    asset_key_t key = {ASSET_GENERATOR_GALAXY, octaves, persistence, tint, width, height, seed};
+    return asset_cache_get(key);
+}
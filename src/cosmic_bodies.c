@@ -3,6 +3,12 @@
 #include <game_constants.h>
 #include <time.h>
 #include <utility.h>
+#include <asset_cache.h>
+#include <particles.h>
+#include <starfield.h>
+#include <quality.h>
+#include <frame_memory.h>
+#include <pixel_kernel.h>
 
 // CONSTANTS
 rafgl_pixel_rgb_t sun_color = { {214, 75, 15} };
@@ -21,96 +27,62 @@ int farthest_stars_count = 0;
 
 int show_smoke;
 
-smoke_particle_t smoke_particles[MAX_SMOKE_PARTICLES];
-int active_smoke_particles = 0;
-
-star_t hyperdrive_stars[MAX_HYPER_STARS];
-
-
-void init_stars() {
-    for (int i = 0; i < MAX_HYPER_STARS; i++) {
-        hyperdrive_stars[i].x += ((float)rand() / RAND_MAX - 0.5f) * 0.1f; // Random offset in X
-        hyperdrive_stars[i].y += ((float)rand() / RAND_MAX - 0.5f) * 0.1f; // Random offset in Y
-
-        hyperdrive_stars[i].z = ((float)rand() / RAND_MAX) * 100.0f + 1.0f; // Closer stars move faster
-        hyperdrive_stars[i].speed = HYPER_STAR_SPEED;
-    }
+/// PARTICLES
+particle_pool_t particle_pool;
+particle_emitter_t smoke_emitter;
+particle_sprite_t smoke_sprite;
+
+/// HYPERDRIVE STARS
+starfield_t hyperdrive_starfield;
+static int system_star_chance = 0;     /// star updates since the jump, past 75 every star takes the next system's colour
+
+/// VIEW
+/// World coordinates are window pixels. Rasters can be smaller than the window
+/// (dynamic resolution), so positions and sizes are multiplied by view_scale when drawn.
+static int world_width = RASTER_WIDTH;
+static int world_height = RASTER_HEIGHT;
+static float view_scale = 1.0f;
+
+/// QUALITY
+static float fisheye_radius = 3.0f;    /// black hole lens radius, in black hole radii
+
+void set_view(int width, int height, float scale) {
+    world_width = width;
+    world_height = height;
+    view_scale = scale;
 }
 
-void update_stars(float delta_time, int width, int height) {
-    for (int i = 0; i < MAX_HYPER_STARS; i++) {
-        hyperdrive_stars[i].z -= hyperdrive_stars[i].speed * delta_time;
-
-        hyperdrive_stars[i].x += ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
-        hyperdrive_stars[i].y += ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
 
-        if (hyperdrive_stars[i].z <= 0 || fabs(hyperdrive_stars[i].x / hyperdrive_stars[i].z) > width || fabs(hyperdrive_stars[i].y / hyperdrive_stars[i].z) > height) {
-            hyperdrive_stars[i].x = ((float)rand() / RAND_MAX - 0.5f) * width * 2.0f;
-            hyperdrive_stars[i].y = ((float)rand() / RAND_MAX - 0.5f) * height * 2.0f;
-            hyperdrive_stars[i].z = ((float)rand() / RAND_MAX) * 100.0f + 1.0f;
-            hyperdrive_stars[i].speed = ((float)rand() / RAND_MAX) * 5.0f + 1.0f;
-        }
-    }
+void init_stars(int count) {
+    if (!hyperdrive_starfield.capacity)
+        starfield_init(&hyperdrive_starfield, MAX_HYPER_STARS);
+    starfield_reset(&hyperdrive_starfield, count);
+    system_star_chance = 0;
 }
 
+void cleanup_stars() {
+    starfield_cleanup(&hyperdrive_starfield);
+}
 
-void render_stars(rafgl_raster_t *raster, int width, int height) {
-    for (int i = 0; i < MAX_HYPER_STARS; i++) {
-        float streak_length = 1.0f + (50.0f / hyperdrive_stars[i].z);
-        float prev_x = hyperdrive_stars[i].x / (hyperdrive_stars[i].z + hyperdrive_stars[i].speed * streak_length);
-        float prev_y = hyperdrive_stars[i].y / (hyperdrive_stars[i].z + hyperdrive_stars[i].speed * streak_length);
-        float cur_x = hyperdrive_stars[i].x / hyperdrive_stars[i].z;
-        float cur_y = hyperdrive_stars[i].y / hyperdrive_stars[i].z;
-
-        int screen_prev_x = (int)(prev_x * width + width / 2);
-        int screen_prev_y = (int)(prev_y * height + height / 2);
-        int screen_cur_x = (int)(cur_x * width + width / 2);
-        int screen_cur_y = (int)(cur_y * height + height / 2);
-
-        int color = rafgl_RGB(rand() % 256, rand() % 256, 255);
-
-        rafgl_raster_draw_line(raster, screen_cur_x, screen_cur_y, screen_prev_x, screen_prev_y, color);
-    }
+void set_hyper_star_count(int count) {
+    if (hyperdrive_starfield.capacity)
+        starfield_set_count(&hyperdrive_starfield, count);
 }
 
-void render_stars_with_shaking(rafgl_raster_t *raster, int width, int height, float delta_time, rafgl_pixel_rgb_t next_system_color, int ending) {
-    static float shake_intensity = 0.0f;
-    const float max_shake = 10.0f;
-    static int system_star_chance = 0;
+void update_stars(float delta_time, int width, int height) {
     system_star_chance += 1;
+    starfield_update(&hyperdrive_starfield, delta_time, width, height);
+}
 
-    shake_intensity += delta_time * 0.5f;
-    if (shake_intensity > max_shake) shake_intensity = max_shake;
-
-    float random_offset_x = ((float)rand() / RAND_MAX - 0.5f) * 2.0f * shake_intensity;
-    float random_offset_y = ((float)rand() / RAND_MAX - 0.5f) * 2.0f * shake_intensity;
-
-    for (int i = 0; i < MAX_HYPER_STARS; i++) {
-        float streak_length = 1.0f + (50.0f / hyperdrive_stars[i].z);
-        float prev_x = hyperdrive_stars[i].x / (hyperdrive_stars[i].z + hyperdrive_stars[i].speed * streak_length);
-        float prev_y = hyperdrive_stars[i].y / (hyperdrive_stars[i].z + hyperdrive_stars[i].speed * streak_length);
-        float cur_x = hyperdrive_stars[i].x / hyperdrive_stars[i].z;
-        float cur_y = hyperdrive_stars[i].y / hyperdrive_stars[i].z;
-
-        int screen_prev_x = (int)(prev_x * width + width / 2 + random_offset_x);
-        int screen_prev_y = (int)(prev_y * height + height / 2 + random_offset_y);
-        int screen_cur_x = (int)(cur_x * width + width / 2 + random_offset_x);
-        int screen_cur_y = (int)(cur_y * height + height / 2 + random_offset_y);
-
-        int color = rafgl_RGB(rand() % 256, rand() % 256, 255);
+void render_stars(rafgl_raster_t *raster) {
+    starfield_render(&hyperdrive_starfield, raster, 0.0f, 0.0f, NULL, HYPER_TRAIL_DECAY);
+}
 
-        if (system_star_chance > 75) {
-            color = rafgl_RGB(next_system_color.r, next_system_color.g, next_system_color.b);
-        }
+void render_hyperdrive_stars(rafgl_raster_t *raster, rafgl_pixel_rgb_t next_system_color, int trail_decay) {
+    uint32_t system_color = rafgl_RGB(next_system_color.r, next_system_color.g, next_system_color.b);
 
-        if (screen_cur_x != screen_prev_x || screen_cur_y != screen_prev_y) {
-            rafgl_raster_draw_line(raster, screen_cur_x, screen_cur_y, screen_prev_x, screen_prev_y, color);
-        }
-    }
-    if (ending) {
-        shake_intensity = 0.0f;
-        system_star_chance = 0;
-    }
+    starfield_render(&hyperdrive_starfield, raster, 0.0f, 0.0f,
+                     system_star_chance > 75 ? &system_color : NULL, trail_decay);
 }
 
 void draw_hyperspeed_rocket(rafgl_raster_t *raster, int width, int height, float delta_time) {
@@ -122,6 +94,10 @@ void draw_hyperspeed_rocket(rafgl_raster_t *raster, int width, int height, float
         elongation_factor = max_elongation;
     }
 
+    const float elongation = elongation_factor * 10 * view_scale;
+    const int tip_gap = 150 * view_scale;
+    const int wing_gap = 200 * view_scale;
+
     const int start_rx_tip = width / 2;
     const int start_ry_tip = (height / 8) * 6;
     const int start_rx_left = width / 4;
@@ -130,40 +106,30 @@ void draw_hyperspeed_rocket(rafgl_raster_t *raster, int width, int height, float
     const int start_ry_right = (height / 8) * 7;
 
     int rx_tip = start_rx_tip;
-    int ry_tip = (start_ry_tip - elongation_factor * 10 > height / 2 + 150)
-        ? start_ry_tip - elongation_factor * 10
-        : height / 2 + 150;
+    int ry_tip = (start_ry_tip - elongation > height / 2 + tip_gap)
+        ? start_ry_tip - elongation
+        : height / 2 + tip_gap;
 
-    int rx_left = (start_rx_left + elongation_factor * 10 < width / 2 - 200)
-        ? start_rx_left + elongation_factor * 10
-        : width / 2 - 200;
+    int rx_left = (start_rx_left + elongation < width / 2 - wing_gap)
+        ? start_rx_left + elongation
+        : width / 2 - wing_gap;
     int ry_left = start_ry_left;
 
-    int rx_right = (start_rx_right - elongation_factor * 10 > width / 2 + 200)
-        ? start_rx_right - elongation_factor * 10
-        : width / 2 + 200;
+    int rx_right = (start_rx_right - elongation > width / 2 + wing_gap)
+        ? start_rx_right - elongation
+        : width / 2 + wing_gap;
     int ry_right = start_ry_right;
 
-    static float shake_intensity = 1; // Adjust intensity of the shake
-    int shake_x = (rand() % (2 * (int) shake_intensity + 1)) - (int) shake_intensity; // Random [-shake_intensity, shake_intensity]
-    int shake_y = (rand() % (2 * (int) shake_intensity + 1)) - (int) shake_intensity;
-
-    rx_tip += shake_x;
-    ry_tip += shake_y;
-    rx_left += shake_x;
-    ry_left += shake_y;
-    rx_right += shake_x;
-    ry_right += shake_y;
-
     int color = rafgl_RGB(255, 255, 255);
 
+    rafgl_line_t outline[15];
+    int outline_count = 0;
     for (int offset = -2; offset <= 2; offset++) {
-        rafgl_raster_draw_line_custom(raster, rx_tip + offset, ry_tip, rx_left + offset, ry_left, color);
-        rafgl_raster_draw_line_custom(raster, rx_tip + offset, ry_tip, rx_right + offset, ry_right, color);
-        rafgl_raster_draw_line_custom(raster, rx_left + offset, ry_left, rx_right + offset, ry_right, color);
+        outline[outline_count++] = (rafgl_line_t){rx_tip + offset, ry_tip, rx_left + offset, ry_left, color};
+        outline[outline_count++] = (rafgl_line_t){rx_tip + offset, ry_tip, rx_right + offset, ry_right, color};
+        outline[outline_count++] = (rafgl_line_t){rx_left + offset, ry_left, rx_right + offset, ry_right, color};
     }
-
-    shake_intensity += 0.5;
+    rafgl_raster_draw_lines_thick(raster, outline, outline_count, RAFGL_LINE_SIZE);
 }
 
 void move_background_stars() {
@@ -173,10 +139,10 @@ void move_background_stars() {
     for (int i = 0; i < closest_stars_count; i++) {
         closest_stars[i].y += CLOSEST_STAR_SPEED;
         closest_stars[i].x += CLOSEST_STAR_SPEED / 2;
-        if (closest_stars[i].y >= RASTER_HEIGHT) {
+        if (closest_stars[i].y >= world_height) {
             closest_stars[i].y = 0;
         }
-        if (closest_stars[i].x >= RASTER_WIDTH) {
+        if (closest_stars[i].x >= world_width) {
             closest_stars[i].x = 0;
         }
     }
@@ -184,10 +150,10 @@ void move_background_stars() {
     for (int i = 0; i < middle_stars_count; i++) {
         middle_stars[i].y += MIDDLE_STAR_SPEED;
         middle_stars[i].x += CLOSEST_STAR_SPEED / 2;
-        if (middle_stars[i].y >= RASTER_HEIGHT) {
+        if (middle_stars[i].y >= world_height) {
             middle_stars[i].y = 0;
         }
-        if (middle_stars[i].x >= RASTER_WIDTH) {
+        if (middle_stars[i].x >= world_width) {
             middle_stars[i].x = 0;
         }
     }
@@ -195,10 +161,10 @@ void move_background_stars() {
     for (int i = 0; i < farthest_stars_count; i++) {
         farthest_stars[i].y += FARTHEST_STAR_SPEED;
         farthest_stars[i].x += CLOSEST_STAR_SPEED / 2;
-        if (farthest_stars[i].y >= RASTER_HEIGHT) {
+        if (farthest_stars[i].y >= world_height) {
             farthest_stars[i].y = 0;
         }
-        if (farthest_stars[i].x >= RASTER_WIDTH) {
+        if (farthest_stars[i].x >= world_width) {
             farthest_stars[i].x = 0;
         }
     }
@@ -210,20 +176,56 @@ void link_rocket(spaceship* ship, int smoke_effects) {
     show_smoke = smoke_effects;
 }
 
-void draw_realistic_sun(rafgl_raster_t raster, int x, int y, int radius) {
-    for (int i = 0; i < RASTER_WIDTH; i++) {
-        for (int j = 0; j < RASTER_HEIGHT; j++) {
-            float dx = i - x;
-            float dy = j - y;
-            float distance = sqrt(dx * dx + dy * dy);
+void set_render_quality(const quality_level_t *level) {
+    smoke_emitter.max_alive = level->particle_cap;
+    if (show_smoke && level->particle_cap == 0) {
+        particle_pool_clear(&particle_pool);
+    }
+    show_smoke = level->particle_cap > 0;
+    fisheye_radius = level->fisheye_radius;
+}
 
-            // TODO: Make surface smoother but still random
-            double noise = (rand() % 100) / 100.0 * sun_surface_noise_factor;
+typedef struct {
+    int x, y, radius;
+    const unsigned char *noise;         /// rand() % 100 of every pixel in the bounding box, row by row
+    int left, top, pitch;
+} sun_params_t;
 
-            if (distance < radius * (1 + noise))
-                pixel_at_m(raster, i, j) = sun_color;
-        }
+KERNEL_INLINE void sun_pixel(const sun_params_t *p, rafgl_pixel_rgb_t *pixel, int i, int j) {
+    float dx = i - p->x;
+    float dy = j - p->y;
+    float distance = sqrt(dx * dx + dy * dy);
+
+    // TODO: Make surface smoother but still random
+    double noise = p->noise[(j - p->top) * p->pitch + i - p->left] / 100.0 * sun_surface_noise_factor;
+
+    if (distance < p->radius * (1 + noise))
+        *pixel = sun_color;
+}
+
+PIXEL_KERNEL(sun_kernel, sun_params_t, sun_pixel, 1)
+
+static void draw_sun(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, const void *params) {
+    sun_kernel(raster, x0, y0, x1, y1, params);
+}
+
+void draw_realistic_sun(display_list_t *list, int x, int y, int radius) {
+    /// nothing past the largest noisy radius is ever painted, so only its bounding box is visited
+    int reach = radius * (1 + sun_surface_noise_factor) + 1;
+    int left = rafgl_max_m(x - reach, 0), top = rafgl_max_m(y - reach, 0);
+    int right = rafgl_min_m(x + reach + 1, list->width), bottom = rafgl_min_m(y + reach + 1, list->height);
+    if (left >= right || top >= bottom) return;
+
+    /// the noise is drawn here, one rand() per pixel in row order, so the surface comes out
+    /// the same whichever tile or thread paints it
+    int pitch = right - left;
+    unsigned char *noise = scratch_alloc(&frame_scratch, pitch * (bottom - top));
+    for (int i = 0; i < pitch * (bottom - top); i++) {
+        noise[i] = rand() % 100;
     }
+
+    sun_params_t params = {x, y, radius, noise, left, top, pitch};
+    display_list_draw(list, draw_sun, &params, sizeof(params), left, top, right, bottom);
 }
 
 float vignette_strength(float distance_to_sun, float max_effect_distance, float max_intensity) {
@@ -233,42 +235,76 @@ float vignette_strength(float distance_to_sun, float max_effect_distance, float
     return max_intensity * (1.0f - (distance_to_sun / max_effect_distance));
 }
 
-void render_planets(rafgl_raster_t raster, rafgl_spritesheet_t black_hole_spritesheet,solar_system_t *solar_system) {
+typedef struct {
+    const rafgl_raster_t *texture;
+    int left, top;                      /// raster position of the texture's corner
+    float center_x, center_y, radius;
+    float scale;
+} planet_params_t;
+
+KERNEL_INLINE void planet_pixel(const planet_params_t *p, rafgl_pixel_rgb_t *pixel, int x, int y) {
+    if (rafgl_distance2D((float)x, (float)y, p->center_x, p->center_y) < p->radius) {
+        *pixel = pixel_at_pm(p->texture, (int)((x - p->left) / p->scale), (int)((y - p->top) / p->scale));
+    }
+}
+
+PIXEL_KERNEL(planet_kernel, planet_params_t, planet_pixel, 1)
+
+static void draw_planet(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, const void *params) {
+    planet_kernel(raster, x0, y0, x1, y1, params);
+}
+
+typedef struct {
+    int cx, cy, radius;
+} lens_params_t;
+
+static void draw_lens(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, const void *params) {
+    const lens_params_t *p = params;
+    apply_fisheye_lens(raster, p->cx, p->cy, p->radius);
+}
+
+void render_planets(display_list_t *list, rafgl_spritesheet_t *black_hole_spritesheet, const solar_system_t *solar_system) {
     for (int planet_id = 0; planet_id < solar_system->num_bodies; planet_id++) {
-        cosmic_body_t *planet = &solar_system->planets[planet_id];
+        const cosmic_body_t *planet = &solar_system->planets[planet_id];
+        float center_x = planet->current_x * view_scale;
+        float center_y = planet->current_y * view_scale;
+        float radius = planet->radius * view_scale;
         if (planet->is_center) {
-            draw_realistic_sun(raster, (int)planet->current_x, (int)planet->current_y, planet->radius);
+            draw_realistic_sun(list, (int)center_x, (int)center_y, radius);
         } else {
-            int top_left_x = planet->current_x - planet->radius;
-            int top_left_y = planet->current_y - planet->radius;
-            for (int i = 0; i < solar_system->planets[planet_id].radius * 2 + 20; i++) {
-                for (int j = 0; j < solar_system->planets[planet_id].radius * 2 + 20; j++) {
-                    int dx = top_left_x + i;
-                    int dy = top_left_y + j;
-                    if (dx >= 0 && dx < raster.width && dy >= 0 && dy < raster.height && rafgl_distance2D((float)dx, (float)dy, planet->current_x, planet->current_y) < planet->radius) {
-                        pixel_at_m(raster, dx, dy) = pixel_at_m(planet->texture, i, j);
-                    }
-                }
-            }
+            int top_left_x = center_x - radius;
+            int top_left_y = center_y - radius;
+            int extent = (planet->radius * 2 + 20) * view_scale;
+            planet_params_t params = {&planet->texture, top_left_x, top_left_y, center_x, center_y, radius, view_scale};
+            display_list_draw(list, draw_planet, &params, sizeof(params), top_left_x, top_left_y, top_left_x + extent, top_left_y + extent);
         }
     }
-    cosmic_body_t *black_hole = &solar_system->black_hole;
-    apply_fisheye_lens(&raster, black_hole->current_x + black_hole->radius, black_hole->current_y + black_hole->radius, black_hole->radius * 3);
-    rafgl_raster_draw_spritesheet(&raster, &black_hole_spritesheet,
+
+    /// the lens reads back what the planets drew around it, which can lie in another tile
+    const cosmic_body_t *black_hole = &solar_system->black_hole;
+    lens_params_t lens = {(black_hole->current_x + black_hole->radius) * view_scale, (black_hole->current_y + black_hole->radius) * view_scale, black_hole->radius * fisheye_radius * view_scale};
+    display_list_barrier(list, draw_lens, &lens, sizeof(lens));
+
+    display_list_sprite(list, black_hole_spritesheet,
         solar_system->black_hole.bh_curr_frame_x,
         solar_system->black_hole.bh_curr_frame_y,
-            (int) solar_system->black_hole.current_x,
-            (int) solar_system->black_hole.current_y);
+            (int) (solar_system->black_hole.current_x * view_scale),
+            (int) (solar_system->black_hole.current_y * view_scale),
+            view_scale);
+}
 
+void update_planets(solar_system_t *solar_system, float delta_time) {
     solar_system->black_hole.bh_curr_frame_x = (solar_system->black_hole.bh_curr_frame_x + 1) % 8;
     solar_system->black_hole.bh_curr_frame_y = (solar_system->black_hole.bh_curr_frame_y + 1) % 8;
 
     for (int i = 0; i < solar_system->num_bodies; i++) {
         if (!solar_system->planets[i].is_center) {
+            /// outer planets sweep faster, as they did with the old per-frame (rand() % i + 1) * 0.1 step
+            float orbit_time = delta_time * ORBIT_TIME_SCALE * (i + 1);
             update_ellipsoid_path_point(&solar_system->planets[i].current_x, &solar_system->planets[i].current_y,
                 solar_system->planets[i].orbit_center_x, solar_system->planets[i].orbit_center_y,
                 solar_system->planets[i].orbit_radius_x, solar_system->planets[i].orbit_radius_y,
-                &solar_system->planets[i].theta, (rand() % i+1) * 0.1, solar_system->planets[i].orbit_speed, solar_system->planets[i].orbit_direction);
+                &solar_system->planets[i].theta, orbit_time, solar_system->planets[i].orbit_speed, solar_system->planets[i].orbit_direction);
         }
     }
 }
@@ -291,44 +327,53 @@ rafgl_pixel_rgb_t map_noise_to_sun_color(double noise_value) {
     return (rafgl_pixel_rgb_t){r, g, b};
 }
 
-void draw_realistic_sun_with_texture(rafgl_raster_t raster, int x, int y, int radius, rafgl_raster_t sun_texture, double smooth_factor) {
-    int texture_width = sun_texture.width;
-    int texture_height = sun_texture.height;
+typedef struct {
+    int x, y, radius;
+    const rafgl_raster_t *texture;
+    double smooth_factor;
+} textured_sun_params_t;
 
-    for (int i = 0; i < RASTER_WIDTH; i++) {
-        for (int j = 0; j < RASTER_HEIGHT; j++) {
-            float dx = i - x;
-            float dy = j - y;
-            float distance = sqrt(dx * dx + dy * dy);
+KERNEL_INLINE void textured_sun_pixel(const textured_sun_params_t *p, rafgl_pixel_rgb_t *pixel, int i, int j) {
+    int texture_width = p->texture->width;
+    int texture_height = p->texture->height;
+    float dx = i - p->x;
+    float dy = j - p->y;
+    float distance = sqrt(dx * dx + dy * dy);
 
-            double current_noise = (rand() % 100) / 100.0 * sun_surface_noise_factor;
+    double current_noise = (rand() % 100) / 100.0 * sun_surface_noise_factor;
 
-            double smooth_noise_value = smooth_noise(current_noise, smooth_factor);
+    double smooth_noise_value = smooth_noise(current_noise, p->smooth_factor);
 
-            previous_noise = smooth_noise_value;
+    previous_noise = smooth_noise_value;
 
-            if (distance < radius * (1 + smooth_noise_value)) {
-                rafgl_pixel_rgb_t sun_color = map_noise_to_sun_color(smooth_noise_value);
+    if (distance < p->radius * (1 + smooth_noise_value)) {
+        rafgl_pixel_rgb_t sun_color = map_noise_to_sun_color(smooth_noise_value);
 
-                int tex_x = (int)((dx / radius + 1) * 0.5 * texture_width);
-                int tex_y = (int)((dy / radius + 1) * 0.5 * texture_height);
+        int tex_x = (int)((dx / p->radius + 1) * 0.5 * texture_width);
+        int tex_y = (int)((dy / p->radius + 1) * 0.5 * texture_height);
 
-                tex_x = (tex_x < 0) ? 0 : (tex_x >= texture_width) ? texture_width - 1 : tex_x;
-                tex_y = (tex_y < 0) ? 0 : (tex_y >= texture_height) ? texture_height - 1 : tex_y;
+        tex_x = (tex_x < 0) ? 0 : (tex_x >= texture_width) ? texture_width - 1 : tex_x;
+        tex_y = (tex_y < 0) ? 0 : (tex_y >= texture_height) ? texture_height - 1 : tex_y;
 
-                rafgl_pixel_rgb_t texture_color = pixel_at_m(sun_texture, tex_x, tex_y);
-                sun_color.r = (sun_color.r + texture_color.r) / 2; // Blend the colors
-                sun_color.g = (sun_color.g + texture_color.g) / 2;
-                sun_color.b = (sun_color.b + texture_color.b) / 2;
+        rafgl_pixel_rgb_t texture_color = pixel_at_pm(p->texture, tex_x, tex_y);
+        sun_color.r = (sun_color.r + texture_color.r) / 2; // Blend the colors
+        sun_color.g = (sun_color.g + texture_color.g) / 2;
+        sun_color.b = (sun_color.b + texture_color.b) / 2;
 
-                pixel_at_m(raster, i, j) = sun_color;
-            } else {
-                pixel_at_m(raster, i, j) = sky_color;
-            }
-        }
+        *pixel = sun_color;
+    } else {
+        *pixel = sky_color;
     }
 }
 
+/// the noise is smoothed along the scan, so the pass keeps to one thread and row order
+PIXEL_KERNEL(textured_sun_kernel, textured_sun_params_t, textured_sun_pixel, 0)
+
+void draw_realistic_sun_with_texture(rafgl_raster_t raster, int x, int y, int radius, rafgl_raster_t sun_texture, double smooth_factor) {
+    textured_sun_params_t params = {x, y, radius, &sun_texture, smooth_factor};
+    textured_sun_kernel(&raster, KERNEL_WHOLE(&raster), &params);
+}
+
 void render_background_star(rafgl_raster_t raster, background_star_t star) {
 
     //printf("PRINTING STAR\n");
@@ -344,32 +389,22 @@ void render_background_star(rafgl_raster_t raster, background_star_t star) {
         star_color = (rafgl_pixel_rgb_t){150, 150, 150};
     }
 
+    int size = FARTHEST_STAR_SIZE;
     if (star.layer == 0) {
-        for (int xi = star.x; xi < star.x + CLOSEST_STAR_SIZE; xi++) {
-            for (int yi = star.y; yi < star.y + CLOSEST_STAR_SIZE; yi++) {
-                if (xi >= RASTER_WIDTH || yi >= RASTER_HEIGHT) {
-                    continue;
-                }
-                pixel_at_m(raster, xi, yi) = star_color;
-            }
-        }
+        size = CLOSEST_STAR_SIZE;
     } else if (star.layer == 1) {
-        for (int xi = star.x; xi < star.x + MIDDLE_STAR_SIZE; xi++) {
-            for (int yi = star.y; yi < star.y + MIDDLE_STAR_SIZE; yi++) {
-                if (xi >= RASTER_WIDTH || yi >= RASTER_HEIGHT) {
-                    continue;
-                }
-                pixel_at_m(raster, xi, yi) = star_color;
-            }
-        }
-    } else {
-        for (int xi = star.x; xi < star.x + FARTHEST_STAR_SIZE; xi++) {
-            for (int yi = star.y; yi < star.y + FARTHEST_STAR_SIZE; yi++) {
-                if (xi >= RASTER_WIDTH || yi >= RASTER_HEIGHT) {
-                    continue;
-                }
-                pixel_at_m(raster, xi, yi) = star_color;
-            }
+        size = MIDDLE_STAR_SIZE;
+    }
+
+    /// stars never shrink below a pixel, or the far layer would vanish at low resolutions
+    int x = star.x * view_scale;
+    int y = star.y * view_scale;
+    size = rafgl_max_m((int)(size * view_scale + 0.5f), 1);
+
+    for (int yi = y; yi < y + size && yi < raster.height; yi++) {
+        rafgl_pixel_rgb_t *row = rafgl_row_pm(&raster, yi);
+        for (int xi = x; xi < x + size && xi < raster.width; xi++) {
+            row[xi] = star_color;
         }
     }
     //printf("FINISHED PRINTING STAR\n");
@@ -390,8 +425,8 @@ void draw_background_stars(rafgl_raster_t raster) {
 
 void scatter_stars(rafgl_raster_t raster, int num_stars, int layer) {
     for (int i = 0; i < num_stars; i++) {
-        int x = rand() % RASTER_WIDTH;
-        int y = rand() % RASTER_HEIGHT;
+        int x = rand() % world_width;
+        int y = rand() % world_height;
         rafgl_pixel_rgb_t star_color = {255, 255, 255};
 
         background_star_t star = {x, y, layer};
@@ -411,7 +446,7 @@ void scatter_stars(rafgl_raster_t raster, int num_stars, int layer) {
 
 void set_corner_coords(int corner_type, cosmic_body_t *body) {
 
-    int general_diff = RASTER_HEIGHT / 8;
+    int general_diff = world_height / 8;
 
     switch (corner_type) {
         case 1:
@@ -419,16 +454,16 @@ void set_corner_coords(int corner_type, cosmic_body_t *body) {
             body->current_y = general_diff;
             break;
         case 2:
-            body->current_x = RASTER_WIDTH - general_diff;
+            body->current_x = world_width - general_diff;
             body->current_y = general_diff;
             break;
         case 3:
             body->current_x = general_diff;
-            body->current_y = RASTER_HEIGHT - general_diff;
+            body->current_y = world_height - general_diff;
             break;
         case 4:
-            body->current_x = RASTER_WIDTH - general_diff;
-            body->current_y = RASTER_HEIGHT - general_diff;
+            body->current_x = world_width - general_diff;
+            body->current_y = world_height - general_diff;
             break;
     }
 }
@@ -445,6 +480,7 @@ solar_system_t generate_solar_system(int num_planets, int sun_radius, int sun_x,
     solar_system.num_bodies = num_planets + 1;
     solar_system.planets[0] = sun;
 
+    int previous_tag = rafgl_memory_set_tag(rafgl_memory_tag("planet texture"));
     for (int i = 1; i <= num_planets; i++) {
         cosmic_body_t planet;
         planet.orbit_center_x = sun_x;
@@ -462,7 +498,7 @@ solar_system_t generate_solar_system(int num_planets, int sun_radius, int sun_x,
         planet.radius = rand() % 20 + 10;
         planet.is_center = 0;
         planet.is_black_hole = 0;
-        planet.texture = generate_perlin_with_color(3, 0.7);
+        planet.texture = cached_perlin_with_color(world_width, world_height, 3, 0.7, asset_cache_seed());
 
         planet.orbit_speed = ((rand() % 100) / 1000.0) * (1.0 / i);
         planet.orbit_direction = ((rand() + i) % 2) ? 1 : -1;
@@ -473,6 +509,7 @@ solar_system_t generate_solar_system(int num_planets, int sun_radius, int sun_x,
         curr_orbit_radius_x += rand() % 100 + planet.radius + 25;
         curr_orbit_radius_y += rand() % 50 + planet.radius + 15;
     }
+    rafgl_memory_set_tag(previous_tag);
 
     cosmic_body_t black_hole;
     black_hole.is_black_hole = 1;
@@ -488,24 +525,32 @@ solar_system_t generate_solar_system(int num_planets, int sun_radius, int sun_x,
 
     solar_system.next_system_color = (rafgl_pixel_rgb_t){rand() % 255, rand() % 255, rand() % 255};
 
-    for (int i = 0; i < active_smoke_particles; i++) {
-        smoke_particles[i] = (smoke_particle_t){0, 0, 0, 0};
-    }
+    particle_pool_clear(&particle_pool);
 
     return solar_system;
 }
 
+typedef struct {
+    const rafgl_raster_t *background;
+    const int *source_x, *source_y;
+} background_params_t;
+
+KERNEL_INLINE void background_pixel(const background_params_t *p, rafgl_pixel_rgb_t *pixel, int x, int y) {
+    *pixel = pixel_at_pm(p->background, p->source_x[x], p->source_y[y]);
+}
+
+PIXEL_KERNEL(background_kernel, background_params_t, background_pixel, 1)
+
+/// bg_color is not added: the texture is copied as it was sampled
 void set_background(rafgl_raster_t raster, rafgl_raster_t background, rafgl_pixel_rgb_t bg_color) {
-    for (int i = 0; i < RASTER_WIDTH; i++) {
-        for (int j = 0; j < RASTER_HEIGHT; j++) {
-            rafgl_pixel_rgb_t sampled = pixel_at_m(background, i, j);
-            rafgl_pixel_rgb_t result;
-            result.r = rafgl_saturatei(sampled.r + bg_color.r);
-            result.g = rafgl_saturatei(sampled.g + bg_color.g);
-            result.b = rafgl_saturatei(sampled.b + bg_color.b);
-            pixel_at_m(raster, i, j) = pixel_at_m(background, i, j);
-        }
-    }
+    /// the background texture is generated at world size, so it is resampled onto smaller rasters
+    int *source_x = scratch_alloc(&frame_scratch, raster.width * sizeof(int));
+    int *source_y = scratch_alloc(&frame_scratch, raster.height * sizeof(int));
+    for (int i = 0; i < raster.width; i++) source_x[i] = i * background.width / raster.width;
+    for (int j = 0; j < raster.height; j++) source_y[j] = j * background.height / raster.height;
+
+    background_params_t params = {&background, source_x, source_y};
+    background_kernel(&raster, KERNEL_WHOLE(&raster), &params);
 }
 
 void add_stars_to_background(rafgl_raster_t background_raster, int new_stars) {
@@ -551,9 +596,11 @@ void fill_triangle(rafgl_raster_t raster, int x1, int y1, int x2, int y2, int x3
     float m2 = (float)(x3 - x1) / (y3 - y1);
     float m3 = (float)(x3 - x2) / (y3 - y2);
 
+    uint32_t colour = color->rgba;
+
     float startX1 = x1, startX2 = x1;
     for (int y = y1; y <= y2; y++) {
-        rafgl_raster_draw_line(&raster, (int)startX1, y, (int)startX2, y, color);
+        rafgl_raster_draw_span(&raster, (int)startX1, (int)startX2, y, colour);
         startX1 += m1;
         startX2 += m2;
     }
@@ -561,83 +608,87 @@ void fill_triangle(rafgl_raster_t raster, int x1, int y1, int x2, int y2, int x3
     startX1 = x2;
     startX2 = x1;
     for (int y = y2; y <= y3; y++) {
-        rafgl_raster_draw_line(&raster, (int)startX1, y, (int)startX2, y, color);
+        rafgl_raster_draw_span(&raster, (int)startX1, (int)startX2, y, colour);
         startX1 += m3;
         startX2 += m2;
     }
 }
 
-void spawn_smoke_particle(int x, int y, float lifespan, int frame) {
-    if (active_smoke_particles < MAX_SMOKE_PARTICLES) {
-        smoke_particles[active_smoke_particles++] = (smoke_particle_t){x, y, lifespan, frame};
-    }
+void init_particles(rafgl_spritesheet_t smoke_spritesheet) {
+    particle_pool_init(&particle_pool, PARTICLE_POOL_CAPACITY);
+    particle_sprite_init(&smoke_sprite, &smoke_spritesheet);
+
+    particle_emitter_init(&smoke_emitter, &particle_pool, &smoke_sprite, 1, 6, SMOKE_LIFESPAN, MAX_SMOKE_PARTICLES);
+    smoke_emitter.spawn_radius = 5.0;
+    smoke_emitter.jitter = 2.0;
 }
 
-void update_smoke_particles(float delta_time) {
-    for (int i = 0; i < active_smoke_particles; i++) {
-        smoke_particles[i].smoke_lifespan -= delta_time;
-        if (smoke_particles[i].smoke_lifespan <= 0) {
-            smoke_particles[i] = smoke_particles[--active_smoke_particles];
-            i--;
-        }
+void cleanup_particles() {
+    particle_pool_cleanup(&particle_pool);
+    particle_sprite_cleanup(&smoke_sprite);
+}
 
-        smoke_particles[i].pos_x += rand() % 5 - 2;
-        smoke_particles[i].pos_y += rand() % 5 - 2;
-    }
+int smoke_particle_count() {
+    return particle_pool.count;
 }
 
-void draw_particles(rafgl_raster_t raster, rafgl_spritesheet_t spritesheet) {
-    for (int i = 0; i < active_smoke_particles; i++) {
-        smoke_particle_t *particle = &smoke_particles[i];
-        rafgl_raster_draw_spritesheet(&raster, &spritesheet, particle->frame, 1, particle->pos_x, particle->pos_y);
-    }
+int hyper_star_count() {
+    return hyperdrive_starfield.count;
+}
+
+int background_star_count() {
+    return closest_stars_count + middle_stars_count + farthest_stars_count;
 }
 
-void draw_rocket(rafgl_raster_t raster, spaceship *ship, rafgl_spritesheet_t smoke_spritesheet, float delta_time, int moved) {
-    int width = raster.width;
-    int height = raster.height;
+void update_rocket_exhaust(const spaceship *ship, float delta_time, int moved) {
+    if (!show_smoke) return;
 
+    if (moved) {
+        double size = 10.0;
+        float exhaust_x = ship->curr_x - size * cos(ship->angle);
+        float exhaust_y = ship->curr_y - size * sin(ship->angle);
+        particle_emit(&smoke_emitter, exhaust_x, exhaust_y, ship->angle + M_PI, 1);
+    }
+
+    particle_pool_update(&particle_pool, delta_time);
+}
+
+void draw_rocket(display_list_t *list, const spaceship *ship) {
     double size = 10.0;
     double pointiness_factor = 2.5;
     double x1, y1, x2, y2, x3, y3;
 
     double front_size = size * pointiness_factor;
 
-    x2 = ship->curr_x + front_size * cos(ship->angle);
-    y2 = ship->curr_y + front_size * sin(ship->angle);
+    /// the hull is drawn in raster pixels, the exhaust below stays in world units
+    double x = ship->curr_x * view_scale;
+    double y = ship->curr_y * view_scale;
+    double hull_size = size * view_scale;
+    double hull_front_size = front_size * view_scale;
+
+    x2 = x + hull_front_size * cos(ship->angle);
+    y2 = y + hull_front_size * sin(ship->angle);
 
-    x3 = ship->curr_x + size * cos(ship->angle + M_PI / 3);
-    y3 = ship->curr_y + size * sin(ship->angle + M_PI / 3);
+    x3 = x + hull_size * cos(ship->angle + M_PI / 3);
+    y3 = y + hull_size * sin(ship->angle + M_PI / 3);
 
-    x1 = ship->curr_x + size * cos(ship->angle - M_PI / 3);
-    y1 = ship->curr_y + size * sin(ship->angle - M_PI / 3);
+    x1 = x + hull_size * cos(ship->angle - M_PI / 3);
+    y1 = y + hull_size * sin(ship->angle - M_PI / 3);
 
     rafgl_pixel_rgb_t rgb = {255, 255, 255};
 
     //fill_triangle(raster, (int)x1, (int)y1, (int)x2, (int)y2, (int)x3, (int)y3, &rgb);
 
-    rafgl_raster_draw_line(&raster, (int)x1, (int)y1, (int)x2, (int)y2, &rgb);
-    rafgl_raster_draw_line(&raster, (int)x2, (int)y2, (int)x3, (int)y3, &rgb);
-    rafgl_raster_draw_line(&raster, (int)x3, (int)y3, (int)x1, (int)y1, &rgb);
+    rafgl_line_t outline[3] = {
+        {(int)x1, (int)y1, (int)x2, (int)y2, rgb.rgba},
+        {(int)x2, (int)y2, (int)x3, (int)y3, rgb.rgba},
+        {(int)x3, (int)y3, (int)x1, (int)y1, rgb.rgba}
+    };
+    display_list_lines(list, outline, 3);
 
     if (show_smoke) {
         /// Smoke trail
-        int exhaust_x = ship->curr_x - size * cos(ship->angle) + rand() % 10 - 5;
-        int exhaust_y = ship->curr_y - size * sin(ship->angle) + rand() % 10 - 5;
-
-
-        //printf("SHEET WIDTH %d\n", smoke_spritesheet.sheet_width);
-        //int frame = (ship->trail_timer * 10) % (smoke_spritesheet.sheet_width / SMOKE_SPRITE_WIDTH);
-        //rafgl_raster_draw_spritesheet(&raster, &smoke_spritesheet, ship->curr_particle, 1, exhaust_x, exhaust_y);
-        //printf("AFTER PRINT\n");
-
-        if (moved) {
-            int frame = rand() % 6;
-            spawn_smoke_particle(exhaust_x, exhaust_y, 5.0, frame);
-        }
-
-        update_smoke_particles(delta_time);
-        draw_particles(raster, smoke_spritesheet);
+        particle_pool_draw(&particle_pool, list, view_scale);
     }
 }
 
@@ -667,12 +718,12 @@ spaceship init_spaceship(cosmic_body_t black_hole, float angle, float speed, int
 
     /// get sum other corner
     if (black_hole.black_hole_corner == 1) {
-        black_hole_x = RASTER_WIDTH - black_hole_x;
-        black_hole_y = RASTER_HEIGHT - black_hole_y;
+        black_hole_x = world_width - black_hole_x;
+        black_hole_y = world_height - black_hole_y;
     } else if (black_hole.black_hole_corner == 2) {
-        black_hole_y = RASTER_HEIGHT - black_hole_y;
+        black_hole_y = world_height - black_hole_y;
     } else if (black_hole.black_hole_corner == 3) {
-        black_hole_x = RASTER_WIDTH - black_hole_x;
+        black_hole_x = world_width - black_hole_x;
     }
 
     ship.curr_x = black_hole_x;
@@ -686,9 +737,16 @@ spaceship init_spaceship(cosmic_body_t black_hole, float angle, float speed, int
 
 solar_system_t generate_next_solar_system(rafgl_pixel_rgb_t system_color) {
     int num_planets = rand() % 3;
-    int sun_radius = RASTER_HEIGHT / (40 + rand() % 10);
+    int sun_radius = world_height / (40 + rand() % 10);
     sun_color = system_color;
-    return generate_solar_system(num_planets, sun_radius, RASTER_WIDTH / 2, RASTER_HEIGHT / 2);
+    return generate_solar_system(num_planets, sun_radius, world_width / 2, world_height / 2);
+}
+
+void cleanup_solar_system(solar_system_t *solar_system) {
+    /// the sun's texture is never set, rafgl_raster_cleanup leaves it alone
+    for (int i = 0; i < solar_system->num_bodies; i++) {
+        rafgl_raster_cleanup(&solar_system->planets[i].texture);
+    }
 }
 
 void stabilize_rocket(spaceship *rocket, cosmic_body_t black_hole) {
@@ -710,17 +768,17 @@ void stabilize_rocket(spaceship *rocket, cosmic_body_t black_hole) {
     rocket->speed = 0;
 }
 
-void handle_rocket_out_of_bounds(rafgl_raster_t raster, spaceship *rocket, rafgl_spritesheet_t arrows_spritesheet, int rocket_diff_x, int rocket_diff_y) {
+void handle_rocket_out_of_bounds(display_list_t *list, spaceship *rocket, rafgl_spritesheet_t *arrows_spritesheet, int rocket_diff_x, int rocket_diff_y) {
     /// 0 - left, 1 - down, 2 - up, 3 - right
     int rx = rocket->curr_x;
     int ry = rocket->curr_y;
     int arrow_dir = -1;
 
-    if (rx > RASTER_WIDTH)
+    if (rx > world_width)
         arrow_dir = 3;
     else if (rx < 0)
         arrow_dir = 0;
-    else if (ry > RASTER_HEIGHT)
+    else if (ry > world_height)
         arrow_dir = 1;
     else if (ry < 0)
         arrow_dir = 2;
@@ -728,8 +786,8 @@ void handle_rocket_out_of_bounds(rafgl_raster_t raster, spaceship *rocket, rafgl
     int arrow_x;
     int arrow_y;
 
-    float old_dist = rafgl_distance2D(RASTER_WIDTH / 2, RASTER_HEIGHT / 2, rocket_diff_x, rocket_diff_y);
-    float new_dist = rafgl_distance2D(RASTER_WIDTH / 2, RASTER_HEIGHT / 2, rocket->curr_x, rocket->curr_y);
+    float old_dist = rafgl_distance2D(world_width / 2, world_height / 2, rocket_diff_x, rocket_diff_y);
+    float new_dist = rafgl_distance2D(world_width / 2, world_height / 2, rocket->curr_x, rocket->curr_y);
 
     rafgl_pixel_rgb_t arrow_color = {255, 255, 255};
     if (old_dist - new_dist < -1) {
@@ -738,70 +796,87 @@ void handle_rocket_out_of_bounds(rafgl_raster_t raster, spaceship *rocket, rafgl
         arrow_color = (rafgl_pixel_rgb_t) {0, 255, 0};
     }
 
+    /// the arrows are HUD, they keep their sprite size and are clamped to the raster edges
+    rx *= view_scale;
+    ry *= view_scale;
+
     if (arrow_dir != -1) {
         if (arrow_dir == 0) {
             arrow_x = 0;
             arrow_y = ry;
-            if (ry > RASTER_HEIGHT - 64) arrow_y = RASTER_HEIGHT - 64;
+            if (ry > list->height - 64) arrow_y = list->height - 64;
             if (ry < 0) arrow_y = 0;
         } else if (arrow_dir == 1) {
             arrow_x = rx;
-            arrow_y = RASTER_HEIGHT - 64;
-            if (rx > RASTER_WIDTH - 64) arrow_x = RASTER_WIDTH - 64;
+            arrow_y = list->height - 64;
+            if (rx > list->width - 64) arrow_x = list->width - 64;
             if (rx < 0) arrow_x = 0;
         } else if (arrow_dir == 2) {
             arrow_x = rx;
             arrow_y = 0;
-            if (rx > RASTER_WIDTH - 64) arrow_x = RASTER_WIDTH - 64;
+            if (rx > list->width - 64) arrow_x = list->width - 64;
             if (rx < 64) arrow_x = 0;
         } else {
-            arrow_x = RASTER_WIDTH - 64;
+            arrow_x = list->width - 64;
             arrow_y = ry;
-            if (ry > RASTER_HEIGHT - 64) arrow_y = RASTER_HEIGHT - 64;
+            if (ry > list->height - 64) arrow_y = list->height - 64;
             if (ry < 0) arrow_y = 0;
         }
 
-        rafgl_raster_draw_spritesheet_color_insteadof(&raster, &arrows_spritesheet, (rafgl_pixel_rgb_t){136, 155, 162}, arrow_color, arrow_dir, 0, arrow_x, arrow_y);
+        display_list_sprite_recoloured(list, arrows_spritesheet, (rafgl_pixel_rgb_t){136, 155, 162}, arrow_color, arrow_dir, 0, arrow_x, arrow_y);
     }
 }
 
-rafgl_raster_t temp_raster;
+typedef struct {
+    const rafgl_raster_t *source;
+    int cx, cy, radius;
+} fisheye_params_t;
 
-void apply_fisheye_lens(rafgl_raster_t *raster, int cx, int cy, int radius) {
-    rafgl_raster_init(&temp_raster, raster->width, raster->height);
-    memcpy(temp_raster.data, raster->data, raster->width * raster->height * sizeof(rafgl_pixel_rgb_t));
-
-    for (int y = -radius; y <= radius; y++) {
-        for (int x = -radius; x <= radius; x++) {
-            int fx = cx + x;
-            int fy = cy + y;
-
-            if (fx < 0 || fx >= raster->width || fy < 0 || fy >= raster->height)
-                continue;
-
-            float distance = sqrt(x * x + y * y);
-            if (distance > radius)
-                continue;
-
-            float normalized_distance = distance / radius;
-            float angle = atan2(y, x);
-
-            float distorted_distance;
-            if (y < 0) {
-                // pull in
-                distorted_distance = pow(normalized_distance, 0.5);
-            } else {
-                // push out
-                distorted_distance = pow(normalized_distance, 2.0);
-            }
-
-            int source_x = (int)(cx + distorted_distance * radius * cos(angle));
-            int source_y = (int)(cy + distorted_distance * radius * sin(angle));
-
-            if (source_x >= 0 && source_x < raster->width && source_y >= 0 && source_y < raster->height) {
-                raster->data[fy * raster->width + fx] =
-                    temp_raster.data[source_y * raster->width + source_x];
-            }
-        }
+KERNEL_INLINE void fisheye_pixel(const fisheye_params_t *p, rafgl_pixel_rgb_t *pixel, int fx, int fy) {
+    int x = fx - p->cx;
+    int y = fy - p->cy;
+    int radius = p->radius;
+
+    float distance = sqrt(x * x + y * y);
+    if (distance > radius)
+        return;
+
+    float normalized_distance = distance / radius;
+    float angle = atan2(y, x);
+
+    float distorted_distance;
+    if (y < 0) {
+        // pull in
+        distorted_distance = pow(normalized_distance, 0.5);
+    } else {
+        // push out
+        distorted_distance = pow(normalized_distance, 2.0);
+    }
+
+    int source_x = (int)(p->cx + distorted_distance * radius * cos(angle));
+    int source_y = (int)(p->cy + distorted_distance * radius * sin(angle));
+
+    if (source_x >= 0 && source_x < p->source->width && source_y >= 0 && source_y < p->source->height) {
+        *pixel = pixel_at_pm(p->source, source_x, source_y);
     }
 }
+
+PIXEL_KERNEL(fisheye_kernel, fisheye_params_t, fisheye_pixel, 1)
+
+/// Every source pixel lies within the radius of the centre, so the lens works in place on a view of
+/// its own rectangle and only that rectangle is copied aside.
+void apply_fisheye_lens(rafgl_raster_t *raster, int cx, int cy, int radius) {
+    rafgl_raster_t lens, source;
+    rafgl_raster_view(&lens, raster, cx - radius, cy - radius, 2 * radius + 1, 2 * radius + 1);
+    if (lens.width == 0 || lens.height == 0) return;
+
+    scratch_alloc_raster(&frame_scratch, &source, lens.width, lens.height);
+    rafgl_raster_copy_pixels(&source, &lens);
+
+    /// from here on, coordinates are the lens's own
+    cx -= rafgl_max_m(cx - radius, 0);
+    cy -= rafgl_max_m(cy - radius, 0);
+
+    fisheye_params_t params = {&source, cx, cy, radius};
+    fisheye_kernel(&lens, cx - radius, cy - radius, cx + radius + 1, cy + radius + 1, &params);
+}
@@ -0,0 +1,212 @@
+#include <display_list.h>
+#include <parallel.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/// params are copied at this alignment, enough for any of the structs recorded
+#define PARAMS_ALIGNMENT 16
+
+void display_list_init(display_list_t *list) {
+    memset(list, 0, sizeof(display_list_t));
+}
+
+void display_list_cleanup(display_list_t *list) {
+    free(list->commands);
+    free(list->params);
+    free(list->bin_start);
+    free(list->bin_items);
+    free(list->busy_tiles);
+    memset(list, 0, sizeof(display_list_t));
+}
+
+void display_list_begin(display_list_t *list, int width, int height) {
+    list->width = width;
+    list->height = height;
+    list->count = 0;
+    list->params_used = 0;
+}
+
+static display_command_t *record(display_list_t *list, display_draw_fn_t draw, const void *params, size_t params_size, int x0, int y0, int x1, int y1, int flags) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : DISPLAY_LIST_INITIAL;
+        list->commands = realloc(list->commands, list->capacity * sizeof(display_command_t));
+    }
+
+    size_t offset = (list->params_used + PARAMS_ALIGNMENT - 1) & ~(size_t)(PARAMS_ALIGNMENT - 1);
+    if (offset + params_size > list->params_capacity) {
+        list->params_capacity = rafgl_max_m(list->params_capacity * 2, offset + params_size);
+        list->params = realloc(list->params, list->params_capacity);
+    }
+    memcpy(list->params + offset, params, params_size);
+    list->params_used = offset + params_size;
+
+    display_command_t *command = &list->commands[list->count++];
+    command->draw = draw;
+    command->params = offset;
+    command->x0 = x0;
+    command->y0 = y0;
+    command->x1 = x1;
+    command->y1 = y1;
+    command->flags = flags;
+    return command;
+}
+
+void display_list_draw(display_list_t *list, display_draw_fn_t draw, const void *params, size_t params_size, int x0, int y0, int x1, int y1) {
+    x0 = rafgl_max_m(x0, 0);
+    y0 = rafgl_max_m(y0, 0);
+    x1 = rafgl_min_m(x1, list->width);
+    y1 = rafgl_min_m(y1, list->height);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    record(list, draw, params, params_size, x0, y0, x1, y1, 0);
+}
+
+void display_list_barrier(display_list_t *list, display_draw_fn_t draw, const void *params, size_t params_size) {
+    record(list, draw, params, params_size, 0, 0, list->width, list->height, DISPLAY_BARRIER);
+}
+
+static void draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, const void *params) {
+    rafgl_raster_draw_lines_rect(raster, params, 1, x0, y0, x1, y1);
+}
+
+void display_list_lines(display_list_t *list, const rafgl_line_t *lines, int count) {
+    for (int i = 0; i < count; i++) {
+        const rafgl_line_t *line = &lines[i];
+        display_list_draw(list, draw_line, line, sizeof(rafgl_line_t),
+                          rafgl_min_m(line->x0, line->x1), rafgl_min_m(line->y0, line->y1),
+                          rafgl_max_m(line->x0, line->x1) + 1, rafgl_max_m(line->y0, line->y1) + 1);
+    }
+}
+
+typedef struct {
+    rafgl_spritesheet_t *spritesheet;
+    int sheet_x, sheet_y;
+    int x, y;
+    float scale;
+} sprite_params_t;
+
+/// drawn into a view of the rectangle, which clips it without changing which sheet pixel lands where
+static void draw_sprite(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, const void *params) {
+    const sprite_params_t *p = params;
+    rafgl_raster_t clip;
+    rafgl_raster_view(&clip, raster, x0, y0, x1 - x0, y1 - y0);
+    rafgl_raster_draw_spritesheet_scaled(&clip, p->spritesheet, p->sheet_x, p->sheet_y, p->x - x0, p->y - y0, p->scale);
+}
+
+void display_list_sprite(display_list_t *list, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y, float scale) {
+    int width = (int)(spritesheet->frame_width * scale + 0.5f);
+    int height = (int)(spritesheet->frame_height * scale + 0.5f);
+    sprite_params_t params = {spritesheet, sheet_x, sheet_y, x, y, scale};
+    display_list_draw(list, draw_sprite, &params, sizeof(params), x, y, x + width, y + height);
+}
+
+typedef struct {
+    const rafgl_pixel_rgb_t *frame;
+    int frame_width;
+    int x, y;
+} recoloured_params_t;
+
+static void draw_recoloured(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, const void *params) {
+    const recoloured_params_t *p = params;
+    for (int y = y0; y < y1; y++) {
+        const rafgl_pixel_rgb_t *src = p->frame + (y - p->y) * p->frame_width + (x0 - p->x);
+        rafgl_pixel_rgb_t *dst = &pixel_at_pm(raster, x0, y);
+        for (int i = 0; i < x1 - x0; i++) {
+            if (src[i].rgba != RAFGL_COLOUR_KEY.rgba) dst[i] = src[i];
+        }
+    }
+}
+
+void display_list_sprite_recoloured(display_list_t *list, rafgl_spritesheet_t *spritesheet, rafgl_pixel_rgb_t insteadof_color, rafgl_pixel_rgb_t new_color, int sheet_x, int sheet_y, int x, int y) {
+    int width = spritesheet->frame_width, height = spritesheet->frame_height;
+    if (x >= list->width || y >= list->height || x + width <= 0 || y + height <= 0) return;
+
+    recoloured_params_t params = {rafgl_spritesheet_recoloured_frame(spritesheet, insteadof_color, new_color, sheet_x, sheet_y), width, x, y};
+    display_list_draw(list, draw_recoloured, &params, sizeof(params), x, y, x + width, y + height);
+}
+
+/// Bins commands [first, last) and draws them tile by tile. Bins are filled in record
+/// order, so within a tile later commands still land on top.
+static void run_tiles(display_list_t *list, rafgl_raster_t *raster, int first, int last) {
+    if (first == last) return;
+
+    int tiles_x = (list->width + DISPLAY_TILE_SIZE - 1) / DISPLAY_TILE_SIZE;
+    int tiles_y = (list->height + DISPLAY_TILE_SIZE - 1) / DISPLAY_TILE_SIZE;
+    int num_tiles = tiles_x * tiles_y;
+
+    if (list->bin_capacity < num_tiles + 1) {
+        list->bin_capacity = num_tiles + 1;
+        list->bin_start = realloc(list->bin_start, list->bin_capacity * sizeof(int));
+        list->busy_tiles = realloc(list->busy_tiles, list->bin_capacity * sizeof(int));
+    }
+    int *bin_start = list->bin_start;
+    memset(bin_start, 0, (num_tiles + 1) * sizeof(int));
+
+    /// count, prefix sum, then scatter indices into the bins
+    for (int c = first; c < last; c++) {
+        const display_command_t *command = &list->commands[c];
+        for (int ty = command->y0 / DISPLAY_TILE_SIZE; ty <= (command->y1 - 1) / DISPLAY_TILE_SIZE; ty++)
+            for (int tx = command->x0 / DISPLAY_TILE_SIZE; tx <= (command->x1 - 1) / DISPLAY_TILE_SIZE; tx++)
+                bin_start[ty * tiles_x + tx + 1]++;
+    }
+
+    int busy = 0;
+    for (int t = 0; t < num_tiles; t++) {
+        if (bin_start[t + 1]) list->busy_tiles[busy++] = t;
+        bin_start[t + 1] += bin_start[t];
+    }
+
+    int total = bin_start[num_tiles];
+    if (list->item_capacity < total) {
+        list->item_capacity = total * 2;
+        list->bin_items = realloc(list->bin_items, list->item_capacity * sizeof(int));
+    }
+    int *bin_items = list->bin_items;
+
+    for (int c = first; c < last; c++) {
+        const display_command_t *command = &list->commands[c];
+        for (int ty = command->y0 / DISPLAY_TILE_SIZE; ty <= (command->y1 - 1) / DISPLAY_TILE_SIZE; ty++)
+            for (int tx = command->x0 / DISPLAY_TILE_SIZE; tx <= (command->x1 - 1) / DISPLAY_TILE_SIZE; tx++)
+                bin_items[bin_start[ty * tiles_x + tx]++] = c;
+    }
+
+    /// the scatter advanced every start to the next bin's start; shift back by one
+    for (int t = num_tiles; t > 0; t--) {
+        bin_start[t] = bin_start[t - 1];
+    }
+    bin_start[0] = 0;
+
+    const int *busy_tiles = list->busy_tiles;
+    PARALLEL_FOR_DYNAMIC
+    for (int b = 0; b < busy; b++) {
+        int t = busy_tiles[b];
+        int tile_x0 = (t % tiles_x) * DISPLAY_TILE_SIZE;
+        int tile_y0 = (t / tiles_x) * DISPLAY_TILE_SIZE;
+        int tile_x1 = rafgl_min_m(tile_x0 + DISPLAY_TILE_SIZE, list->width);
+        int tile_y1 = rafgl_min_m(tile_y0 + DISPLAY_TILE_SIZE, list->height);
+
+        for (int k = bin_start[t]; k < bin_start[t + 1]; k++) {
+            const display_command_t *command = &list->commands[bin_items[k]];
+            command->draw(raster,
+                          rafgl_max_m(command->x0, tile_x0), rafgl_max_m(command->y0, tile_y0),
+                          rafgl_min_m(command->x1, tile_x1), rafgl_min_m(command->y1, tile_y1),
+                          list->params + command->params);
+        }
+    }
+}
+
+void display_list_execute(display_list_t *list, rafgl_raster_t *raster) {
+    assert(raster->width == list->width && raster->height == list->height && "display list recorded for another raster size");
+
+    int first = 0;
+    for (int c = 0; c < list->count; c++) {
+        const display_command_t *command = &list->commands[c];
+        if (!(command->flags & DISPLAY_BARRIER)) continue;
+
+        run_tiles(list, raster, first, c);
+        command->draw(raster, 0, 0, list->width, list->height, list->params + command->params);
+        first = c + 1;
+    }
+    run_tiles(list, raster, first, list->count);
+}
@@ -0,0 +1,178 @@
+#include <frame_memory.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+raster_pool_t frame_pool;
+scratch_arena_t frame_scratch;
+
+/// sits in front of every pooled buffer, so a release only needs the pointer
+struct _pool_block_t {
+    pool_block_t *next;
+    int size_class;
+    int borrowed;
+    unsigned char padding[FRAME_MEMORY_ALIGNMENT - sizeof(pool_block_t *) - 2 * sizeof(int)];
+};
+
+struct _scratch_chunk_t {
+    scratch_chunk_t *next;
+    size_t bytes;
+    unsigned char padding[FRAME_MEMORY_ALIGNMENT - sizeof(scratch_chunk_t *) - sizeof(size_t)];
+};
+
+/// the pool and the arena show up in rafgl's memory report as one subsystem
+static void track(int64_t bytes) {
+    rafgl_memory_track(rafgl_memory_tag("scratch"), bytes);
+}
+
+static int size_class(size_t bytes) {
+    int c = FRAME_POOL_MIN_CLASS;
+    while (((size_t)1 << c) < bytes) c++;
+    return c - FRAME_POOL_MIN_CLASS;
+}
+
+void *raster_pool_acquire(raster_pool_t *pool, size_t bytes) {
+    int c = size_class(bytes);
+    assert(c < FRAME_POOL_CLASSES);
+
+    pool_block_t *block = pool->free_lists[c];
+    if (block) {
+        pool->free_lists[c] = block->next;
+        pool->retained_bytes -= (size_t)1 << (c + FRAME_POOL_MIN_CLASS);
+        pool->hits += 1;
+    } else {
+        block = rafgl_aligned_alloc(FRAME_MEMORY_ALIGNMENT, sizeof(pool_block_t) + ((size_t)1 << (c + FRAME_POOL_MIN_CLASS)));
+        block->size_class = c;
+        pool->misses += 1;
+        track((int64_t)1 << (c + FRAME_POOL_MIN_CLASS));
+    }
+
+    block->next = NULL;
+    block->borrowed = 1;
+    pool->outstanding += 1;
+    return block + 1;
+}
+
+void raster_pool_release(raster_pool_t *pool, void *buffer) {
+    if (!buffer) return;
+
+    pool_block_t *block = (pool_block_t *)buffer - 1;
+    assert(block->borrowed && "released a buffer that is not borrowed from this pool");
+    int c = block->size_class;
+    size_t bytes = (size_t)1 << (c + FRAME_POOL_MIN_CLASS);
+
+    block->borrowed = 0;
+    pool->outstanding -= 1;
+
+    if (pool->retained_bytes + bytes > FRAME_POOL_MAX_RETAINED) {
+        track(-(int64_t)bytes);
+        rafgl_aligned_free(block);
+        return;
+    }
+
+    block->next = pool->free_lists[c];
+    pool->free_lists[c] = block;
+    pool->retained_bytes += bytes;
+}
+
+/// borrowed rasters are tightly packed and never go through rafgl_raster_cleanup
+static void borrowed_raster(rafgl_raster_t *raster, void *data, int width, int height) {
+    memset(raster, 0, sizeof(rafgl_raster_t));
+    raster->width = width;
+    raster->height = height;
+    raster->stride = width;
+    raster->data = data;
+}
+
+void raster_pool_acquire_raster(raster_pool_t *pool, rafgl_raster_t *raster, int width, int height) {
+    borrowed_raster(raster, raster_pool_acquire(pool, (size_t)width * height * sizeof(rafgl_pixel_rgb_t)), width, height);
+}
+
+void raster_pool_release_raster(raster_pool_t *pool, rafgl_raster_t *raster) {
+    raster_pool_release(pool, raster->data);
+    raster->data = NULL;
+    raster->width = 0;
+    raster->height = 0;
+}
+
+void raster_pool_cleanup(raster_pool_t *pool) {
+    for (int c = 0; c < FRAME_POOL_CLASSES; c++) {
+        while (pool->free_lists[c]) {
+            pool_block_t *next = pool->free_lists[c]->next;
+            track(-((int64_t)1 << (c + FRAME_POOL_MIN_CLASS)));
+            rafgl_aligned_free(pool->free_lists[c]);
+            pool->free_lists[c] = next;
+        }
+    }
+    pool->retained_bytes = 0;
+}
+
+void scratch_init(scratch_arena_t *arena, size_t capacity) {
+    capacity = (capacity + FRAME_MEMORY_ALIGNMENT - 1) & ~(size_t)(FRAME_MEMORY_ALIGNMENT - 1);
+    arena->base = capacity ? rafgl_aligned_alloc(FRAME_MEMORY_ALIGNMENT, capacity) : NULL;
+    if (capacity) track(capacity);
+    arena->capacity = capacity;
+    arena->used = 0;
+    arena->high_water = 0;
+    arena->overflow = NULL;
+}
+
+void *scratch_alloc(scratch_arena_t *arena, size_t bytes) {
+    bytes = (bytes + FRAME_MEMORY_ALIGNMENT - 1) & ~(size_t)(FRAME_MEMORY_ALIGNMENT - 1);
+    arena->used += bytes;
+    if (arena->used > arena->high_water) arena->high_water = arena->used;
+
+    if (arena->used <= arena->capacity) {
+        return arena->base + arena->used - bytes;
+    }
+
+    /// past capacity: serve it on the side this frame, the next reset makes room for it
+    scratch_chunk_t *chunk = rafgl_aligned_alloc(FRAME_MEMORY_ALIGNMENT, sizeof(scratch_chunk_t) + bytes);
+    chunk->bytes = bytes;
+    track(bytes);
+    chunk->next = arena->overflow;
+    arena->overflow = chunk;
+    return chunk + 1;
+}
+
+void scratch_alloc_raster(scratch_arena_t *arena, rafgl_raster_t *raster, int width, int height) {
+    borrowed_raster(raster, scratch_alloc(arena, (size_t)width * height * sizeof(rafgl_pixel_rgb_t)), width, height);
+}
+
+void scratch_reset(scratch_arena_t *arena) {
+    while (arena->overflow) {
+        scratch_chunk_t *next = arena->overflow->next;
+        track(-(int64_t)arena->overflow->bytes);
+        rafgl_aligned_free(arena->overflow);
+        arena->overflow = next;
+    }
+
+    if (arena->high_water > arena->capacity) {
+        if (arena->capacity) track(-(int64_t)arena->capacity);
+        rafgl_aligned_free(arena->base);
+        scratch_init(arena, arena->high_water + arena->high_water / 2);
+    }
+    arena->used = 0;
+}
+
+void scratch_cleanup(scratch_arena_t *arena) {
+    arena->high_water = 0;
+    scratch_reset(arena);
+    if (arena->capacity) track(-(int64_t)arena->capacity);
+    rafgl_aligned_free(arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+}
+
+void frame_memory_begin_frame() {
+    assert(frame_pool.outstanding == 0 && "a pooled buffer was borrowed and never released");
+    scratch_reset(&frame_scratch);
+    if (!frame_scratch.base) scratch_init(&frame_scratch, FRAME_SCRATCH_INITIAL);
+}
+
+void frame_memory_cleanup() {
+    assert(frame_pool.outstanding == 0 && "a pooled buffer was borrowed and never released");
+    raster_pool_cleanup(&frame_pool);
+    scratch_cleanup(&frame_scratch);
+}
@@ -0,0 +1,121 @@
+#include <hud.h>
+#include <stdio.h>
+#include <string.h>
+
+/// glyph size of rafgl's small font
+#define HUD_GLYPH_WIDTH 8
+#define HUD_GLYPH_HEIGHT 16
+#define HUD_PADDING 4
+
+static void format_bytes(char *out, int size, double bytes) {
+    if (bytes >= 1024.0 * 1024.0) snprintf(out, size, "%.1f MB", bytes / (1024.0 * 1024.0));
+    else if (bytes >= 1024.0) snprintf(out, size, "%.1f KB", bytes / 1024.0);
+    else snprintf(out, size, "%.0f B", bytes);
+}
+
+void hud_init(hud_t *hud) {
+    memset(hud, 0, sizeof(hud_t));
+    int previous_tag = rafgl_memory_set_tag(rafgl_memory_tag("hud"));
+    rafgl_raster_init(&hud->raster, HUD_COLUMNS * HUD_GLYPH_WIDTH + 2 * HUD_PADDING, HUD_LINES * HUD_GLYPH_HEIGHT + 2 * HUD_PADDING);
+    rafgl_raster_init(&hud->under, hud->raster.width, hud->raster.height);
+    rafgl_memory_set_tag(previous_tag);
+
+    rafgl_raster_fill(&hud->raster, rafgl_RGB(HUD_BACKGROUND_R, HUD_BACKGROUND_G, HUD_BACKGROUND_B));
+}
+
+void hud_cleanup(hud_t *hud) {
+    rafgl_raster_cleanup(&hud->raster);
+    rafgl_raster_cleanup(&hud->under);
+}
+
+static void redraw_line(hud_t *hud, int line) {
+    uint32_t background = rafgl_RGB(HUD_BACKGROUND_R, HUD_BACKGROUND_G, HUD_BACKGROUND_B);
+    int y0 = HUD_PADDING + line * HUD_GLYPH_HEIGHT;
+
+    for (int y = y0; y < y0 + HUD_GLYPH_HEIGHT; y++) {
+        rafgl_pixel_rgb_t *row = &pixel_at_m(hud->raster, 0, y);
+        for (int x = 0; x < hud->raster.width; x++) {
+            row[x].rgba = background;
+        }
+    }
+
+    rafgl_raster_draw_string(&hud->raster, hud->lines[line], HUD_PADDING, y0, rafgl_RGB(HUD_TEXT_R, HUD_TEXT_G, HUD_TEXT_B), RAFGL_FONT_SMALL);
+    hud->redraws += 1;
+}
+
+void hud_update(hud_t *hud, const hud_sample_t *sample, float delta_time) {
+    if (!hud->visible) {
+        /// nothing is kept while hidden, the first frame shown refreshes straight away
+        hud->samples = 0;
+        hud->refresh_timer = HUD_REFRESH_TIME;
+        return;
+    }
+
+    hud_sample_t *sum = &hud->sum;
+    if (hud->samples == 0) {
+        memset(sum, 0, sizeof(hud_sample_t));
+        hud->worst_frame_time = 0.0f;
+    }
+
+    sum->frame_time += sample->frame_time;
+    sum->sim_time += sample->sim_time;
+    sum->draw_time += sample->draw_time;
+    sum->upload_time += sample->upload_time;
+    sum->swap_time += sample->swap_time;
+    sum->sim_steps += sample->sim_steps;
+    sum->allocated_bytes += sample->allocated_bytes;
+    if (sample->frame_time > hud->worst_frame_time) hud->worst_frame_time = sample->frame_time;
+    hud->samples += 1;
+
+    hud->refresh_timer += delta_time;
+    if (hud->refresh_timer < HUD_REFRESH_TIME) return;
+
+    float n = hud->samples;
+    char bytes[10];
+    char lines[HUD_LINES][HUD_COLUMNS + 1];
+    format_bytes(bytes, sizeof(bytes), sum->allocated_bytes / n);
+
+    snprintf(lines[0], sizeof(lines[0]), "FRAME %5.1f MS  MAX %5.1f", sum->frame_time / n * 1e3f, hud->worst_frame_time * 1e3f);
+    snprintf(lines[1], sizeof(lines[1]), "SIM %4.1f DRAW %4.1f UP %4.1f", sum->sim_time / n * 1e3f, sum->draw_time / n * 1e3f, sum->upload_time / n * 1e3f);
+    snprintf(lines[2], sizeof(lines[2]), "SWAP %4.1f  STEPS %.1f", sum->swap_time / n * 1e3f, sum->sim_steps / n);
+    snprintf(lines[3], sizeof(lines[3]), "PARTICLES %d", sample->particles);
+    snprintf(lines[4], sizeof(lines[4]), "STARS %d  HYPER %d", sample->background_stars, sample->hyper_stars);
+    char live[10];
+    format_bytes(live, sizeof(live), sample->live_bytes);
+    snprintf(lines[5], sizeof(lines[5]), "ALLOC %s/F LIVE %s", bytes, live);
+    snprintf(lines[6], sizeof(lines[6]), "QUALITY %d/%d  SCALE %d%%", sample->quality_level, QUALITY_LEVELS - 1, (int)(sample->resolution_scale * 100.0f + 0.5f));
+
+    for (int i = 0; i < HUD_LINES; i++) {
+        if (strcmp(lines[i], hud->lines[i]) != 0) {
+            memcpy(hud->lines[i], lines[i], sizeof(lines[i]));
+            redraw_line(hud, i);
+        }
+    }
+
+    hud->samples = 0;
+    hud->refresh_timer = 0.0f;
+}
+
+void hud_draw(hud_t *hud, rafgl_raster_t *frame) {
+    if (!hud->visible) return;
+
+    int width = rafgl_min_m(hud->raster.width, frame->width);
+    int height = rafgl_min_m(hud->raster.height, frame->height);
+
+    for (int y = 0; y < height; y++) {
+        memcpy(&pixel_at_m(hud->under, 0, y), &pixel_at_pm(frame, 0, y), width * sizeof(rafgl_pixel_rgb_t));
+        memcpy(&pixel_at_pm(frame, 0, y), &pixel_at_m(hud->raster, 0, y), width * sizeof(rafgl_pixel_rgb_t));
+    }
+    hud->covered = frame;
+    hud->covered_width = width;
+    hud->covered_height = height;
+}
+
+void hud_erase(hud_t *hud) {
+    if (!hud->covered) return;
+
+    for (int y = 0; y < hud->covered_height; y++) {
+        memcpy(&pixel_at_pm(hud->covered, 0, y), &pixel_at_m(hud->under, 0, y), hud->covered_width * sizeof(rafgl_pixel_rgb_t));
+    }
+    hud->covered = NULL;
+}
@@ -10,21 +10,29 @@
 
 #include <game_constants.h>
 #include <utility.h>
-
-static rafgl_raster_t raster, raster2, perlin_raster, galaxy_texture, background_raster, handbrake_raster, hyper_raster;
+#include <asset_cache.h>
+#include <resolution.h>
+#include <quality.h>
+#include <replay.h>
+#include <hud.h>
+#include <frame_memory.h>
+#include <post_process.h>
+#include <render_graph.h>
+#include <display_list.h>
+
+static rafgl_raster_t raster, perlin_raster, galaxy_texture, handbrake_raster, hyper_raster;
 static rafgl_raster_t raw_background, raw_hyperdrive;
+static rafgl_raster_t display_raster;
 static rafgl_spritesheet_t smoke_spritesheet, black_hole_spritesheet, chars_spritesheet, arrows_spritesheet;
 
-static rafgl_raster_t test_raster;
-
 static rafgl_texture_t texture;
 
 int hole_x = 0;
 int hole_y = 0;
 
-float sun_x = RASTER_WIDTH / 2;
-float sun_y = RASTER_HEIGHT / 2;
-int sun_radius = RASTER_HEIGHT / 40;
+float sun_x;
+float sun_y;
+int sun_radius;
 
 float orange_r = 1.0;
 float orange_g = 0.5;
@@ -44,8 +52,6 @@ spaceship rocket;
 rafgl_pixel_rgb_t color_white = {255, 255, 255};
 rafgl_pixel_rgb_t color_sun = {255, 255, 0};
 
-rafgl_raster_t vignetted_raster;
-
 /// GENERAL SETTINGS
 float distortion_duration = 2.0;
 float distortion_timer = 0.0;
@@ -55,42 +61,290 @@ float whiteout_duration = 2.0;
 float whiteout_timer = 0.0;
 int whiteout_active = 0;
 
+int show_hyperdrive = 0;
+float hyperdrive_timer = 0;
+
+camera_shake_t hyperdrive_shake;
+
+int num_planets = 5;
+
+/// SIMULATION
+sim_clock_t sim_clock;
+static spaceship previous_rocket;           /// state one step back, presentation interpolates towards the current one
+static solar_system_t previous_system;
+
+/// REPLAY
+static replay_t replay;
+static const char *record_path = NULL;
+static int replay_ended = 0;
+
+/// PERFORMANCE HUD
+static hud_t hud;
+static float hud_delta_time;
+static double sim_time, draw_time;
+static uint64_t allocated_before;
+static int over_memory_budget = 0;
+static int frame_steps;
+
+/// RENDER GRAPH
+/// one graph per mode, built with the world; present() picks one and fills in the view for its passes
+static render_graph_t normal_graph, distortion_graph, hyperdrive_graph, game_over_graph;
+static render_graph_t *frame_graph = NULL;
+static struct {
+    spaceship rocket;
+    solar_system_t system;
+    post_stack_t post;
+    int blur_radius;
+    float zoom;                     /// black hole zoom blur, 0 - off
+    int zoom_x, zoom_y;
+    int radial_blur_passes;
+    int bloom_levels;
+    int steps;
+    float delta_time;
+} view;
+static display_list_t draw_list;    /// recorded and executed within one pass; the passes share it, so those are serial
+
+/// FRAME BUDGET
+resolution_controller_t resolution;
+quality_governor_t quality;
+static double frame_start = 0.0;
+
 /// FPS CONTROL CENTER
-int hot_vignette = 1;   /// TURN ON/OFF SUN PROXIMITY VIGNETTE
-int smoke_effects = 1;  /// 0 - NO SMOKE; 1 - SMOKE
-int num_planets = 5;    /// 0,1,2 - OK;   3,4... - SHITS THE BED
+int quality_governor = 1;       /// STEP EFFECTS DOWN THE QUALITY LADDER (quality.c) WHEN FRAMES RUN OVER BUDGET
+int print_quality_stats = 0;    /// PRINT THE GOVERNOR'S DECISIONS ON EXIT
+float frame_stats_interval = 0; /// LOG FRAME TIME PERCENTILES AND STUTTERS EVERY N SECONDS, 0 - OFF
+int print_frame_stats = 1;      /// LOG FRAME TIME PERCENTILES AND THE LATEST STUTTERS ON EXIT
+int show_hud = 0;               /// PERFORMANCE OVERLAY, TOGGLED WITH H
+int print_memory_stats = 0;     /// PRINT RASTER MEMORY PER SUBSYSTEM ON EXIT; LEAKS AND A BLOWN MEMORY_BUDGET ARE ALWAYS PRINTED
+int print_render_graphs = 0;    /// PRINT EVERY MODE'S RENDER GRAPH ONCE IT IS BUILT
+int blur_resolution_shift = 1;  /// BLURS RUN AT 1/2 (1) OR 1/4 (2) RESOLUTION AND ARE STRETCHED BACK, 0 - FULL RESOLUTION
+int bloom_levels = BLOOM_MAX_LEVELS;  /// GLOW PYRAMID DEPTH, EACH LEVEL SPREADS IT TWICE AS FAR; THE QUALITY LADDER CAN ONLY LOWER IT, 0 - OFF
+int hyper_stars = HYPER_STAR_COUNT;   /// HYPERDRIVE STARS AT FULL QUALITY, UP TO MAX_HYPER_STARS
+int dynamic_resolution = 1;     /// RENDER THE WORLD SMALLER ONCE THE QUALITY LADDER IS EXHAUSTED
+int upscale_on_cpu = 0;         /// 0 - THE GPU STRETCHES THE SMALLER FRAME; 1 - UPSAMPLE TO WINDOW SIZE BEFORE UPLOAD
+double sim_step = SIM_STEP;     /// SECONDS OF GAMEPLAY PER SIMULATION STEP, INDEPENDENT OF THE FRAME RATE
+int texture_variants = ASSET_CACHE_VARIANTS;  /// DISTINCT GALAXIES AND PLANETS TO PICK FROM, KEPT IN cache/ SO RELAUNCHES SKIP GENERATING THEM; MORE NEEDS A BIGGER ASSET_CACHE_MAX_BYTES, 0 - NEW EVERY TIME
 
 int systems_visited = 0;
 
 int last_rocket_x = 0;
 int last_rocket_y = 0;
 
-void main_state_init(GLFWwindow *window, void *args, int width, int height) {
+/// Reallocates every world-sized raster at the controller's internal resolution, with rows
+/// aligned for the row kernels. The background is resampled from the galaxy texture and
+/// hyperdrive trails start over.
+static void resize_render_targets(int width, int height) {
+    rafgl_raster_t *targets[] = {&raster, &raw_background, &hyper_raster, &raw_hyperdrive};
+
+    int previous_tag = rafgl_memory_set_tag(rafgl_memory_tag("render target"));
+    for (int i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        rafgl_raster_cleanup(targets[i]);
+        rafgl_raster_init_aligned(targets[i], width, height);
+    }
+    rafgl_memory_set_tag(previous_tag);
+    render_graph_resize(width, height);
+
+    set_view(raster_width, raster_height, (float)width / raster_width);
+    set_background(raw_background, galaxy_texture, sky_color);
+}
+
+static void apply_quality(const quality_level_t *level) {
+    set_render_quality(level);
+    set_hyper_star_count(hyper_stars * level->hyper_star_fraction);
+}
+
+/// Effects are traded away before resolution: the scale only drops once the ladder
+/// is at its last rung, and the ladder only climbs back once the scale is full again.
+static void update_frame_budget(float frame_time) {
+    resolution.enabled = dynamic_resolution && (!quality_governor || quality_is_lowest(&quality) || resolution.scale < resolution.max_scale);
+    quality.enabled = quality_governor && resolution.scale >= resolution.max_scale;
+
+    resolution_update(&resolution, frame_time);
+    if (quality_update(&quality, frame_time)) {
+        apply_quality(quality_current(&quality));
+    }
+}
+
+static void sky_pass(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes) {
+    rafgl_raster_copy_pixels(writes[0], reads[0]);
+    add_stars_to_background(*writes[0], 0);
+}
+
+static void draw_world(rafgl_raster_t *frame, int with_rocket) {
+    display_list_begin(&draw_list, frame->width, frame->height);
+    render_planets(&draw_list, &black_hole_spritesheet, &view.system);
+    if (with_rocket) {
+        draw_rocket(&draw_list, &view.rocket);
+    }
+    display_list_execute(&draw_list, frame);
+}
+
+static void world_pass(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes) {
+    draw_world(writes[0], 0);
+}
+
+static void world_rocket_pass(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes) {
+    draw_world(writes[0], 1);
+}
+
+static void post_pass(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes) {
+    post_stack_apply(&view.post, writes[0], writes[1]);
+}
+
+/// the radius shrinks with the copy, so the blur covers as much of the screen
+static void blur_pass(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes) {
+    reduced_raster_t reduced;
+    reduced_raster_begin(&reduced, writes[0], blur_resolution_shift);
+    apply_gaussian_blur(reduced.raster, rafgl_max_m(view.blur_radius >> blur_resolution_shift, 1));
+    reduced_raster_end(&reduced, writes[0]);
+}
+
+/// streaks the world into the black hole while the rocket falls in
+static void zoom_pass(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes) {
+    if (view.zoom <= 0.0f) return;
+
+    reduced_raster_t reduced;
+    reduced_raster_begin(&reduced, writes[0], blur_resolution_shift);
+    apply_radial_blur(reduced.raster, view.zoom_x >> reduced.shift, view.zoom_y >> reduced.shift, view.zoom, view.radial_blur_passes);
+    reduced_raster_end(&reduced, writes[0]);
+}
+
+static void bloom_pass(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes) {
+    apply_bloom(*writes[0], view.bloom_levels, BLOOM_STRENGTH);
+}
+
+static void arrows_pass(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes) {
+    display_list_begin(&draw_list, writes[0]->width, writes[0]->height);
+    handle_rocket_out_of_bounds(&draw_list, &view.rocket, &arrows_spritesheet, last_rocket_x, last_rocket_y);
+    display_list_execute(&draw_list, writes[0]);
+}
+
+static void hyper_stars_pass(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes) {
+    if (view.steps > 0) {
+        /// trails fade once per step, so a frame that covers several steps fades them as often
+        int trail_decay = 256.0 * pow(HYPER_TRAIL_DECAY / 256.0, view.steps);
+        render_hyperdrive_stars(writes[0], solar_system.next_system_color, trail_decay);
+    }
+}
+
+static void hyper_rocket_pass(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes) {
+    rafgl_raster_copy_pixels(writes[0], reads[0]);
+    draw_hyperspeed_rocket(writes[0], writes[0]->width, writes[0]->height, view.delta_time);
+}
+
+/// shake the composed layer as a whole, the stars and rocket underneath stay put
+static void shake_pass(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes) {
+    camera_shake_update(&hyperdrive_shake, view.delta_time);
+    camera_shake_apply(&hyperdrive_shake, writes[0], reads[0], rafgl_RGB(0, 0, 0));
+}
+
+static void hyper_whiteout_pass(rafgl_raster_t *const *reads, rafgl_raster_t *const *writes) {
+    if (hyperdrive_timer > 4.0) {
+        apply_whiteout(*writes[0], whiteout_timer, whiteout_duration);
+    }
+}
+
+static int add_pass(render_graph_t *graph, const char *name, render_pass_fn_t run, int flags, int read, int write) {
+    int pass = render_graph_pass(graph, name, run, flags);
+    if (read >= 0) render_graph_read(graph, pass, read);
+    render_graph_write(graph, pass, write);
+    return pass;
+}
+
+/// The world as the normal, distortion and game over modes draw it; only the rocket
+/// and the blurs differ between them.
+static void build_world_graph(render_graph_t *graph, const char *name, int with_rocket, int with_zoom, int with_blur) {
+    render_graph_init(graph, name);
+    int background = render_graph_import(graph, "background", &raw_background);
+    int frame = render_graph_import(graph, "frame", &raster);
+    int spare = render_graph_transient(graph, "post spare");
+
+    add_pass(graph, "sky", sky_pass, 0, background, frame);
+    /// past the sky every pass borrows from frame_pool or frame_scratch or records into
+    /// draw_list, none of which is thread safe; the sun's surface also draws from rand()
+    add_pass(graph, "world", with_rocket ? world_rocket_pass : world_pass, RENDER_PASS_SERIAL, frame, frame);
+    if (with_zoom) {
+        add_pass(graph, "zoom", zoom_pass, RENDER_PASS_SERIAL, frame, frame);
+    }
+    /// before the post effects, so the vignette darkens the glow with the rest
+    add_pass(graph, "bloom", bloom_pass, RENDER_PASS_SERIAL, frame, frame);
+    int post = add_pass(graph, "post", post_pass, RENDER_PASS_SERIAL, frame, frame);
+    render_graph_write(graph, post, spare);
+    if (with_blur) {
+        add_pass(graph, "blur", blur_pass, RENDER_PASS_SERIAL, frame, frame);
+    }
+    add_pass(graph, "arrows", arrows_pass, RENDER_PASS_SERIAL, frame, frame);
+
+    render_graph_compile(graph, frame);
+}
+
+static void build_render_graphs() {
+    build_world_graph(&normal_graph, "normal", 1, 0, 0);
+    build_world_graph(&distortion_graph, "distortion", 0, 1, 0);
+    build_world_graph(&game_over_graph, "game over", 1, 0, 1);
+
+    render_graph_t *graph = &hyperdrive_graph;
+    render_graph_init(graph, "hyperdrive");
+    int trails = render_graph_import(graph, "trails", &raw_hyperdrive);
+    int layer = render_graph_transient(graph, "hyperdrive layer");
+    int frame = render_graph_import(graph, "hyperdrive frame", &hyper_raster);
+
+    add_pass(graph, "stars", hyper_stars_pass, 0, trails, trails);
+    add_pass(graph, "rocket", hyper_rocket_pass, 0, trails, layer);
+    /// the shake draws from rand()
+    add_pass(graph, "shake", shake_pass, RENDER_PASS_SERIAL, layer, frame);
+    /// on the frame, the trails would feed their own glow back in; its pyramid comes from frame_pool
+    add_pass(graph, "bloom", bloom_pass, RENDER_PASS_SERIAL, frame, frame);
+    add_pass(graph, "whiteout", hyper_whiteout_pass, 0, frame, frame);
+    render_graph_compile(graph, frame);
+
+    if (print_render_graphs) {
+        render_graph_t *graphs[] = {&normal_graph, &distortion_graph, &hyperdrive_graph, &game_over_graph};
+        for (int i = 0; i < sizeof(graphs) / sizeof(graphs[0]); i++) {
+            render_graph_dump(graphs[i], stdout);
+        }
+    }
+}
+
+/// Everything the game needs except the window, so the simulation can also run headless.
+static void init_world(int width, int height, unsigned int seed) {
     raster_width = width;
     raster_height = height;
-    srand(time(NULL));
+    srand(seed);
+
+    /// the world is measured in window pixels
+    sun_x = raster_width / 2;
+    sun_y = raster_height / 2;
+    sun_radius = raster_height / 40;
+    set_view(raster_width, raster_height, 1.0f);
+    resolution_init(&resolution, raster_width, raster_height, TARGET_FPS, dynamic_resolution);
+    quality_init(&quality, FRAME_BUDGET / TARGET_FPS, quality_governor);
 
     sky_color = (rafgl_pixel_rgb_t){3, 4, 15};
 
     /// RASTER INITS
-    rafgl_raster_init(&raster, raster_width, raster_height);
-    rafgl_raster_init(&raster2, raster_width, raster_height);
-    rafgl_raster_init(&vignetted_raster, raster_width, raster_height);
-    rafgl_raster_init(&background_raster, raster_width, raster_height);
-    rafgl_raster_init(&test_raster, raster_width, raster_height);
-    rafgl_raster_init(&hyper_raster, raster_width, raster_height);
-    rafgl_raster_init(&raw_background, raster_width, raster_height);
-    rafgl_raster_init(&raw_hyperdrive, raster_width, raster_height);
+    int previous_tag = rafgl_memory_set_tag(rafgl_memory_tag("render target"));
+    rafgl_raster_init_aligned(&raster, raster_width, raster_height);
+    rafgl_raster_init_aligned(&hyper_raster, raster_width, raster_height);
+    rafgl_raster_init_aligned(&raw_background, raster_width, raster_height);
+    rafgl_raster_init_aligned(&raw_hyperdrive, raster_width, raster_height);
+    render_graph_resize(raster_width, raster_height);
+
+    rafgl_memory_set_tag(rafgl_memory_tag("spritesheet"));
     rafgl_raster_load_from_image(&handbrake_raster, "res/images/handbrake.jpeg");
-
     rafgl_spritesheet_init(&smoke_spritesheet, "res/images/plumeplume.png", 6, 5);
     rafgl_spritesheet_init(&black_hole_spritesheet, "res/images/black_hole_spritesheet.png", 8, 8);
     rafgl_spritesheet_init(&chars_spritesheet, "res/fonts/chars-large.png", 16, 6);
     rafgl_spritesheet_init(&arrows_spritesheet, "res/images/arrows.png", 4, 1);
+    rafgl_spritesheet_compile(&black_hole_spritesheet);
+    rafgl_spritesheet_compile(&arrows_spritesheet);
 
     /// GALAXY TEXTURE
-    perlin_raster = generate_perlin(8, 0.7);
-    galaxy_texture = generate_galaxy_texture(raster_width, raster_height, 4, 0.05, sky_color);
+    rafgl_memory_set_tag(rafgl_memory_tag("background"));
+    asset_cache_init(ASSET_CACHE_DIR, ASSET_CACHE_MAX_BYTES, texture_variants);
+    perlin_raster = cached_perlin(8, 0.7, asset_cache_seed());
+    galaxy_texture = cached_galaxy_texture(raster_width, raster_height, 4, 0.05, sky_color, asset_cache_seed());
+    rafgl_memory_set_tag(previous_tag);
 
     solar_system = generate_solar_system(num_planets, sun_radius, sun_x, sun_y);
 
@@ -99,10 +353,8 @@ void main_state_init(GLFWwindow *window, void *args, int width, int height) {
     black_hole_g = solar_system.next_system_color.g / 255.0;
     black_hole_b = solar_system.next_system_color.b / 255.0;
 
-    glfwSwapInterval(1);
-    rafgl_texture_init(&texture);
-
-    init_stars();
+    init_stars(hyper_stars);
+    camera_shake_init(&hyperdrive_shake, HYPER_SHAKE_GROWTH, HYPER_SHAKE_MAX);
 
     // for (int i = 0; i < RASTER_WIDTH; i++) {
     //     for (int j = 0; j < RASTER_HEIGHT; j++) {
@@ -112,11 +364,12 @@ void main_state_init(GLFWwindow *window, void *args, int width, int height) {
 
     /// ROCKET
     rocket = init_spaceship(solar_system.black_hole, 0.0, 0., 10);
-    link_rocket(&rocket, smoke_effects);
+    link_rocket(&rocket, quality_current(&quality)->particle_cap > 0);
+    init_particles(smoke_spritesheet);
+    apply_quality(quality_current(&quality));
 
     set_background(raw_background, galaxy_texture, sky_color);
-    memcpy(background_raster.data, raw_background.data, raster.width * raster.height * sizeof(rafgl_pixel_rgb_t));
-    add_stars_to_background(background_raster, 1);
+    add_stars_to_background(raster, 1);
 
     for (int i = 0; i < solar_system.num_bodies; i++) {
         draw_ellipse(raster, solar_system.planets[i].orbit_center_x,
@@ -125,130 +378,109 @@ void main_state_init(GLFWwindow *window, void *args, int width, int height) {
             solar_system.planets[i].orbit_radius_y,
             color_white);
     }
+
+    sim_clock_init(&sim_clock, sim_step, SIM_MAX_STEPS_PER_FRAME);
+    previous_rocket = rocket;
+    previous_system = solar_system;
+
+    build_render_graphs();
+}
+
+void main_state_init(GLFWwindow *window, void *args, int width, int height) {
+    unsigned int seed = replay.file ? replay.header.seed : time(NULL);
+
+    if (record_path && !replay_record(&replay, record_path, seed, width, height, sim_step)) {
+        printf("REPLAY: can't write %s, not recording\n", record_path);
+    }
+    init_world(width, height, seed);
+
+    glfwSwapInterval(1);
+    rafgl_texture_init(&texture);
+    rafgl_log_frame_stats(frame_stats_interval, print_frame_stats);
+    hud_init(&hud);
+    display_list_init(&draw_list);
+
+    rafgl_memory_stats_t memory;
+    rafgl_memory_stats(RAFGL_MEMORY_ALL, &memory);
+    allocated_before = memory.allocated_bytes;
 }
 
 int pressed;
 float location = 0;
 float selector = 0;
 
-int show_hyperdrive = 0;
-float hyperdrive_timer = 0;
-
 int game_over = 0;
 
+/// Controls held during a simulation step; sampled once per frame and repeated for every step in it.
+typedef struct {
+    int thrust, reverse;
+    int left, right;
+    int brake;
+} sim_input_t;
+
+static sim_input_t sample_input(rafgl_game_data_t *game_data) {
+    sim_input_t input;
+    input.thrust = game_data->keys_down[GLFW_KEY_W];
+    input.reverse = game_data->keys_down[GLFW_KEY_S];
+    input.left = game_data->keys_down[GLFW_KEY_A];
+    input.right = game_data->keys_down[GLFW_KEY_D];
+    input.brake = game_data->keys_down[GLFW_KEY_SPACE];
+    return input;
+}
 
-void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *game_data, void *args)
-{
+static void rocket_distances(const spaceship *ship, const solar_system_t *system, float *sun_dist, float *black_hole_dist) {
+    *sun_dist = rafgl_distance2D(system->sun.current_x, system->sun.current_y, ship->curr_x, ship->curr_y);
+    *black_hole_dist = rafgl_distance2D(system->black_hole.current_x + 32, system->black_hole.current_y + 32, ship->curr_x, ship->curr_y);
+}
 
-    if (game_over) {
-        char systems_visited_str[10];
-        sprintf(systems_visited_str, "%d", systems_visited);
-        char game_over_text[50] = "    GAME OVER\nSYSTEMS VISITED: ";
+/// Drops the previous state, so a jump is shown as a jump instead of a slide.
+static void snap_interpolation() {
+    previous_rocket = rocket;
+    previous_system = solar_system;
+}
 
-        strcat(game_over_text, systems_visited_str);
-        rafgl_raster_draw_string(&raster, game_over_text, RASTER_WIDTH / 2 - 280, RASTER_HEIGHT / 2 - 20, (u_int32_t) 255, 20);
-        return;
-    }
+/// One step of gameplay. Nothing here draws, so it runs the same with or without a window.
+static void simulate_step(float dt, sim_input_t input) {
+    previous_rocket = rocket;
+    previous_system = solar_system;
 
-    /* hendluj input */
-    if(game_data->is_lmb_down && game_data->is_rmb_down)
-    {
-        pressed = 1;
-        location = rafgl_clampf(game_data->mouse_pos_y, 0, raster_height - 1);
-        selector = 1.0f * location / raster_height;
-    }
-    else
-    {
-        pressed = 0;
-    }
-    if (game_data->keys_down[GLFW_KEY_SPACE]) {
+    if (input.brake) {
         debug_mode = 0;
         rocket.speed = 0.0;
     } else {
         debug_mode = 1;
     }
 
-    //printf("delta time: %f\n", delta_time);
-    //printf("HERE\n");
-    memcpy(background_raster.data, raw_background.data, raster.width * raster.height * sizeof(rafgl_pixel_rgb_t));
-    //printf("HEREEE\n");
-    add_stars_to_background(background_raster, 0);
-    //printf("AAAAA\n");
-    ///draw_ellipse(raster, sun_x, sun_y, 100, 50, color_white);
-
-    float dist, vignette_factor = 1.5, vignette_scale_factor = 0.5;
-    rafgl_pixel_rgb_t sampled, result;
-    float cx = raster.width / 2;
-    float cy = raster.height / 2;
-
-    float rocket_sun_dist = rafgl_distance2D(solar_system.sun.current_x, solar_system.sun.current_y, rocket.curr_x, rocket.curr_y);
-    float rocket_black_hole_dist = rafgl_distance2D(solar_system.black_hole.current_x + 32, solar_system.black_hole.current_y + 32, rocket.curr_x, rocket.curr_y);
-    int closer_to_sun = 1;
-    int applY_radial_blur = 0;
+    float rocket_sun_dist, rocket_black_hole_dist;
+    rocket_distances(&rocket, &solar_system, &rocket_sun_dist, &rocket_black_hole_dist);
 
     if (rocket_black_hole_dist < 25.0) {
         distortion_active = 1;
-        applY_radial_blur = 1;
     }
 
-    if (rocket_black_hole_dist < rocket_sun_dist) {
-        rocket_sun_dist = rocket_black_hole_dist;
-        closer_to_sun = 0;
-    }
-
-    float r = 750.0 + rocket_sun_dist * vignette_scale_factor;
-
-    float vignette_r, vignette_g, vignette_b;
-
-    float sun_influence = fmax(0.0, 1.0 - rocket_sun_dist / 100.0);
-    float black_hole_influence = fmax(0.0, 1.0 - rocket_black_hole_dist / 100.0);
-
-
-    float total_influence = sun_influence + black_hole_influence;
-    sun_influence /= total_influence;
-    black_hole_influence /= total_influence;
-    float default_influence = 1.0 - (sun_influence + black_hole_influence);
-
-    vignette_r = default_influence * 0.0
-                     + sun_influence * orange_r
-                     + black_hole_influence * black_hole_r;
-    vignette_g = default_influence * 0.0
-                     + sun_influence * orange_g
-                     + black_hole_influence * black_hole_g;
-    vignette_b = default_influence * 0.0
-                     + sun_influence * orange_b
-                     + black_hole_influence * black_hole_b;
-
-    memcpy(raster.data, background_raster.data, raster.width * raster.height * sizeof(rafgl_pixel_rgb_t));
-
-    render_planets(raster, black_hole_spritesheet, &solar_system);
-
+    update_planets(&solar_system, dt);
 
     if (!distortion_active && !whiteout_active) {
         int moved = 0;
-        if (game_data->keys_down[GLFW_KEY_W]) {
-            move_rocket(&rocket, 0.7, 0.0, delta_time);
+        if (input.thrust) {
+            move_rocket(&rocket, 0.7, 0.0, dt);
             moved = 1;
         }
-        if (game_data->keys_down[GLFW_KEY_A]) {
-            move_rocket(&rocket, 0.0, -0.1, delta_time);
+        if (input.left) {
+            move_rocket(&rocket, 0.0, -0.1, dt);
         }
-        if (game_data->keys_down[GLFW_KEY_S]) {
-            move_rocket(&rocket, -0.7, 0.0, delta_time);
+        if (input.reverse) {
+            move_rocket(&rocket, -0.7, 0.0, dt);
             moved = 1;
         }
-        if (game_data->keys_down[GLFW_KEY_D]) {
-            move_rocket(&rocket, 0.0, 0.1, delta_time);
+        if (input.right) {
+            move_rocket(&rocket, 0.0, 0.1, dt);
         }
 
-        move_rocket(&rocket, 0.0, 0.0, delta_time);
-        draw_rocket(raster, &rocket, smoke_spritesheet, delta_time, moved);
-
-        // TODO: Smoothly blend hot and normal vignettes
-        render_proximity_vignette(raster, cx, cy, vignette_factor, rocket_sun_dist, vignette_r, vignette_g, vignette_b, r);
+        move_rocket(&rocket, 0.0, 0.0, dt);
+        update_rocket_exhaust(&rocket, dt, moved);
 
         if (rocket_sun_dist < 25.0) {
-            apply_gaussian_blur(raster, 5);
             game_over = 1;
         }
 
@@ -256,7 +488,6 @@ void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *
             int px = solar_system.planets[k].current_x;
             int py = solar_system.planets[k].current_y;
             if (rafgl_distance2D(px, py, rocket.curr_x, rocket.curr_y) < solar_system.planets[k].radius) {
-                apply_gaussian_blur(raster, 5);
                 game_over = 1;
             }
         }
@@ -267,9 +498,7 @@ void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *
                 whiteout_active = 1;
             }
 
-            if (distortion_timer <= distortion_duration) {
-                apply_screen_distortion(raster, distortion_timer, distortion_duration);
-            } else {
+            if (distortion_timer > distortion_duration) {
                 distortion_timer = 0.0;
                 distortion_active = 0;
 
@@ -289,15 +518,14 @@ void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *
 
                 rocket.curr_x = raster_width - solar_system.black_hole.current_x;
                 rocket.curr_y = raster_height - solar_system.black_hole.current_y;
-
+                snap_interpolation();
             }
-            distortion_timer += delta_time;
+            distortion_timer += dt;
         }
 
         if (whiteout_active) {
-            whiteout_timer += delta_time;
+            whiteout_timer += dt;
             if (whiteout_timer <= whiteout_duration) {
-                apply_whiteout(raster, whiteout_timer, whiteout_duration);
                 if (hyperdrive_timer == 0.0 && whiteout_timer > whiteout_duration / 2.0)
                     show_hyperdrive = 1;
             } else {
@@ -311,49 +539,365 @@ void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *
 
     if (show_hyperdrive) {
         if (hyperdrive_timer > 5.0) {
-            render_stars_with_shaking(&raw_hyperdrive, raster.width, raster.height, delta_time, solar_system.next_system_color, 1);
+            camera_shake_init(&hyperdrive_shake, HYPER_SHAKE_GROWTH, HYPER_SHAKE_MAX);
             printf("ENDED\n");
             show_hyperdrive = 0;
-            galaxy_texture = generate_galaxy_texture(raster_width, raster_height, 4, 0.05, sky_color);
+            int previous_tag = rafgl_memory_set_tag(rafgl_memory_tag("background"));
+            rafgl_raster_cleanup(&galaxy_texture);
+            /// the sky tint was just rolled at random, so this galaxy would only push reusable ones out of the cache
+            asset_key_t galaxy_key = {ASSET_GENERATOR_GALAXY, 4, 0.05, sky_color, raster_width, raster_height, asset_cache_seed()};
+            galaxy_texture = asset_cache_generate(galaxy_key);
+            rafgl_memory_set_tag(previous_tag);
             set_background(raw_background, galaxy_texture, sky_color);
+            cleanup_solar_system(&solar_system);
             solar_system = generate_next_solar_system(solar_system.next_system_color);
+            snap_interpolation();
             systems_visited += 1;
             //hyperdrive_timer = 0.0; // Reset the hyperdrive timer
-            init_stars();
-            rafgl_raster_init(&hyper_raster, raster_width, raster_height);
-            rafgl_raster_init(&raw_hyperdrive, raster_width, raster_height);
+            init_stars(hyper_stars * quality_current(&quality)->hyper_star_fraction);
+            rafgl_raster_fill(&hyper_raster, 0);
+            rafgl_raster_fill(&raw_hyperdrive, 0);
             whiteout_active = 1;
         }
-        update_stars(delta_time, raster.width, raster.height);
-        render_stars_with_shaking(&raw_hyperdrive, raster.width, raster.height, delta_time, solar_system.next_system_color, 0);
-        memcpy(hyper_raster.data, raw_hyperdrive.data, raster.width * raster.height * sizeof(rafgl_pixel_rgb_t));
-        draw_hyperspeed_rocket(&hyper_raster, raster.width, raster.height, delta_time);
-        hyperdrive_timer += delta_time;
+        update_stars(dt, raster.width, raster.height);
+        hyperdrive_timer += dt;
         if (hyperdrive_timer > 4.0) {
-            whiteout_timer += delta_time;
-            apply_whiteout(hyper_raster, whiteout_timer, whiteout_duration);
+            whiteout_timer += dt;
         }
     }
 
-    handle_rocket_out_of_bounds(raster, &rocket, arrows_spritesheet, last_rocket_x, last_rocket_y);
-
     move_background_stars();
+}
+
+static float lerpf(float a, float b, float t) {
+    return a + (b - a) * t;
+}
+
+/// Draws the world between the last two simulation steps, alpha of the way to the newer one.
+/// steps is how many steps ran this frame; effects that accumulate per step catch up by that much.
+static void present(float delta_time, float alpha, int steps) {
+    const quality_level_t *level = quality_current(&quality);
+
+    spaceship view_rocket = rocket;
+    view_rocket.curr_x = lerpf(previous_rocket.curr_x, rocket.curr_x, alpha);
+    view_rocket.curr_y = lerpf(previous_rocket.curr_y, rocket.curr_y, alpha);
+    view_rocket.angle = lerpf(previous_rocket.angle, rocket.angle, alpha);
+
+    solar_system_t *view_system = &view.system;
+    *view_system = solar_system;
+    for (int i = 0; i < solar_system.num_bodies; i++) {
+        view_system->planets[i].current_x = lerpf(previous_system.planets[i].current_x, solar_system.planets[i].current_x, alpha);
+        view_system->planets[i].current_y = lerpf(previous_system.planets[i].current_y, solar_system.planets[i].current_y, alpha);
+    }
+
+    //printf("delta time: %f\n", delta_time);
+    ///draw_ellipse(raster, sun_x, sun_y, 100, 50, color_white);
+
+    float dist, vignette_factor = 1.5, vignette_scale_factor = 0.5;
+    rafgl_pixel_rgb_t sampled, result;
+    float cx = raster.width / 2;
+    float cy = raster.height / 2;
+
+    float rocket_sun_dist, rocket_black_hole_dist;
+    rocket_distances(&view_rocket, view_system, &rocket_sun_dist, &rocket_black_hole_dist);
+    int closer_to_sun = 1;
+
+    if (rocket_black_hole_dist < rocket_sun_dist) {
+        rocket_sun_dist = rocket_black_hole_dist;
+        closer_to_sun = 0;
+    }
+
+    float r = (750.0 + rocket_sun_dist * vignette_scale_factor) * resolution.scale;
+
+    float vignette_r, vignette_g, vignette_b;
+
+    float sun_influence = fmax(0.0, 1.0 - rocket_sun_dist / 100.0);
+    float black_hole_influence = fmax(0.0, 1.0 - rocket_black_hole_dist / 100.0);
+
+
+    float total_influence = sun_influence + black_hole_influence;
+    sun_influence /= total_influence;
+    black_hole_influence /= total_influence;
+    float default_influence = 1.0 - (sun_influence + black_hole_influence);
+
+    vignette_r = default_influence * 0.0
+                     + sun_influence * orange_r
+                     + black_hole_influence * black_hole_r;
+    vignette_g = default_influence * 0.0
+                     + sun_influence * orange_g
+                     + black_hole_influence * black_hole_g;
+    vignette_b = default_influence * 0.0
+                     + sun_influence * orange_b
+                     + black_hole_influence * black_hole_b;
+
+    /// the hyperdrive frame replaces the world, so while it is up the world isn't drawn at all
+    if (show_hyperdrive) {
+        frame_graph = &hyperdrive_graph;
+    } else if (game_over) {
+        frame_graph = &game_over_graph;
+    } else if (distortion_active || whiteout_active) {
+        frame_graph = &distortion_graph;
+    } else {
+        frame_graph = &normal_graph;
+    }
+
+    /// the frame's effects go on one stack and are applied in a single pass
+    post_stack_clear(&view.post);
+
+    if (!distortion_active && !whiteout_active) {
+        // TODO: Smoothly blend hot and normal vignettes
+        post_push_vignette(&view.post, cx, cy, vignette_factor, rocket_sun_dist, vignette_r, vignette_g, vignette_b, r, level->vignette_step);
+    } else {
+        if (distortion_active) {
+            post_push_distortion(&view.post, screen_distortion_factor(distortion_timer, distortion_duration), level->distortion_step);
+        }
+
+        if (whiteout_active && whiteout_timer <= whiteout_duration) {
+            post_push_whiteout(&view.post, whiteout_factor(whiteout_timer, whiteout_duration));
+        }
+    }
+
+    view.rocket = view_rocket;
+    view.blur_radius = level->blur_radius;
+    /// the zoom swells and fades with the distortion, centred on the hole the rocket fell into
+    view.zoom = distortion_active ? RADIAL_BLUR_MAX_ZOOM * sin(fminf(distortion_timer / distortion_duration, 1.0f) * M_PI) : 0.0f;
+    view.zoom_x = (view_system->black_hole.current_x + view_system->black_hole.radius) * resolution.scale;
+    view.zoom_y = (view_system->black_hole.current_y + view_system->black_hole.radius) * resolution.scale;
+    view.radial_blur_passes = level->radial_blur_passes;
+    view.bloom_levels = rafgl_min_m(bloom_levels, level->bloom_levels);
+    view.steps = steps;
+    view.delta_time = delta_time;
+    render_graph_execute(frame_graph);
+
+    last_rocket_x = view_rocket.curr_x;
+    last_rocket_y = view_rocket.curr_y;
+}
+
+void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *game_data, void *args)
+{
+    frame_start = glfwGetTime();
+    frame_memory_begin_frame();
+
+    if (replay.file && !replay_ended && !replay_input(&replay, &delta_time, game_data)) {
+        replay_ended = 1;
+        glfwSetWindowShouldClose(window, 1);
+    }
+
+    if (game_data->keys_pressed[GLFW_KEY_H]) {
+        show_hud = !show_hud;
+    }
+    hud.visible = show_hud;
+    hud_delta_time = delta_time;
+    frame_steps = 0;
+
+    if (game_over) {
+        if (raster.width != raster_width || raster.height != raster_height) {
+            /// the last frame stays up for good, so bring it to window size before writing over it
+            rafgl_raster_t full;
+            int previous_tag = rafgl_memory_set_tag(raster.tag);
+            rafgl_raster_init(&full, raster_width, raster_height);
+            rafgl_memory_set_tag(previous_tag);
+            rafgl_raster_bilinear_upsample(&full, &raster);
+            rafgl_raster_cleanup(&raster);
+            raster = full;
+        }
+
+        char systems_visited_str[10];
+        sprintf(systems_visited_str, "%d", systems_visited);
+        char game_over_text[50] = "    GAME OVER\nSYSTEMS VISITED: ";
+
+        strcat(game_over_text, systems_visited_str);
+        rafgl_raster_draw_string(&raster, game_over_text, raster.width / 2 - 280, raster.height / 2 - 20, (u_int32_t) 255, 20);
+        return;
+    }
+
+    if (resolution.width != raster.width || resolution.height != raster.height) {
+        resize_render_targets(resolution.width, resolution.height);
+    }
+
+    /* hendluj input */
+    if(game_data->is_lmb_down && game_data->is_rmb_down)
+    {
+        pressed = 1;
+        location = rafgl_clampf(game_data->mouse_pos_y, 0, raster_height - 1);
+        selector = 1.0f * location / raster_height;
+    }
+    else
+    {
+        pressed = 0;
+    }
+
+    sim_input_t input = sample_input(game_data);
+
+    sim_clock.step = sim_step;
+
+    double sim_start = glfwGetTime();
+    int steps = sim_clock_advance(&sim_clock, delta_time);
+    for (int i = 0; i < steps && !game_over; i++) {
+        simulate_step(sim_clock.step, input);
+    }
+    frame_steps = steps;
 
-    last_rocket_x = rocket.curr_x;
-    last_rocket_y = rocket.curr_y;
+    double draw_start = glfwGetTime();
+    /// the crash frame is shown as it happened, not between two steps
+    present(delta_time, game_over ? 1.0f : sim_clock.alpha, steps);
+
+    sim_time = draw_start - sim_start;
+    draw_time = glfwGetTime() - draw_start;
+}
+
+/// Feeds the HUD this frame's costs; engine-side times are from the frame before, the last one rafgl finished.
+static void sample_hud(double upload_time) {
+    double engine_times[RAFGL_PASS_COUNT];
+    rafgl_frame_last(engine_times);
+
+    rafgl_memory_stats_t memory;
+    rafgl_memory_stats(RAFGL_MEMORY_ALL, &memory);
+
+    hud_sample_t sample;
+    sample.frame_time = engine_times[RAFGL_PASS_TOTAL];
+    sample.sim_time = sim_time;
+    sample.draw_time = draw_time;
+    sample.upload_time = upload_time;
+    sample.swap_time = engine_times[RAFGL_PASS_SWAP];
+    sample.sim_steps = frame_steps;
+    sample.particles = smoke_particle_count();
+    sample.hyper_stars = show_hyperdrive ? hyper_star_count() : 0;
+    sample.background_stars = background_star_count();
+    sample.allocated_bytes = memory.allocated_bytes - allocated_before;
+    sample.live_bytes = memory.live_bytes;
+    sample.quality_level = quality.level;
+    sample.resolution_scale = resolution.scale;
+    allocated_before = memory.allocated_bytes;
+
+    hud_update(&hud, &sample, hud_delta_time);
 }
 
 
 void main_state_render(GLFWwindow *window, void *args) {
-    rafgl_texture_load_from_raster(&texture, !show_hyperdrive ? &raster : &hyper_raster);
+    rafgl_raster_t *frame = frame_graph ? render_graph_output(frame_graph) : &raster;
+
+    /// a frame smaller than the window is stretched by the texture's linear filtering,
+    /// unless a window-sized frame is asked for explicitly
+    if (upscale_on_cpu && (frame->width != raster_width || frame->height != raster_height)) {
+        if (display_raster.width != raster_width || display_raster.height != raster_height) {
+            int previous_tag = rafgl_memory_set_tag(rafgl_memory_tag("render target"));
+            rafgl_raster_cleanup(&display_raster);
+            rafgl_raster_init(&display_raster, raster_width, raster_height);
+            rafgl_memory_set_tag(previous_tag);
+        }
+        rafgl_raster_bilinear_upsample(&display_raster, frame);
+        frame = &display_raster;
+    }
+
+    /// hashed before the HUD goes on, its numbers are timings and never replay the same
+    uint32_t frame_hash = replay.file ? replay_hash_raster(frame) : 0;
+    hud_draw(&hud, frame);
+
+    double upload_start = glfwGetTime();
+    rafgl_texture_load_from_raster(&texture, frame);
+    hud_erase(&hud);
     rafgl_texture_show(&texture, 0);
+
+    float frame_time = glfwGetTime() - frame_start;
+    sample_hud(glfwGetTime() - upload_start);
+
+    if (replay.file && !replay_ended) {
+        replay_end_frame(&replay, &frame_time, frame_hash);
+    }
+    update_frame_budget(frame_time);
+}
+
+void main_state_record_to(const char *path) {
+    record_path = path;
+}
+
+int main_state_replay_from(const char *path, int *width, int *height) {
+    if (!replay_open(&replay, path)) {
+        printf("REPLAY: %s is not a replay\n", path);
+        return 0;
+    }
+
+    *width = replay.header.width;
+    *height = replay.header.height;
+    sim_step = replay.header.sim_step;
+    return 1;
 }
 
 
+int main_state_run_headless(int width, int height, long long steps, unsigned int seed) {
+    init_world(width, height, seed);
+
+    /// no one is at the controls; the planets still move and the run ends like a real one would
+    sim_input_t input = {0};
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    long long step;
+    for (step = 0; step < steps && !game_over; step++) {
+        frame_memory_begin_frame();
+        simulate_step(sim_step, input);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    printf("HEADLESS: %lld steps (%.1f s of gameplay) in %.3f s, %.0f steps/s, %.1fx real time\n",
+           step, step * sim_step, seconds, step / seconds, step * sim_step / seconds);
+    printf("HEADLESS: seed %u, systems visited %d, %s\n", seed, systems_visited, game_over ? "crashed" : "survived");
+
+    main_state_cleanup(NULL, NULL);
+    return game_over ? 1 : over_memory_budget ? 2 : 0;
+}
+
 void main_state_cleanup(GLFWwindow *window, void *args) {
     rafgl_raster_cleanup(&raster);
-    rafgl_raster_cleanup(&raster2);
-    rafgl_raster_cleanup(&vignetted_raster);
-    rafgl_raster_cleanup(&background_raster);
-    rafgl_raster_cleanup(&test_raster);
+    cleanup_particles();
+    cleanup_stars();
+    render_graph_cleanup();
+    rafgl_raster_cleanup(&hyper_raster);
+    rafgl_raster_cleanup(&raw_background);
+    rafgl_raster_cleanup(&raw_hyperdrive);
+    rafgl_raster_cleanup(&display_raster);
+    rafgl_raster_cleanup(&perlin_raster);
+    rafgl_raster_cleanup(&galaxy_texture);
+    rafgl_raster_cleanup(&handbrake_raster);
+    rafgl_spritesheet_cleanup(&smoke_spritesheet);
+    rafgl_spritesheet_cleanup(&black_hole_spritesheet);
+    rafgl_spritesheet_cleanup(&chars_spritesheet);
+    rafgl_spritesheet_cleanup(&arrows_spritesheet);
+    cleanup_solar_system(&solar_system);
+    hud_cleanup(&hud);
+    display_list_cleanup(&draw_list);
+    frame_memory_cleanup();
+
+    if (print_memory_stats) {
+        rafgl_memory_report();
+    }
+
+    int64_t leaked = rafgl_memory_leak_report();
+    if (leaked > 0) {
+        printf("MEMORY: %.2f MB still allocated after cleanup\n", leaked / (1024.0 * 1024.0));
+    }
+
+    rafgl_memory_stats_t memory;
+    rafgl_memory_stats(RAFGL_MEMORY_ALL, &memory);
+    over_memory_budget = memory.peak_bytes > MEMORY_BUDGET;
+    if (over_memory_budget) {
+        printf("MEMORY: peak %.2f MB is over the %.2f MB budget\n", memory.peak_bytes / (1024.0 * 1024.0), MEMORY_BUDGET / (1024.0 * 1024.0));
+    }
+
+    if (print_quality_stats) {
+        quality_print_stats(&quality);
+    }
+
+    if (replay.file && !replay.recording) {
+        if (replay.mismatches == 0) {
+            printf("REPLAY: %lld frames, all identical to the recording\n", replay.frames);
+        } else {
+            printf("REPLAY: %lld frames, %lld differ from the recording, first at frame %lld\n",
+                   replay.frames, replay.mismatches, replay.first_mismatch);
+        }
+    }
+    replay_close(&replay);
 }
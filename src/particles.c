@@ -0,0 +1,241 @@
+#include <particles.h>
+#include <parallel.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static float pool_randf(particle_pool_t *pool) {
+    /// xorshift32
+    uint32_t s = pool->rng;
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    pool->rng = s;
+    return hash_to_unit(s);
+}
+
+void particle_sprite_init(particle_sprite_t *sprite, rafgl_spritesheet_t *sheet) {
+    sprite->width = sheet->sheet.width;
+    sprite->height = sheet->sheet.height;
+    sprite->frame_width = sheet->frame_width;
+    sprite->frame_height = sheet->frame_height;
+    sprite->pixels = malloc(sprite->width * sprite->height * sizeof(rafgl_pixel_rgb_t));
+
+    for (int i = 0; i < sprite->width * sprite->height; i++) {
+        rafgl_pixel_rgb_t pix = sheet->sheet.data[i];
+        if (pix.rgba == RAFGL_COLOUR_KEY.rgba) {
+            pix.rgba = 0;
+        } else {
+            pix.r = (pix.r * pix.a + 127) / 255;
+            pix.g = (pix.g * pix.a + 127) / 255;
+            pix.b = (pix.b * pix.a + 127) / 255;
+        }
+        sprite->pixels[i] = pix;
+    }
+}
+
+void particle_sprite_cleanup(particle_sprite_t *sprite) {
+    free(sprite->pixels);
+    sprite->pixels = NULL;
+}
+
+void particle_pool_init(particle_pool_t *pool, int capacity) {
+    memset(pool, 0, sizeof(particle_pool_t));
+    pool->capacity = capacity;
+    pool->x = malloc(capacity * sizeof(float));
+    pool->y = malloc(capacity * sizeof(float));
+    pool->vx = malloc(capacity * sizeof(float));
+    pool->vy = malloc(capacity * sizeof(float));
+    pool->life = malloc(capacity * sizeof(float));
+    pool->lifespan = malloc(capacity * sizeof(float));
+    pool->jitter = malloc(capacity * sizeof(float));
+    pool->frame = malloc(capacity * sizeof(uint8_t));
+    pool->emitter = malloc(capacity * sizeof(uint8_t));
+    pool->rng = 0x2545F491U ^ (uint32_t)rand();
+    if (!pool->rng) pool->rng = 1;
+}
+
+void particle_pool_cleanup(particle_pool_t *pool) {
+    free(pool->x);
+    free(pool->y);
+    free(pool->vx);
+    free(pool->vy);
+    free(pool->life);
+    free(pool->lifespan);
+    free(pool->jitter);
+    free(pool->frame);
+    free(pool->emitter);
+    memset(pool, 0, sizeof(particle_pool_t));
+}
+
+void particle_pool_clear(particle_pool_t *pool) {
+    pool->count = 0;
+    memset(pool->emitter_alive, 0, sizeof(pool->emitter_alive));
+}
+
+void particle_emitter_init(particle_emitter_t *emitter, particle_pool_t *pool, particle_sprite_t *sprite, int sprite_row, int frame_count, float lifespan, int max_alive) {
+    memset(emitter, 0, sizeof(particle_emitter_t));
+    emitter->pool = pool;
+    emitter->sprite = sprite;
+    emitter->sprite_row = sprite_row;
+    emitter->frame_count = frame_count;
+    emitter->lifespan = lifespan;
+    emitter->max_alive = max_alive;
+
+    emitter->id = pool->num_emitters;
+    if (pool->num_emitters < PARTICLE_MAX_EMITTERS) {
+        pool->emitters[pool->num_emitters++] = emitter;
+    } else {
+        /// out of slots: share the last one rather than writing past the table
+        emitter->id = PARTICLE_MAX_EMITTERS - 1;
+        pool->emitters[emitter->id] = emitter;
+    }
+}
+
+void particle_emit(particle_emitter_t *emitter, float x, float y, float angle, int count) {
+    particle_pool_t *pool = emitter->pool;
+
+    for (int k = 0; k < count; k++) {
+        if (pool->count >= pool->capacity || pool->emitter_alive[emitter->id] >= emitter->max_alive)
+            return;
+
+        int i = pool->count++;
+        pool->emitter_alive[emitter->id]++;
+
+        float direction = angle + (pool_randf(pool) - 0.5f) * emitter->spread;
+        float speed = emitter->speed * (0.5f + pool_randf(pool));
+
+        pool->x[i] = x + (pool_randf(pool) * 2.0f - 1.0f) * emitter->spawn_radius;
+        pool->y[i] = y + (pool_randf(pool) * 2.0f - 1.0f) * emitter->spawn_radius;
+        pool->vx[i] = cosf(direction) * speed;
+        pool->vy[i] = sinf(direction) * speed;
+        pool->life[i] = emitter->lifespan;
+        pool->lifespan[i] = emitter->lifespan;
+        pool->jitter[i] = emitter->jitter;
+        pool->frame[i] = emitter->frame_count > 0 ? (int)(pool_randf(pool) * emitter->frame_count) : 0;
+        pool->emitter[i] = emitter->id;
+    }
+}
+
+void particle_pool_update(particle_pool_t *pool, float delta_time) {
+    int n = pool->count;
+    float *restrict x = pool->x;
+    float *restrict y = pool->y;
+    float *restrict vx = pool->vx;
+    float *restrict vy = pool->vy;
+    float *restrict life = pool->life;
+    float *restrict lifespan = pool->lifespan;
+    float *restrict jitter = pool->jitter;
+    uint8_t *restrict frame = pool->frame;
+    uint8_t *restrict emitter = pool->emitter;
+    uint32_t seed = parallel_hash(pool->tick++) * 2;
+
+    /// integrate: no branches and no calls, so this vectorizes
+    PARALLEL_FOR_IF(n >= PARTICLE_PARALLEL_THRESHOLD)
+    for (int i = 0; i < n; i++) {
+        float jx = hash_to_unit(parallel_hash(seed + 2 * (uint32_t)i)) - 0.5f;
+        float jy = hash_to_unit(parallel_hash(seed + 2 * (uint32_t)i + 1)) - 0.5f;
+        x[i] += vx[i] * delta_time + jx * 2.0f * jitter[i];
+        y[i] += vy[i] * delta_time + jy * 2.0f * jitter[i];
+        life[i] -= delta_time;
+    }
+
+    /// stable compaction: every slot is copied, the write cursor only advances past live ones
+    int w = 0;
+    memset(pool->emitter_alive, 0, sizeof(pool->emitter_alive));
+    for (int i = 0; i < n; i++) {
+        int alive = life[i] > 0.0f;
+        x[w] = x[i];
+        y[w] = y[i];
+        vx[w] = vx[i];
+        vy[w] = vy[i];
+        life[w] = life[i];
+        lifespan[w] = lifespan[i];
+        jitter[w] = jitter[i];
+        frame[w] = frame[i];
+        emitter[w] = emitter[i];
+        pool->emitter_alive[emitter[i]] += alive;
+        w += alive;
+    }
+    pool->count = w;
+}
+
+/// Premultiplied "over": dst = src * alpha + dst * (1 - src.a * alpha).
+/// alpha is the particle opacity in 0..256; everything stays in 16-bit lanes.
+static void blend_span(rafgl_pixel_rgb_t *restrict dst, const rafgl_pixel_rgb_t *restrict src, int n, int alpha) {
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opacity = _mm_set1_epi16(alpha);
+    const __m128i full = _mm_set1_epi16(256);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+
+        __m128i s_lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), opacity), 8);
+        __m128i s_hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), opacity), 8);
+
+        /// broadcast each pixel's alpha lane across its four lanes
+        __m128i a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+        __m128i d_lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(full, a_lo)), 8);
+        __m128i d_hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(full, a_hi)), 8);
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(_mm_add_epi16(s_lo, d_lo), _mm_add_epi16(s_hi, d_hi)));
+    }
+#endif
+
+    for (; i < n; i++) {
+        int sa = (src[i].a * alpha) >> 8;
+        int inverse = 256 - sa;
+        for (int c = 0; c < 4; c++) {
+            int value = ((src[i].components[c] * alpha) >> 8) + ((dst[i].components[c] * inverse) >> 8);
+            dst[i].components[c] = value > 255 ? 255 : value;
+        }
+    }
+}
+
+typedef struct {
+    const rafgl_pixel_rgb_t *frame;     /// top left of the particle's frame in the sprite
+    int pitch;
+    int x, y;
+    int alpha;
+} composite_params_t;
+
+static void composite_particle(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, const void *params) {
+    const composite_params_t *p = params;
+    for (int yi = y0; yi < y1; yi++) {
+        const rafgl_pixel_rgb_t *src = p->frame + (yi - p->y) * p->pitch + (x0 - p->x);
+        blend_span(&pixel_at_pm(raster, x0, yi), src, x1 - x0, p->alpha);
+    }
+}
+
+/// Recorded in pool order, which is spawn order: older puffs end up underneath.
+void particle_pool_draw(particle_pool_t *pool, display_list_t *list, float scale) {
+    for (int i = 0; i < pool->count; i++) {
+        particle_emitter_t *emitter = pool->emitters[pool->emitter[i]];
+        particle_sprite_t *sprite = emitter->sprite;
+
+        /// fades out linearly over the remaining lifespan
+        int alpha = (int)(256.0f * pool->life[i] / pool->lifespan[i]);
+        alpha = rafgl_clampi(alpha, 0, 256);
+        if (alpha == 0) continue;
+
+        int fw = sprite->frame_width;
+        int fh = sprite->frame_height;
+        composite_params_t params;
+        params.frame = sprite->pixels + emitter->sprite_row * fh * sprite->width + pool->frame[i] * fw;
+        params.pitch = sprite->width;
+        params.x = (int)floorf(pool->x[i] * scale);
+        params.y = (int)floorf(pool->y[i] * scale);
+        params.alpha = alpha;
+        display_list_draw(list, composite_particle, &params, sizeof(params), params.x, params.y, params.x + fw, params.y + fh);
+    }
+}
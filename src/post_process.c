@@ -0,0 +1,323 @@
+#include <post_process.h>
+#include <pixel_kernel.h>
+#include <frame_memory.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+void post_stack_clear(post_stack_t *stack) {
+    stack->count = 0;
+    stack->gathers = 0;
+    stack->compiled_width = 0;
+    stack->compiled_height = 0;
+}
+
+static post_effect_t *push(post_stack_t *stack, post_op_t op, post_kind_t kind) {
+    if (stack->count >= POST_MAX_EFFECTS) return NULL;
+
+    post_effect_t *effect = &stack->effects[stack->count++];
+    memset(effect, 0, sizeof(post_effect_t));
+    effect->op = op;
+    effect->kind = kind;
+    stack->compiled_width = 0;
+    stack->compiled_height = 0;
+    return effect;
+}
+
+void post_push_vignette(post_stack_t *stack, int cx, int cy, float vignette_factor, float rocket_sun_dist, float vignette_r, float vignette_g, float vignette_b, float r, int step) {
+    if (step < 1) return;
+
+    post_effect_t *effect = push(stack, POST_VIGNETTE, POST_COLOUR);
+    if (!effect) return;
+
+    post_vignette_t *vignette = &effect->vignette;
+    vignette->cx = cx;
+    vignette->cy = cy;
+    vignette->r = r;
+    vignette->vignette_factor = vignette_factor;
+    vignette->proximity_factor = 1.0 - (rocket_sun_dist / 100.0);
+    vignette->tinted = rocket_sun_dist < 100.0;
+    vignette->vignette_r = vignette_r;
+    vignette->vignette_g = vignette_g;
+    vignette->vignette_b = vignette_b;
+    vignette->step = step;
+}
+
+void post_push_whiteout(post_stack_t *stack, float white_factor) {
+    post_effect_t *effect = push(stack, POST_WHITEOUT, POST_COLOUR);
+    if (effect) effect->whiteout.white_factor = white_factor;
+}
+
+void post_push_distortion(post_stack_t *stack, float distortion_factor, int step) {
+    post_effect_t *effect = push(stack, POST_DISTORTION, POST_GATHER);
+    if (!effect) return;
+
+    effect->distortion.distortion_factor = distortion_factor;
+    effect->distortion.step = step < 1 ? 1 : step;
+}
+
+KERNEL_INLINE float vignette_tint(const post_vignette_t *v, int x, int y) {
+    float dist = rafgl_distance2D(x, y, v->cx, v->cy) / v->r;
+
+    dist = powf(dist, 1.8f);
+
+    float tint_factor = dist * v->vignette_factor;
+    if (v->tinted) {
+        tint_factor *= v->proximity_factor;
+    }
+    return tint_factor;
+}
+
+KERNEL_INLINE float vignette_tint_at(const post_vignette_t *v, int x, int y) {
+    return v->step == 1 ? vignette_tint(v, x, y) : v->block_tint[v->block_row[y] + v->block_column[x]];
+}
+
+KERNEL_INLINE rafgl_pixel_rgb_t vignette_colour(const post_vignette_t *v, rafgl_pixel_rgb_t sampled, int x, int y) {
+    float tint_factor = vignette_tint_at(v, x, y);
+    rafgl_pixel_rgb_t result = sampled;
+
+    if (v->tinted) {
+        result.r = rafgl_saturatei(sampled.r * (1.0f - tint_factor) + v->vignette_r * tint_factor * 255);
+        result.g = rafgl_saturatei(sampled.g * (1.0f - tint_factor) + v->vignette_g * tint_factor * 255);
+        result.b = rafgl_saturatei(sampled.b * (1.0f - tint_factor) + v->vignette_b * tint_factor * 255);
+    } else {
+        result.r = rafgl_saturatei(sampled.r * (1.0f - tint_factor));
+        result.g = rafgl_saturatei(sampled.g * (1.0f - tint_factor));
+        result.b = rafgl_saturatei(sampled.b * (1.0f - tint_factor));
+    }
+    return result;
+}
+
+KERNEL_INLINE rafgl_pixel_rgb_t whiteout_colour(const post_whiteout_t *w, rafgl_pixel_rgb_t pix) {
+    pix.r = pix.r + (255 - pix.r) * w->white_factor;
+    pix.g = pix.g + (255 - pix.g) * w->white_factor;
+    pix.b = pix.b + (255 - pix.b) * w->white_factor;
+    return pix;
+}
+
+/// the block a pixel is in is displaced as a whole, by the offsets of its first row and column
+KERNEL_INLINE void distortion_gather(const post_distortion_t *d, int x, int y, int *sx, int *sy) {
+    int x0 = d->origin_x[x], y0 = d->origin_y[y];
+
+    int src_x = (int)(x0 + d->offset_x[y]) % d->width;
+    int src_y = (int)(y0 + d->offset_y[x]) % d->height;
+
+    if (src_x < 0) src_x += d->width;
+    if (src_y < 0) src_y += d->height;
+
+    *sx = (src_x + x - x0) % d->width;
+    *sy = (src_y + y - y0) % d->height;
+}
+
+static void compile_vignette(post_vignette_t *v, int width, int height) {
+    if (v->step == 1) return;
+
+    int step = v->step;
+    int columns = (width + step - 1) / step;
+    int rows = (height + step - 1) / step;
+    float *block_tint = scratch_alloc(&frame_scratch, columns * rows * sizeof(float));
+    int *block_column = scratch_alloc(&frame_scratch, width * sizeof(int));
+    int *block_row = scratch_alloc(&frame_scratch, height * sizeof(int));
+
+    /// sampled at the centre of each block
+    for (int by = 0; by < rows; by++) {
+        for (int bx = 0; bx < columns; bx++) {
+            block_tint[by * columns + bx] = vignette_tint(v, bx * step + step / 2, by * step + step / 2);
+        }
+    }
+    for (int x = 0; x < width; x++) block_column[x] = x / step;
+    for (int y = 0; y < height; y++) block_row[y] = y / step * columns;
+
+    v->block_tint = block_tint;
+    v->block_column = block_column;
+    v->block_row = block_row;
+}
+
+static void compile_distortion(post_distortion_t *d, int width, int height) {
+    float *offset_x = scratch_alloc(&frame_scratch, height * sizeof(float));
+    float *offset_y = scratch_alloc(&frame_scratch, width * sizeof(float));
+    int *origin_x = scratch_alloc(&frame_scratch, width * sizeof(int));
+    int *origin_y = scratch_alloc(&frame_scratch, height * sizeof(int));
+
+    /// the offsets only depend on the block's row or column, so the trigonometry is done once per line
+    for (int y = 0; y < height; y++) {
+        origin_y[y] = y - y % d->step;
+        offset_x[y] = sin(origin_y[y] * 0.05f) * d->distortion_factor;
+    }
+    for (int x = 0; x < width; x++) {
+        origin_x[x] = x - x % d->step;
+        offset_y[x] = cos(origin_x[x] * 0.05f) * d->distortion_factor;
+    }
+
+    d->width = width;
+    d->height = height;
+    d->offset_x = offset_x;
+    d->offset_y = offset_y;
+    d->origin_x = origin_x;
+    d->origin_y = origin_y;
+}
+
+static int is_noop(const post_effect_t *effect) {
+    switch (effect->op) {
+        case POST_WHITEOUT: return effect->whiteout.white_factor == 0.0f;
+        case POST_DISTORTION: return effect->distortion.distortion_factor == 0.0f;
+        default: return 0;
+    }
+}
+
+void post_stack_compile(post_stack_t *stack, int width, int height) {
+    int kept = 0;
+    for (int i = 0; i < stack->count; i++) {
+        if (!is_noop(&stack->effects[i])) stack->effects[kept++] = stack->effects[i];
+    }
+    stack->count = kept;
+
+    stack->gathers = 0;
+    for (int i = stack->count - 1; i >= 0; i--) {
+        post_effect_t *effect = &stack->effects[i];
+        effect->stage = stack->gathers;
+        if (effect->kind == POST_GATHER) stack->gathers += 1;
+
+        switch (effect->op) {
+            case POST_VIGNETTE: compile_vignette(&effect->vignette, width, height); break;
+            case POST_DISTORTION: compile_distortion(&effect->distortion, width, height); break;
+            default: break;
+        }
+    }
+
+    stack->compiled_width = width;
+    stack->compiled_height = height;
+}
+
+typedef struct {
+    const post_stack_t *stack;
+    const rafgl_raster_t *source;
+} post_pass_t;
+
+/// Walks the gathers from the last one back to find where the pixel comes from, then runs the
+/// colour ops in stack order, each at the coordinate its input was at.
+KERNEL_INLINE void post_pixel(const post_pass_t *pass, rafgl_pixel_rgb_t *pixel, int x, int y) {
+    const post_stack_t *stack = pass->stack;
+    int xs[POST_MAX_EFFECTS + 1], ys[POST_MAX_EFFECTS + 1];
+    xs[0] = x;
+    ys[0] = y;
+
+    int g = 0;
+    for (int i = stack->count - 1; i >= 0; i--) {
+        const post_effect_t *effect = &stack->effects[i];
+        if (effect->kind == POST_GATHER) {
+            distortion_gather(&effect->distortion, xs[g], ys[g], &xs[g + 1], &ys[g + 1]);
+            g++;
+        }
+    }
+
+    rafgl_pixel_rgb_t pix = g ? pixel_at_pm(pass->source, xs[g], ys[g]) : *pixel;
+
+    for (int i = 0; i < stack->count; i++) {
+        const post_effect_t *effect = &stack->effects[i];
+        switch (effect->op) {
+            case POST_VIGNETTE: pix = vignette_colour(&effect->vignette, pix, xs[effect->stage], ys[effect->stage]); break;
+            case POST_WHITEOUT: pix = whiteout_colour(&effect->whiteout, pix); break;
+            default: break;
+        }
+    }
+
+    *pixel = pix;
+}
+
+#ifdef __SSE2__
+/// a colour op leaves whole channels behind, so the floats are cut back to them before the next one
+KERNEL_INLINE __m128 post_channels(__m128 colour) {
+    colour = _mm_min_ps(_mm_max_ps(colour, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+    return _mm_cvtepi32_ps(_mm_cvttps_epi32(colour));
+}
+
+/// post_pixel for four pixels. Where each comes from and its vignette tint are still found one
+/// at a time, the colour ops then run on all four channels of a pixel at once with the scalar
+/// arithmetic in the same order, so the output is the same to the bit.
+KERNEL_INLINE void post_lanes(const post_pass_t *pass, rafgl_pixel_rgb_t *pixels, int x, int y) {
+    const post_stack_t *stack = pass->stack;
+    int xs[KERNEL_LANES][POST_MAX_EFFECTS + 1], ys[KERNEL_LANES][POST_MAX_EFFECTS + 1];
+    rafgl_pixel_rgb_t sampled[KERNEL_LANES];
+
+    for (int lane = 0; lane < KERNEL_LANES; lane++) {
+        xs[lane][0] = x + lane;
+        ys[lane][0] = y;
+
+        int g = 0;
+        for (int i = stack->count - 1; i >= 0; i--) {
+            const post_effect_t *effect = &stack->effects[i];
+            if (effect->kind == POST_GATHER) {
+                distortion_gather(&effect->distortion, xs[lane][g], ys[lane][g], &xs[lane][g + 1], &ys[lane][g + 1]);
+                g++;
+            }
+        }
+        sampled[lane] = g ? pixel_at_pm(pass->source, xs[lane][g], ys[lane][g]) : pixels[lane];
+    }
+
+    __m128i source = _mm_loadu_si128((const __m128i *)sampled);
+    __m128 colour[KERNEL_LANES];
+    kernel_unpack_ps(source, colour);
+
+    for (int i = 0; i < stack->count; i++) {
+        const post_effect_t *effect = &stack->effects[i];
+        switch (effect->op) {
+            case POST_VIGNETTE: {
+                const post_vignette_t *v = &effect->vignette;
+                __m128 tint = _mm_setr_ps(v->vignette_r, v->vignette_g, v->vignette_b, 0.0f);
+                for (int lane = 0; lane < KERNEL_LANES; lane++) {
+                    __m128 factor = _mm_set1_ps(vignette_tint_at(v, xs[lane][effect->stage], ys[lane][effect->stage]));
+                    __m128 c = _mm_mul_ps(colour[lane], _mm_sub_ps(_mm_set1_ps(1.0f), factor));
+                    if (v->tinted) c = _mm_add_ps(c, _mm_mul_ps(_mm_mul_ps(tint, factor), _mm_set1_ps(255.0f)));
+                    colour[lane] = post_channels(c);
+                }
+                break;
+            }
+            case POST_WHITEOUT: {
+                __m128 factor = _mm_set1_ps(effect->whiteout.white_factor);
+                for (int lane = 0; lane < KERNEL_LANES; lane++) {
+                    __m128 c = colour[lane];
+                    colour[lane] = post_channels(_mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(255.0f), c), factor)));
+                }
+                break;
+            }
+            default: break;
+        }
+    }
+
+    /// the ops never touch alpha
+    __m128i packed = _mm_and_si128(kernel_pack_ps(colour), KERNEL_RGB_MASK);
+    _mm_storeu_si128((__m128i *)pixels, _mm_or_si128(packed, _mm_andnot_si128(KERNEL_RGB_MASK, source)));
+}
+#endif
+
+PIXEL_KERNEL_LANES(post_kernel, post_pass_t, post_pixel, post_lanes, 1)
+
+void post_stack_run(const post_stack_t *stack, rafgl_raster_t *dst, const rafgl_raster_t *src) {
+    assert(stack->compiled_width == dst->width && stack->compiled_height == dst->height && "stack compiled for another frame size");
+    assert((dst != src || stack->gathers == 0) && "a gather can't run in place");
+
+    if (stack->count == 0) {
+        if (dst != src) rafgl_raster_copy_pixels(dst, src);
+        return;
+    }
+
+    post_pass_t pass = {stack, src};
+    post_kernel(dst, KERNEL_WHOLE(dst), &pass);
+}
+
+void post_stack_apply(post_stack_t *stack, rafgl_raster_t *frame, rafgl_raster_t *spare) {
+    post_stack_compile(stack, frame->width, frame->height);
+    if (stack->count == 0) return;
+
+    if (stack->gathers == 0) {
+        post_stack_run(stack, frame, frame);
+        return;
+    }
+
+    post_stack_run(stack, spare, frame);
+
+    rafgl_raster_t swap = *frame;
+    *frame = *spare;
+    *spare = swap;
+}
@@ -0,0 +1,117 @@
+#include <quality.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Ordered from full quality down. Cheaper rungs trade the effects whose cost
+/// grows with the raster first and only then the ones players notice most.
+static const quality_level_t quality_ladder[QUALITY_LEVELS] = {
+    /* vignette  blur  particles  stars  fisheye  distortion  zoom  bloom */
+    {  1,        5,    MAX_SMOKE_PARTICLES, 1.0f,  3.0f, 1,          4,    6 },
+    {  2,        4,    150,                 0.75f, 3.0f, 1,          4,    6 },
+    {  4,        3,    100,                 0.5f,  2.5f, 2,          3,    5 },
+    {  8,        2,    50,                  0.3f,  2.0f, 2,          3,    4 },
+    {  0,        1,    0,                   0.15f, 1.5f, 4,          2,    0 },
+};
+
+void quality_init(quality_governor_t *governor, float budget, int enabled) {
+    memset(governor, 0, sizeof(quality_governor_t));
+    governor->budget = budget;
+    governor->frame_time = budget;
+    governor->enabled = enabled;
+}
+
+static void quality_set_level(quality_governor_t *governor, int level) {
+    quality_decision_t *decision = &governor->decisions[governor->stats.decision_count % QUALITY_DECISION_LOG];
+    decision->frame = governor->stats.frames;
+    decision->from_level = governor->level;
+    decision->to_level = level;
+    decision->frame_time = governor->frame_time;
+    governor->stats.decision_count++;
+
+    if (level > governor->level) {
+        governor->stats.downgrades++;
+    } else {
+        governor->stats.upgrades++;
+    }
+    governor->level = level;
+    governor->cooldown = QUALITY_SETTLE_TIME;
+    governor->comfortable = 0.0f;
+}
+
+int quality_update(quality_governor_t *governor, float frame_time) {
+    quality_stats_t *stats = &governor->stats;
+
+    governor->frame_time += (frame_time - governor->frame_time) * QUALITY_SMOOTHING;
+
+    stats->frames++;
+    stats->frames_at_level[governor->level]++;
+    if (frame_time > governor->budget) stats->frames_over_budget++;
+    if (frame_time > stats->worst_frame_time) stats->worst_frame_time = frame_time;
+
+    if (!governor->enabled) {
+        return 0;
+    }
+
+    /// time under the upgrade line has to be uninterrupted, anything above it starts the wait over
+    if (governor->frame_time < governor->budget * QUALITY_UPGRADE_RATIO) {
+        governor->comfortable += frame_time;
+    } else {
+        governor->comfortable = 0.0f;
+    }
+
+    if (governor->cooldown > 0.0f) {
+        governor->cooldown -= frame_time;
+        return 0;
+    }
+
+    if (governor->frame_time > governor->budget && governor->level < QUALITY_LEVELS - 1) {
+        quality_set_level(governor, governor->level + 1);
+        return 1;
+    }
+
+    if (governor->comfortable >= QUALITY_UPGRADE_DELAY && governor->level > 0) {
+        quality_set_level(governor, governor->level - 1);
+        return 1;
+    }
+
+    return 0;
+}
+
+const quality_level_t *quality_current(const quality_governor_t *governor) {
+    return &quality_ladder[governor->level];
+}
+
+int quality_is_lowest(const quality_governor_t *governor) {
+    return governor->level == QUALITY_LEVELS - 1;
+}
+
+void quality_get_stats(const quality_governor_t *governor, quality_stats_t *stats) {
+    *stats = governor->stats;
+}
+
+int quality_get_decisions(const quality_governor_t *governor, quality_decision_t *out, int max) {
+    int total = governor->stats.decision_count;
+    int count = rafgl_min_m(rafgl_min_m(total, QUALITY_DECISION_LOG), max);
+
+    for (int i = 0; i < count; i++) {
+        out[i] = governor->decisions[(total - count + i) % QUALITY_DECISION_LOG];
+    }
+    return count;
+}
+
+void quality_print_stats(const quality_governor_t *governor) {
+    const quality_stats_t *stats = &governor->stats;
+    quality_decision_t decisions[QUALITY_DECISION_LOG];
+    int count = quality_get_decisions(governor, decisions, QUALITY_DECISION_LOG);
+
+    printf("QUALITY: level %d, %d frames, %d over budget (%.2f ms), worst %.2f ms\n",
+           governor->level, stats->frames, stats->frames_over_budget, governor->budget * 1000.0f, stats->worst_frame_time * 1000.0f);
+    printf("QUALITY: %d downgrades, %d upgrades\n", stats->downgrades, stats->upgrades);
+    for (int i = 0; i < QUALITY_LEVELS; i++) {
+        printf("QUALITY: level %d for %d frames\n", i, stats->frames_at_level[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        printf("QUALITY: frame %d, %d -> %d at %.2f ms\n",
+               decisions[i].frame, decisions[i].from_level, decisions[i].to_level, decisions[i].frame_time * 1000.0f);
+    }
+}
@@ -0,0 +1,234 @@
+#include <render_graph.h>
+#include <parallel.h>
+#include <string.h>
+#include <assert.h>
+
+/// memory behind the transients of every graph
+static rafgl_raster_t slots[RENDER_MAX_SLOTS];
+static int slot_count = 0;
+static int slot_width = 0, slot_height = 0;
+
+static void grow_slots(int count) {
+    int previous_tag = rafgl_memory_set_tag(rafgl_memory_tag("render target"));
+    for (; slot_count < count; slot_count++) {
+        rafgl_raster_init_aligned(&slots[slot_count], slot_width, slot_height);
+    }
+    rafgl_memory_set_tag(previous_tag);
+}
+
+void render_graph_resize(int width, int height) {
+    int count = slot_count;
+    render_graph_cleanup();
+    slot_width = width;
+    slot_height = height;
+    grow_slots(count);
+}
+
+void render_graph_cleanup() {
+    for (int i = 0; i < slot_count; i++) {
+        rafgl_raster_cleanup(&slots[i]);
+    }
+    slot_count = 0;
+}
+
+void render_graph_init(render_graph_t *graph, const char *name) {
+    memset(graph, 0, sizeof(render_graph_t));
+    graph->name = name;
+    graph->output = -1;
+}
+
+static int add_resource(render_graph_t *graph, const char *name, rafgl_raster_t *raster, int transient) {
+    assert(graph->resource_count < RENDER_MAX_RESOURCES);
+    render_resource_t *resource = &graph->resources[graph->resource_count];
+    resource->name = name;
+    resource->raster = raster;
+    resource->transient = transient;
+    resource->slot = -1;
+    return graph->resource_count++;
+}
+
+int render_graph_import(render_graph_t *graph, const char *name, rafgl_raster_t *raster) {
+    return add_resource(graph, name, raster, 0);
+}
+
+int render_graph_transient(render_graph_t *graph, const char *name) {
+    return add_resource(graph, name, NULL, 1);
+}
+
+int render_graph_pass(render_graph_t *graph, const char *name, render_pass_fn_t run, int flags) {
+    assert(graph->pass_count < RENDER_MAX_PASSES);
+    render_pass_t *pass = &graph->passes[graph->pass_count];
+    memset(pass, 0, sizeof(render_pass_t));
+    pass->name = name;
+    pass->run = run;
+    pass->flags = flags;
+    return graph->pass_count++;
+}
+
+void render_graph_read(render_graph_t *graph, int pass, int resource) {
+    render_pass_t *p = &graph->passes[pass];
+    assert(p->read_count < RENDER_MAX_PASS_IO);
+    p->reads[p->read_count++] = resource;
+}
+
+void render_graph_write(render_graph_t *graph, int pass, int resource) {
+    render_pass_t *p = &graph->passes[pass];
+    assert(p->write_count < RENDER_MAX_PASS_IO);
+    p->writes[p->write_count++] = resource;
+}
+
+static int uses(const int *list, int count, int resource) {
+    for (int i = 0; i < count; i++) {
+        if (list[i] == resource) return 1;
+    }
+    return 0;
+}
+
+/// b has to wait for a when it reads what a writes, writes what a reads, or writes what a writes
+static int depends_on(const render_pass_t *b, const render_pass_t *a) {
+    for (int i = 0; i < a->write_count; i++) {
+        if (uses(b->reads, b->read_count, a->writes[i]) || uses(b->writes, b->write_count, a->writes[i])) return 1;
+    }
+    for (int i = 0; i < a->read_count; i++) {
+        if (uses(b->writes, b->write_count, a->reads[i])) return 1;
+    }
+    return 0;
+}
+
+void render_graph_compile(render_graph_t *graph, int output) {
+    graph->output = output;
+
+    /// walking back from the output, a pass lives if it writes something a live pass needs
+    int needed[RENDER_MAX_RESOURCES] = {0};
+    needed[output] = 1;
+    for (int p = graph->pass_count - 1; p >= 0; p--) {
+        render_pass_t *pass = &graph->passes[p];
+        int live = 0;
+        for (int i = 0; i < pass->write_count; i++) {
+            if (needed[pass->writes[i]]) live = 1;
+        }
+        pass->level = live ? 0 : -1;
+        if (live) {
+            for (int i = 0; i < pass->read_count; i++) needed[pass->reads[i]] = 1;
+        }
+    }
+
+    graph->levels = 0;
+    for (int p = 0; p < graph->pass_count; p++) {
+        render_pass_t *pass = &graph->passes[p];
+        if (pass->level < 0) continue;
+        for (int q = 0; q < p; q++) {
+            const render_pass_t *earlier = &graph->passes[q];
+            if (earlier->level >= 0 && depends_on(pass, earlier) && earlier->level + 1 > pass->level) {
+                pass->level = earlier->level + 1;
+            }
+        }
+        if (pass->level + 1 > graph->levels) graph->levels = pass->level + 1;
+    }
+
+    for (int r = 0; r < graph->resource_count; r++) {
+        render_resource_t *resource = &graph->resources[r];
+        resource->first_level = graph->levels;
+        resource->last_level = -1;
+        resource->slot = -1;
+    }
+    for (int p = 0; p < graph->pass_count; p++) {
+        const render_pass_t *pass = &graph->passes[p];
+        if (pass->level < 0) continue;
+        for (int i = 0; i < pass->read_count + pass->write_count; i++) {
+            render_resource_t *resource = &graph->resources[i < pass->read_count ? pass->reads[i] : pass->writes[i - pass->read_count]];
+            if (pass->level < resource->first_level) resource->first_level = pass->level;
+            if (pass->level > resource->last_level) resource->last_level = pass->level;
+        }
+    }
+
+    /// transients in order of first use, each into the first slot that is free by then
+    int busy_until[RENDER_MAX_SLOTS];
+    graph->slots = 0;
+    for (int level = 0; level < graph->levels; level++) {
+        for (int r = 0; r < graph->resource_count; r++) {
+            render_resource_t *resource = &graph->resources[r];
+            if (!resource->transient || resource->first_level != level) continue;
+
+            int slot = 0;
+            while (slot < graph->slots && busy_until[slot] >= level) slot++;
+            assert(slot < RENDER_MAX_SLOTS);
+            if (slot == graph->slots) graph->slots++;
+            busy_until[slot] = resource->last_level;
+            resource->slot = slot;
+        }
+    }
+
+    if (graph->slots > slot_count) grow_slots(graph->slots);
+    for (int r = 0; r < graph->resource_count; r++) {
+        render_resource_t *resource = &graph->resources[r];
+        if (resource->transient) resource->raster = resource->slot >= 0 ? &slots[resource->slot] : NULL;
+    }
+}
+
+static void run_pass(render_graph_t *graph, const render_pass_t *pass) {
+    rafgl_raster_t *reads[RENDER_MAX_PASS_IO], *writes[RENDER_MAX_PASS_IO];
+    for (int i = 0; i < pass->read_count; i++) reads[i] = graph->resources[pass->reads[i]].raster;
+    for (int i = 0; i < pass->write_count; i++) writes[i] = graph->resources[pass->writes[i]].raster;
+    pass->run(reads, writes);
+}
+
+void render_graph_execute(render_graph_t *graph) {
+    for (int level = 0; level < graph->levels; level++) {
+        const render_pass_t *batch[RENDER_MAX_PASSES];
+        int count = 0, serial = 0;
+        for (int p = 0; p < graph->pass_count; p++) {
+            if (graph->passes[p].level != level) continue;
+            batch[count++] = &graph->passes[p];
+            serial |= graph->passes[p].flags & RENDER_PASS_SERIAL;
+        }
+
+        if (count > 1 && !serial) {
+            PARALLEL_FOR_DYNAMIC
+            for (int i = 0; i < count; i++) {
+                run_pass(graph, batch[i]);
+            }
+        } else {
+            for (int i = 0; i < count; i++) {
+                run_pass(graph, batch[i]);
+            }
+        }
+    }
+}
+
+rafgl_raster_t *render_graph_output(render_graph_t *graph) {
+    return graph->resources[graph->output].raster;
+}
+
+static void dump_list(const render_graph_t *graph, const char *label, const int *list, int count, FILE *out) {
+    if (count == 0) return;
+    fprintf(out, "  %s", label);
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "%s%s", i ? ", " : " ", graph->resources[list[i]].name);
+    }
+}
+
+void render_graph_dump(const render_graph_t *graph, FILE *out) {
+    int live = 0;
+    for (int p = 0; p < graph->pass_count; p++) {
+        if (graph->passes[p].level >= 0) live++;
+    }
+    fprintf(out, "RENDER GRAPH %s: %d of %d passes in %d levels, %d transient slots, presents %s\n",
+            graph->name, live, graph->pass_count, graph->levels, graph->slots, graph->resources[graph->output].name);
+
+    for (int p = 0; p < graph->pass_count; p++) {
+        const render_pass_t *pass = &graph->passes[p];
+        if (pass->level >= 0) fprintf(out, "  %2d %-16s", pass->level, pass->name);
+        else fprintf(out, "   - %-16s", pass->name);
+        dump_list(graph, "reads", pass->reads, pass->read_count, out);
+        dump_list(graph, "writes", pass->writes, pass->write_count, out);
+        fprintf(out, "%s%s\n", pass->flags & RENDER_PASS_SERIAL ? "  (serial)" : "", pass->level < 0 ? "  (culled)" : "");
+    }
+
+    for (int r = 0; r < graph->resource_count; r++) {
+        const render_resource_t *resource = &graph->resources[r];
+        if (!resource->transient) continue;
+        if (resource->slot < 0) fprintf(out, "  transient %s: unused\n", resource->name);
+        else fprintf(out, "  transient %s: levels %d-%d, slot %d\n", resource->name, resource->first_level, resource->last_level, resource->slot);
+    }
+}
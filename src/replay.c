@@ -0,0 +1,127 @@
+#include <replay.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#define REPLAY_MAGIC "OSRP"
+#define REPLAY_VERSION 2
+
+/// fixed part of a logged frame; the logged keys follow it, key_count of them
+#define REPLAY_FRAME_FIXED_BYTES offsetof(replay_frame_t, keys)
+
+int replay_record(replay_t *replay, const char *path, uint32_t seed, int width, int height, double sim_step) {
+    memset(replay, 0, sizeof(replay_t));
+    replay->file = fopen(path, "wb");
+    if (!replay->file) return 0;
+
+    replay->recording = 1;
+    memcpy(replay->header.magic, REPLAY_MAGIC, 4);
+    replay->header.version = REPLAY_VERSION;
+    replay->header.seed = seed;
+    replay->header.width = width;
+    replay->header.height = height;
+    replay->header.sim_step = sim_step;
+    replay->first_mismatch = -1;
+
+    if (fwrite(&replay->header, sizeof(replay_header_t), 1, replay->file) != 1) {
+        replay_close(replay);
+        return 0;
+    }
+    return 1;
+}
+
+int replay_open(replay_t *replay, const char *path) {
+    memset(replay, 0, sizeof(replay_t));
+    replay->file = fopen(path, "rb");
+    if (!replay->file) return 0;
+
+    replay->first_mismatch = -1;
+
+    if (fread(&replay->header, sizeof(replay_header_t), 1, replay->file) != 1
+        || memcmp(replay->header.magic, REPLAY_MAGIC, 4) != 0
+        || replay->header.version != REPLAY_VERSION) {
+        replay_close(replay);
+        return 0;
+    }
+    return 1;
+}
+
+int replay_input(replay_t *replay, float *delta_time, rafgl_game_data_t *game_data) {
+    replay_frame_t *frame = &replay->frame;
+
+    if (replay->recording) {
+        frame->delta_time = *delta_time;
+        frame->mouse_x = game_data->mouse_pos_x;
+        frame->mouse_y = game_data->mouse_pos_y;
+        frame->buttons = (game_data->is_lmb_down ? 1 : 0) | (game_data->is_rmb_down ? 2 : 0) | (game_data->is_mmb_down ? 4 : 0);
+        frame->key_count = 0;
+        /// pressed is logged on its own, a tap released within the frame is never down
+        for (int key = 0; key < REPLAY_KEY_RANGE && frame->key_count < REPLAY_MAX_KEYS; key++) {
+            int flags = (game_data->keys_down[key] ? REPLAY_KEY_DOWN : 0) | (game_data->keys_pressed[key] ? REPLAY_KEY_PRESSED : 0);
+            if (flags) frame->keys[frame->key_count++] = key | flags;
+        }
+        return 1;
+    }
+
+    if (fread(frame, REPLAY_FRAME_FIXED_BYTES, 1, replay->file) != 1
+        || frame->key_count > REPLAY_MAX_KEYS
+        || fread(frame->keys, sizeof(uint16_t), frame->key_count, replay->file) != frame->key_count) {
+        return 0;
+    }
+
+    memset(replay->keys_down, 0, sizeof(replay->keys_down));
+    memset(replay->keys_pressed, 0, sizeof(replay->keys_pressed));
+    for (int i = 0; i < frame->key_count; i++) {
+        int key = frame->keys[i] & REPLAY_KEY_MASK;
+        if (key >= REPLAY_KEY_RANGE) continue;
+        replay->keys_down[key] = (frame->keys[i] & REPLAY_KEY_DOWN) != 0;
+        replay->keys_pressed[key] = (frame->keys[i] & REPLAY_KEY_PRESSED) != 0;
+    }
+
+    *delta_time = frame->delta_time;
+    game_data->keys_down = replay->keys_down;
+    game_data->keys_pressed = replay->keys_pressed;
+    game_data->mouse_pos_x = frame->mouse_x;
+    game_data->mouse_pos_y = frame->mouse_y;
+    game_data->is_lmb_down = (frame->buttons & 1) != 0;
+    game_data->is_rmb_down = (frame->buttons & 2) != 0;
+    game_data->is_mmb_down = (frame->buttons & 4) != 0;
+    return 1;
+}
+
+void replay_end_frame(replay_t *replay, float *frame_time, uint32_t frame_hash) {
+    replay_frame_t *frame = &replay->frame;
+
+    if (replay->recording) {
+        frame->frame_time = *frame_time;
+        frame->frame_hash = frame_hash;
+        fwrite(frame, REPLAY_FRAME_FIXED_BYTES, 1, replay->file);
+        fwrite(frame->keys, sizeof(uint16_t), frame->key_count, replay->file);
+    } else {
+        *frame_time = frame->frame_time;
+        if (frame_hash != frame->frame_hash) {
+            if (replay->first_mismatch < 0) replay->first_mismatch = replay->frames;
+            replay->mismatches += 1;
+        }
+    }
+    replay->frames += 1;
+}
+
+void replay_close(replay_t *replay) {
+    if (replay->file) fclose(replay->file);
+    replay->file = NULL;
+}
+
+/// FNV-1a over whole pixels, row padding left out
+uint32_t replay_hash_raster(const rafgl_raster_t *raster) {
+    uint32_t hash = 2166136261u;
+
+    for (int y = 0; y < raster->height; y++) {
+        const rafgl_pixel_rgb_t *row = rafgl_row_pm(raster, y);
+        for (int x = 0; x < raster->width; x++) {
+            hash ^= row[x].rgba;
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
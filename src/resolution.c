@@ -0,0 +1,61 @@
+#include <resolution.h>
+#include <math.h>
+
+void resolution_init(resolution_controller_t *controller, int display_width, int display_height, float target_fps, int enabled) {
+    controller->display_width = display_width;
+    controller->display_height = display_height;
+    controller->min_scale = RESOLUTION_MIN_SCALE;
+    controller->max_scale = RESOLUTION_MAX_SCALE;
+    controller->target_frame_time = FRAME_BUDGET / target_fps;
+    controller->frame_time = controller->target_frame_time;
+    controller->cooldown = 0.0f;
+    controller->enabled = enabled;
+    resolution_set_scale(controller, controller->max_scale);
+}
+
+void resolution_set_scale(resolution_controller_t *controller, float scale) {
+    scale = rafgl_clampf(scale, controller->min_scale, controller->max_scale);
+    controller->scale = scale;
+    controller->width = rafgl_max_m((int)(controller->display_width * scale + 0.5f), 1);
+    controller->height = rafgl_max_m((int)(controller->display_height * scale + 0.5f), 1);
+}
+
+int resolution_update(resolution_controller_t *controller, float frame_time) {
+    controller->frame_time += (frame_time - controller->frame_time) * RESOLUTION_SMOOTHING;
+
+    if (!controller->enabled) {
+        return 0;
+    }
+
+    if (controller->cooldown > 0.0f) {
+        controller->cooldown -= frame_time;
+        return 0;
+    }
+
+    float scale = controller->scale;
+    float target = controller->target_frame_time;
+
+    if (controller->frame_time > target) {
+        /// cost follows the pixel count, the square of the scale
+        scale *= sqrtf(target / controller->frame_time);
+        scale = floorf(scale / RESOLUTION_SCALE_STEP) * RESOLUTION_SCALE_STEP;
+    } else {
+        /// only step up when the larger frame is predicted to fit as well, so the scale cannot oscillate
+        float next = scale + RESOLUTION_SCALE_STEP;
+        float growth = (next * next) / (scale * scale);
+        if (controller->frame_time * growth < target * RESOLUTION_HEADROOM) {
+            scale = next;
+        }
+    }
+
+    scale = rafgl_clampf(scale, controller->min_scale, controller->max_scale);
+    if (scale == controller->scale) {
+        return 0;
+    }
+
+    /// carry the smoothed time over to the new size, so it does not keep reacting to the old one
+    controller->frame_time *= (scale * scale) / (controller->scale * controller->scale);
+    resolution_set_scale(controller, scale);
+    controller->cooldown = RESOLUTION_COOLDOWN;
+    return 1;
+}
@@ -0,0 +1,196 @@
+#include <starfield.h>
+#include <parallel.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+void starfield_init(starfield_t *field, int capacity) {
+    memset(field, 0, sizeof(starfield_t));
+    field->capacity = capacity;
+    field->x = calloc(capacity, sizeof(float));
+    field->y = calloc(capacity, sizeof(float));
+    field->z = calloc(capacity, sizeof(float));
+    field->inv_z = calloc(capacity, sizeof(float));
+    field->speed = calloc(capacity, sizeof(float));
+    field->colour = calloc(capacity, sizeof(uint32_t));
+    field->streaks = malloc(capacity * sizeof(rafgl_streak_t));
+    field->first_band = malloc(capacity * sizeof(int16_t));
+    field->last_band = malloc(capacity * sizeof(int16_t));
+    field->tick = (uint32_t)rand();
+}
+
+void starfield_cleanup(starfield_t *field) {
+    free(field->x);
+    free(field->y);
+    free(field->z);
+    free(field->inv_z);
+    free(field->speed);
+    free(field->colour);
+    free(field->streaks);
+    free(field->first_band);
+    free(field->last_band);
+    free(field->band_start);
+    free(field->band_cursor);
+    free(field->band_items);
+    memset(field, 0, sizeof(starfield_t));
+}
+
+void starfield_set_count(starfield_t *field, int count) {
+    if (count > field->capacity) count = field->capacity;
+    if (count < 1) count = 1;
+
+    /// stars past the old count are stale or zeroed, zero depth makes the next update respawn them
+    for (int i = field->count; i < count; i++) {
+        field->z[i] = 0.0f;
+    }
+    field->count = count;
+
+    field->brightness = (float)HYPER_STAR_COUNT / count;
+    if (field->brightness > 1.0f) field->brightness = 1.0f;
+}
+
+void starfield_reset(starfield_t *field, int count) {
+    starfield_set_count(field, count);
+    count = field->count;
+
+    for (int i = 0; i < count; i++) {
+        field->x[i] += ((float)rand() / RAND_MAX - 0.5f) * 0.1f; // Random offset in X
+        field->y[i] += ((float)rand() / RAND_MAX - 0.5f) * 0.1f; // Random offset in Y
+
+        field->z[i] = ((float)rand() / RAND_MAX) * 100.0f + 1.0f; // Closer stars move faster
+        field->inv_z[i] = 1.0f / field->z[i];
+        field->speed[i] = HYPER_STAR_SPEED;
+        field->colour[i] = rafgl_RGB(rand() % 256, rand() % 256, 255);
+    }
+}
+
+void starfield_update(starfield_t *field, float delta_time, int width, int height) {
+    int n = field->count;
+    float *restrict x = field->x;
+    float *restrict y = field->y;
+    float *restrict z = field->z;
+    float *restrict inv_z = field->inv_z;
+    float *restrict speed = field->speed;
+    uint32_t *restrict colour = field->colour;
+    uint32_t seed = parallel_hash(field->tick++) * 8;
+
+    /// drift towards the camera: no branches and no calls, so this vectorizes
+    PARALLEL_FOR_IF(n >= HYPER_STAR_PARALLEL_THRESHOLD)
+    for (int i = 0; i < n; i++) {
+        float jx = hash_to_unit(parallel_hash(seed + 8 * (uint32_t)i)) - 0.5f;
+        float jy = hash_to_unit(parallel_hash(seed + 8 * (uint32_t)i + 1)) - 0.5f;
+        z[i] -= speed[i] * delta_time;
+        x[i] += jx * 0.1f;
+        y[i] += jy * 0.1f;
+        inv_z[i] = 1.0f / z[i];
+    }
+
+    /// respawn whatever passed the camera or left the view; rare, so it stays out of the loop above
+    PARALLEL_FOR_IF(n >= HYPER_STAR_PARALLEL_THRESHOLD)
+    for (int i = 0; i < n; i++) {
+        if (z[i] <= 0 || fabsf(x[i] * inv_z[i]) > width || fabsf(y[i] * inv_z[i]) > height) {
+            uint32_t h = seed + 8 * (uint32_t)i;
+            uint32_t c = parallel_hash(h + 6);
+            x[i] = (hash_to_unit(parallel_hash(h + 2)) - 0.5f) * width * 2.0f;
+            y[i] = (hash_to_unit(parallel_hash(h + 3)) - 0.5f) * height * 2.0f;
+            z[i] = hash_to_unit(parallel_hash(h + 4)) * 100.0f + 1.0f;
+            inv_z[i] = 1.0f / z[i];
+            speed[i] = hash_to_unit(parallel_hash(h + 5)) * 5.0f + 1.0f;
+            colour[i] = rafgl_RGB(c & 0xff, (c >> 8) & 0xff, 255);
+        }
+    }
+}
+
+/// Bands a streak can touch, including the extra row the anti-aliasing reaches into.
+/// A streak that misses the raster gets an empty range.
+static inline void streak_bands(const rafgl_streak_t *s, int width, int height, int16_t *first, int16_t *last) {
+    float min_x = fminf(s->x0, s->x1), max_x = fmaxf(s->x0, s->x1);
+    float min_y = fminf(s->y0, s->y1) - 1.0f, max_y = fmaxf(s->y0, s->y1) + 1.0f;
+    int visible = max_x >= -1.0f && min_x <= width && max_y >= 0.0f && min_y <= height;
+
+    min_y = fmaxf(min_y, 0.0f);
+    max_y = fminf(max_y, height - 1);
+    *first = visible ? (int)min_y / HYPER_STAR_BAND_HEIGHT : 0;
+    *last = visible ? (int)max_y / HYPER_STAR_BAND_HEIGHT : -1;
+}
+
+void starfield_render(starfield_t *field, rafgl_raster_t *raster, float offset_x, float offset_y, const uint32_t *override_colour, int trail_decay) {
+    int n = field->count;
+    int width = raster->width, height = raster->height;
+    float center_x = width / 2 + offset_x, center_y = height / 2 + offset_y;
+    float brightness = field->brightness;
+    const float *restrict x = field->x;
+    const float *restrict y = field->y;
+    const float *restrict z = field->z;
+    const float *restrict inv_z = field->inv_z;
+    const float *restrict speed = field->speed;
+    const uint32_t *restrict colour = field->colour;
+    rafgl_streak_t *restrict streaks = field->streaks;
+    int16_t *restrict first_band = field->first_band;
+    int16_t *restrict last_band = field->last_band;
+
+    /// project: the head sits at the current depth, the tail further back along the flight path
+    PARALLEL_FOR_IF(n >= HYPER_STAR_PARALLEL_THRESHOLD)
+    for (int i = 0; i < n; i++) {
+        float streak_length = 1.0f + 50.0f * inv_z[i];
+        float tail_inv_z = 1.0f / (z[i] + speed[i] * streak_length);
+        float intensity = 1.0f - z[i] * (1.0f / HYPER_STAR_MAX_DEPTH);
+
+        streaks[i].x0 = x[i] * inv_z[i] * width + center_x;
+        streaks[i].y0 = y[i] * inv_z[i] * height + center_y;
+        streaks[i].x1 = x[i] * tail_inv_z * width + center_x;
+        streaks[i].y1 = y[i] * tail_inv_z * height + center_y;
+        streaks[i].colour = override_colour ? *override_colour : colour[i];
+        streaks[i].intensity = brightness * fmaxf(intensity, HYPER_STREAK_MIN_INTENSITY);
+
+        streak_bands(&streaks[i], width, height, &first_band[i], &last_band[i]);
+    }
+
+    /// bin by horizontal band, so every band can be rasterised on its own thread without locking
+    int bands = (height + HYPER_STAR_BAND_HEIGHT - 1) / HYPER_STAR_BAND_HEIGHT;
+    if (bands != field->band_count) {
+        field->band_count = bands;
+        field->band_start = realloc(field->band_start, (bands + 1) * sizeof(int));
+        field->band_cursor = realloc(field->band_cursor, bands * sizeof(int));
+    }
+
+    int *band_start = field->band_start;
+    memset(band_start, 0, (bands + 1) * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        for (int b = first_band[i]; b <= last_band[i]; b++)
+            band_start[b + 1]++;
+    }
+
+    for (int b = 0; b < bands; b++)
+        band_start[b + 1] += band_start[b];
+
+    if (band_start[bands] > field->band_items_capacity) {
+        field->band_items_capacity = band_start[bands] * 2;
+        field->band_items = realloc(field->band_items, field->band_items_capacity * sizeof(int));
+    }
+
+    int *band_items = field->band_items;
+    int *band_cursor = field->band_cursor;
+    memcpy(band_cursor, band_start, bands * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        for (int b = first_band[i]; b <= last_band[i]; b++)
+            band_items[band_cursor[b]++] = i;
+    }
+
+    /// each band is a view into the raster; streaks are shifted into it and clipped at its edges
+    PARALLEL_FOR_DYNAMIC
+    for (int b = 0; b < bands; b++) {
+        int band_y = b * HYPER_STAR_BAND_HEIGHT;
+        rafgl_raster_t band;
+        rafgl_raster_view(&band, raster, 0, band_y, width, HYPER_STAR_BAND_HEIGHT);
+
+        rafgl_raster_fade(&band, trail_decay);
+
+        for (int k = band_start[b]; k < band_start[b + 1]; k++) {
+            rafgl_streak_t s = streaks[band_items[k]];
+            s.y0 -= band_y;
+            s.y1 -= band_y;
+            rafgl_raster_draw_streaks(&band, &s, 1);
+        }
+    }
+}
@@ -1,6 +1,9 @@
 #include <utility.h>
 #include <rafgl.h>
 #include <game_constants.h>
+#include <frame_memory.h>
+#include <pixel_kernel.h>
+#include <post_process.h>
 #include <time.h>
 #include <stdlib.h>
 
@@ -66,8 +69,6 @@ void map_multiply_and_add(double *dst, double *src, int w, int h, double multipl
 }
 
 rafgl_raster_t generate_perlin(int octaves, double persistence) {
-    srand(time(NULL));
-
     int octave_size = 2;
     double multiplier = 1.0;
 
@@ -77,14 +78,15 @@ rafgl_raster_t generate_perlin(int octaves, double persistence) {
     int height = width;
 
     int i, octave, x, y;
-    double *tmp_map = malloc(height * width * sizeof(double));
-    double *perlin_map = calloc(height * width, sizeof(double));
+    double *tmp_map = raster_pool_acquire(&frame_pool, height * width * sizeof(double));
+    double *perlin_map = raster_pool_acquire(&frame_pool, height * width * sizeof(double));
+    memset(perlin_map, 0, height * width * sizeof(double));
     double *octave_map;
     rafgl_pixel_rgb_t pix;
     rafgl_raster_init(&raster, width, height);
 
     for (octave = 0; octave < octaves; octave++) {
-        octave_map = malloc(octave_size * octave_size * sizeof(double));
+        octave_map = scratch_alloc(&frame_scratch, octave_size * octave_size * sizeof(double));
         for (y = 0; y < octave_size; y++) {
             for (x = 0; x < octave_size; x++) {
                 octave_map[y * octave_size + x] = (1.0 + randf()) * 2.0 - 1.0;
@@ -97,7 +99,6 @@ rafgl_raster_t generate_perlin(int octaves, double persistence) {
         octave_size *= 2;
         multiplier *= persistence;
         memset(tmp_map, 0, height * width * sizeof(double));
-        free(octave_map);
     }
 
     float sample;
@@ -116,8 +117,8 @@ rafgl_raster_t generate_perlin(int octaves, double persistence) {
         }
     }
 
-    free(perlin_map);
-    free(tmp_map);
+    raster_pool_release(&frame_pool, perlin_map);
+    raster_pool_release(&frame_pool, tmp_map);
 
     return raster;
 }
@@ -135,14 +136,15 @@ rafgl_raster_t generate_animated_perlin(int octaves, double persistence, double
     int height = width;
 
     int x, y, octave;
-    double *tmp_map = malloc(height * width * sizeof(double));
-    double *perlin_map = calloc(height * width, sizeof(double));
+    double *tmp_map = raster_pool_acquire(&frame_pool, height * width * sizeof(double));
+    double *perlin_map = raster_pool_acquire(&frame_pool, height * width * sizeof(double));
+    memset(perlin_map, 0, height * width * sizeof(double));
     double *octave_map;
     rafgl_pixel_rgb_t pix;
     rafgl_raster_init(&raster, width, height);
 
     for (octave = 0; octave < octaves; octave++) {
-        octave_map = malloc(octave_size * octave_size * sizeof(double));
+        octave_map = scratch_alloc(&frame_scratch, octave_size * octave_size * sizeof(double));
         for (y = 0; y < octave_size; y++) {
             for (x = 0; x < octave_size; x++) {
                 octave_map[y * octave_size + x] = (1.0 + randf()) * 2.0 - 1.0 + sin(p_time * 0.1 + x + y);
@@ -155,7 +157,6 @@ rafgl_raster_t generate_animated_perlin(int octaves, double persistence, double
         octave_size *= 2;
         multiplier *= persistence;
         memset(tmp_map, 0, height * width * sizeof(double));
-        free(octave_map);
     }
 
     float sample;
@@ -174,12 +175,19 @@ rafgl_raster_t generate_animated_perlin(int octaves, double persistence, double
         }
     }
 
-    free(perlin_map);
-    free(tmp_map);
+    raster_pool_release(&frame_pool, perlin_map);
+    raster_pool_release(&frame_pool, tmp_map);
 
     return raster;
 }
 
+/// kernels may be handed a view, so nothing is written outside the raster they were given
+static inline void plot_clipped(rafgl_raster_t raster, int x, int y, rafgl_pixel_rgb_t color) {
+    if ((unsigned)x < (unsigned)raster.width && (unsigned)y < (unsigned)raster.height) {
+        pixel_at_m(raster, x, y) = color;
+    }
+}
+
 void draw_ellipse(rafgl_raster_t raster, int xc, int yc, int rx, int ry, rafgl_pixel_rgb_t color) {
     int x, y;
     float rx2 = rx * rx;
@@ -194,10 +202,10 @@ void draw_ellipse(rafgl_raster_t raster, int xc, int yc, int rx, int ry, rafgl_p
     int py = two_rx2 * y;
 
     while (px < py) {
-        pixel_at_m(raster, xc + x, yc + y) = color;
-        pixel_at_m(raster, xc - x, yc + y) = color;
-        pixel_at_m(raster, xc + x, yc - y) = color;
-        pixel_at_m(raster, xc - x, yc - y) = color;
+        plot_clipped(raster, xc + x, yc + y, color);
+        plot_clipped(raster, xc - x, yc + y, color);
+        plot_clipped(raster, xc + x, yc - y, color);
+        plot_clipped(raster, xc - x, yc - y, color);
 
         x++;
         px += two_ry2;
@@ -213,10 +221,10 @@ void draw_ellipse(rafgl_raster_t raster, int xc, int yc, int rx, int ry, rafgl_p
     float p2 = (ry2) * (x + 0.5) * (x + 0.5) + (rx2) * (y - 1) * (y - 1) - (rx2 * ry2);
 
     while (y > 0) {
-        pixel_at_m(raster, xc + x, yc + y) = color;
-        pixel_at_m(raster, xc - x, yc + y) = color;
-        pixel_at_m(raster, xc + x, yc - y) = color;
-        pixel_at_m(raster, xc - x, yc - y) = color;
+        plot_clipped(raster, xc + x, yc + y, color);
+        plot_clipped(raster, xc - x, yc + y, color);
+        plot_clipped(raster, xc + x, yc - y, color);
+        plot_clipped(raster, xc - x, yc - y, color);
 
         y--;
         py -= two_rx2;
@@ -254,8 +262,10 @@ rafgl_raster_t generate_galaxy_texture(int width, int height, int octaves, doubl
     rafgl_raster_t raster;
     rafgl_raster_init(&raster, width, height);
 
-    double *noise_map = calloc(width * height, sizeof(double));
-    double *temp_map = malloc(width * height * sizeof(double));
+    double *noise_map = raster_pool_acquire(&frame_pool, width * height * sizeof(double));
+    double *temp_map = raster_pool_acquire(&frame_pool, width * height * sizeof(double));
+    memset(noise_map, 0, width * height * sizeof(double));
+    memset(temp_map, 0, width * height * sizeof(double));
 
     int center_x = width / 2;
     int center_y = height / 2;
@@ -297,8 +307,8 @@ rafgl_raster_t generate_galaxy_texture(int width, int height, int octaves, doubl
         }
     }
 
-    free(noise_map);
-    free(temp_map);
+    raster_pool_release(&frame_pool, noise_map);
+    raster_pool_release(&frame_pool, temp_map);
 
     return raster;
 }
@@ -316,25 +326,21 @@ void update_ellipsoid_path_point(float *x, float *y, float cx, float cy, float a
     *y = cy + b * sin(*theta);
 }
 
-rafgl_raster_t generate_perlin_with_color(int octaves, double persistence) {
-    srand(time(NULL));
-
+rafgl_raster_t generate_perlin_with_color(int width, int height, int octaves, double persistence) {
     int octave_size = 2;
     double multiplier = 1.0;
     rafgl_raster_t raster;
 
-    int width = RASTER_WIDTH;
-    int height = RASTER_HEIGHT;
-
     int x, y, octave;
-    double *tmp_map = malloc(height * width * sizeof(double));
-    double *perlin_map = calloc(height * width, sizeof(double));
+    double *tmp_map = raster_pool_acquire(&frame_pool, height * width * sizeof(double));
+    double *perlin_map = raster_pool_acquire(&frame_pool, height * width * sizeof(double));
+    memset(perlin_map, 0, height * width * sizeof(double));
     double *octave_map;
     rafgl_pixel_rgb_t pix;
     rafgl_raster_init(&raster, width, height);
 
     for (octave = 0; octave < octaves; octave++) {
-        octave_map = malloc(octave_size * octave_size * sizeof(double));
+        octave_map = scratch_alloc(&frame_scratch, octave_size * octave_size * sizeof(double));
 
         for (y = 0; y < octave_size; y++) {
             for (x = 0; x < octave_size; x++) {
@@ -348,7 +354,6 @@ rafgl_raster_t generate_perlin_with_color(int octaves, double persistence) {
         octave_size *= 2;
         multiplier *= persistence;
         memset(tmp_map, 0, height * width * sizeof(double));
-        free(octave_map);
     }
 
     float sample;
@@ -380,44 +385,19 @@ rafgl_raster_t generate_perlin_with_color(int octaves, double persistence) {
         }
     }
 
-    free(perlin_map);
-    free(tmp_map);
+    raster_pool_release(&frame_pool, perlin_map);
+    raster_pool_release(&frame_pool, tmp_map);
 
     return raster;
 }
 
-void apply_screen_distortion(rafgl_raster_t raster, float delta_time_elapsed, float distortion_duration) {
+float screen_distortion_factor(float delta_time_elapsed, float distortion_duration) {
     float t = delta_time_elapsed / distortion_duration;
     if (t > 1.0) t = 1.0;
-    float distortion_factor = sin(t * M_PI) * 100.0;
-    apply_distortion(raster, distortion_factor);
+    return sin(t * M_PI) * 100.0;
 }
 
-void apply_distortion(rafgl_raster_t raster, float distortion_factor) {
-    rafgl_raster_t temp_raster;
-    rafgl_raster_init(&temp_raster, raster.width, raster.height);
-
-    for (int y = 0; y < raster.height; y++) {
-        for (int x = 0; x < raster.width; x++) {
-            float offset_x = sin(y * 0.05f) * distortion_factor;
-            float offset_y = cos(x * 0.05f) * distortion_factor;
-
-            int src_x = (int)(x + offset_x) % raster.width;
-            int src_y = (int)(y + offset_y) % raster.height;
-
-            if (src_x < 0) src_x += raster.width;
-            if (src_y < 0) src_y += raster.height;
-
-            pixel_at_m(temp_raster, x, y) = pixel_at_m(raster, src_x, src_y);
-        }
-    }
-
-    memcpy(raster.data, temp_raster.data, raster.width * raster.height * sizeof(rafgl_pixel_rgb_t));
-
-    rafgl_raster_cleanup(&temp_raster);
-}
-
-void apply_whiteout(rafgl_raster_t raster, float delta_time_elapsed, float whiteout_duration) {
+float whiteout_factor(float delta_time_elapsed, float whiteout_duration) {
     float t = delta_time_elapsed / whiteout_duration;
     float peak = whiteout_duration * 0.5;
 
@@ -431,92 +411,256 @@ void apply_whiteout(rafgl_raster_t raster, float delta_time_elapsed, float white
         whiteness_factor = cos(t * M_PI / peak);
     }
 
-    whiteout(raster, whiteness_factor);
+    return whiteness_factor;
 }
 
-void whiteout(rafgl_raster_t raster, float white_factor) {
-    for (int y = 0; y < raster.height; y++) {
-        for (int x = 0; x < raster.width; x++) {
-            rafgl_pixel_rgb_t pix = pixel_at_m(raster, x, y);
-            pix.r = pix.r + (255 - pix.r) * white_factor;
-            pix.g = pix.g + (255 - pix.g) * white_factor;
-            pix.b = pix.b + (255 - pix.b) * white_factor;
-            pixel_at_m(raster, x, y) = pix;
-        }
+void apply_whiteout(rafgl_raster_t raster, float delta_time_elapsed, float whiteout_duration) {
+    whiteout(raster, whiteout_factor(delta_time_elapsed, whiteout_duration));
+}
+
+void camera_shake_init(camera_shake_t *shake, float growth, float max_intensity) {
+    shake->intensity = 0.0f;
+    shake->max_intensity = max_intensity;
+    shake->growth = growth;
+    shake->offset_x = 0.0f;
+    shake->offset_y = 0.0f;
+}
+
+void camera_shake_update(camera_shake_t *shake, float delta_time) {
+    shake->intensity += delta_time * shake->growth;
+    if (shake->intensity > shake->max_intensity) shake->intensity = shake->max_intensity;
+
+    shake->offset_x = ((float)rand() / RAND_MAX - 0.5f) * 2.0f * shake->intensity;
+    shake->offset_y = ((float)rand() / RAND_MAX - 0.5f) * 2.0f * shake->intensity;
+}
+
+/// One sub-pixel offset blit of the composed layer; what scrolls in from the edge gets edge_colour.
+void camera_shake_apply(camera_shake_t *shake, rafgl_raster_t *to, rafgl_raster_t *from, uint32_t edge_colour) {
+    rafgl_raster_offset_blit(to, from, shake->offset_x, shake->offset_y, edge_colour);
+}
+
+void sim_clock_init(sim_clock_t *clock, double step, int max_steps) {
+    clock->step = step;
+    clock->accumulator = 0.0;
+    clock->max_steps = max_steps;
+    clock->steps = 0;
+    clock->alpha = 0.0f;
+}
+
+int sim_clock_advance(sim_clock_t *clock, double delta_time) {
+    clock->accumulator += delta_time;
+
+    int steps = (int)(clock->accumulator / clock->step);
+    if (steps > clock->max_steps) {
+        /// a stall would otherwise be paid back over the next frames and make them slow too
+        steps = clock->max_steps;
+        clock->accumulator = steps * clock->step;
     }
+
+    clock->accumulator -= steps * clock->step;
+    clock->steps += steps;
+    clock->alpha = clock->accumulator / clock->step;
+    return steps;
+}
+
+void whiteout(rafgl_raster_t raster, float white_factor) {
+    post_stack_t stack;
+    post_stack_clear(&stack);
+    post_push_whiteout(&stack, white_factor);
+    post_stack_apply(&stack, &raster, NULL);
 }
 
 void custom_rafgl_raster_draw_spritesheet(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int frame_x, int frame_y, int x, int y) {
+    /// compiled spans already skip the key colour (#FF00F9)
+    if (spritesheet->spans) {
+        rafgl_raster_draw_spritesheet(raster, spritesheet, frame_x, frame_y, x, y);
+        return;
+    }
+
     int frame_width = spritesheet->frame_width;
     int frame_height = spritesheet->frame_height;
-    int sheet_width = spritesheet->sheet_width;
 
-    int frame_x_pos = (frame_x % (sheet_width / frame_width)) * frame_width;
-    int frame_y_pos = (frame_y / (sheet_width / frame_width)) * frame_height;
+    int frame_x_pos = frame_x * frame_width;
+    int frame_y_pos = frame_y * frame_height;
 
-    rafgl_pixel_rgb_t background_color = {255, 0, 249, 255}; // #FF00F9
+    int x0 = rafgl_max_m(x, 0);
+    int y0 = rafgl_max_m(y, 0);
+    int x1 = rafgl_min_m(x + frame_width, raster->width);
+    int y1 = rafgl_min_m(y + frame_height, raster->height);
 
-    for (int i = 0; i < frame_width; i++) {
-        for (int j = 0; j < frame_height; j++) {
-            rafgl_pixel_rgb_t pixel = rafgl_point_sample(&spritesheet->sheet, (float)(frame_x_pos + i) / sheet_width, (float)(frame_y_pos + j) / spritesheet->sheet_height);
+    rafgl_pixel_rgb_t background_color = {{255, 0, 249, 255}}; // #FF00F9
+
+    for (int j = y0; j < y1; j++) {
+        rafgl_pixel_rgb_t *src = &pixel_at_m(spritesheet->sheet, frame_x_pos, frame_y_pos + j - y);
+        rafgl_pixel_rgb_t *dst = &pixel_at_pm(raster, 0, j);
+        for (int i = x0; i < x1; i++) {
+            rafgl_pixel_rgb_t pixel = src[i - x];
             if (pixel.r != background_color.r || pixel.g != background_color.g || pixel.b != background_color.b) { // Check if the pixel is not the background color
-                pixel_at_pm(raster, x + i, y + j) = pixel;
+                dst[i] = pixel;
             }
         }
     }
 }
 
-void apply_radial_blur(rafgl_raster_t raster, rafgl_raster_t *output, float blur_strength) {
-    int x, y, sx, sy;
-    float dx, dy, distance, weight, total_weight;
-    rafgl_pixel_rgb_t original_color, sample_color, final_color;
+typedef struct {
+    const rafgl_raster_t *source;
+    int center_x, center_y;             /// 16.16
+    int scale[RADIAL_BLUR_TAPS];        /// 16.16 scales towards the centre, the first is 1
+} radial_blur_params_t;
+
+/// adds the bilinear sample at 16.16 (fx, fy) with weights summing to 1 << 16
+KERNEL_INLINE void radial_blur_tap(const rafgl_raster_t *source, int fx, int fy, unsigned *r, unsigned *g, unsigned *b) {
+    int x0 = fx >> 16, y0 = fy >> 16;
+    int x1 = rafgl_min_m(x0 + 1, source->width - 1);
+    const rafgl_pixel_rgb_t *top = rafgl_row_pm(source, y0);
+    const rafgl_pixel_rgb_t *bottom = rafgl_row_pm(source, rafgl_min_m(y0 + 1, source->height - 1));
+    unsigned wx = (fx >> 8) & 0xff, wy = (fy >> 8) & 0xff;
+    unsigned w00 = (256 - wx) * (256 - wy), w10 = wx * (256 - wy);
+    unsigned w01 = (256 - wx) * wy, w11 = wx * wy;
+
+    *r += top[x0].r * w00 + top[x1].r * w10 + bottom[x0].r * w01 + bottom[x1].r * w11;
+    *g += top[x0].g * w00 + top[x1].g * w10 + bottom[x0].g * w01 + bottom[x1].g * w11;
+    *b += top[x0].b * w00 + top[x1].b * w10 + bottom[x0].b * w01 + bottom[x1].b * w11;
+}
 
-    int width = raster.width;
-    int height = raster.height;
-    int center_x = width / 2;
-    int center_y = height / 2;
+/// every tap lies between the centre and the pixel, so it never leaves the raster
+KERNEL_INLINE void radial_blur_pixel(const radial_blur_params_t *p, rafgl_pixel_rgb_t *pixel, int x, int y) {
+    int dx = (x << 16) - p->center_x;
+    int dy = (y << 16) - p->center_y;
 
-    for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-            dx = x - center_x;
-            dy = y - center_y;
-            distance = sqrt(dx * dx + dy * dy);
-
-            final_color = (rafgl_pixel_rgb_t){0, 0, 0};
-            total_weight = 0.0f;
-
-            for (float t = 0.0f; t <= 1.0f; t += 1.0f / blur_strength) {
-                sx = center_x + (int)(dx * t);
-                sy = center_y + (int)(dy * t);
-
-                if (sx >= 0 && sx < width && sy >= 0 && sy < height) {
-                    sample_color = pixel_at_m(raster, sx, sy);
-                    weight = 1.0f - t;
-                    final_color.r += sample_color.r * weight;
-                    final_color.g += sample_color.g * weight;
-                    final_color.b += sample_color.b * weight;
-                    total_weight += weight;
-                }
-            }
+    /// the first tap is the pixel itself
+    rafgl_pixel_rgb_t own = pixel_at_pm(p->source, x, y);
+    unsigned r = own.r << 16, g = own.g << 16, b = own.b << 16;
 
-            final_color.r = (int)(final_color.r / total_weight);
-            final_color.g = (int)(final_color.g / total_weight);
-            final_color.b = (int)(final_color.b / total_weight);
+    for (int k = 1; k < RADIAL_BLUR_TAPS; k++) {
+        int fx = p->center_x + (int)(((long long)dx * p->scale[k]) >> 16);
+        int fy = p->center_y + (int)(((long long)dy * p->scale[k]) >> 16);
+        radial_blur_tap(p->source, fx, fy, &r, &g, &b);
+    }
+
+    /// RADIAL_BLUR_TAPS samples of weight 1 << 16 each
+    const int shift = 16 + RADIAL_BLUR_TAP_BITS;
+    *pixel = (rafgl_pixel_rgb_t){(r + (1u << (shift - 1))) >> shift, (g + (1u << (shift - 1))) >> shift, (b + (1u << (shift - 1))) >> shift};
+}
 
-            pixel_at_m(raster, x, y) = final_color;
+PIXEL_KERNEL(radial_blur_kernel, radial_blur_params_t, radial_blur_pixel, 1)
+
+/// Pass i averages RADIAL_BLUR_TAPS samples at scales q^(k * TAPS^i), so after n passes every
+/// pixel is the mean of TAPS^n samples spread evenly in scale from 1 down to 1 - zoom. Enough
+/// passes are run to bring the samples at the farthest corner within a pixel of each other,
+/// up to max_passes, so the cost grows with the log of the streak length.
+void apply_radial_blur(rafgl_raster_t raster, int center_x, int center_y, float zoom, int max_passes) {
+    if (zoom <= 0.0f || max_passes < 1) return;
+    zoom = fminf(zoom, 1.0f);
+    center_x = rafgl_max_m(0, rafgl_min_m(center_x, raster.width - 1));
+    center_y = rafgl_max_m(0, rafgl_min_m(center_y, raster.height - 1));
+
+    float reach = rafgl_distance2D(0, 0, rafgl_max_m(center_x, raster.width - 1 - center_x), rafgl_max_m(center_y, raster.height - 1 - center_y));
+    float streak = zoom * reach;
+    int passes = 1, taps = RADIAL_BLUR_TAPS;
+    while (passes < max_passes && taps < streak + 1) {
+        passes++;
+        taps *= RADIAL_BLUR_TAPS;
+    }
+    float q = powf(1.0f - zoom, 1.0f / (taps - 1));
+
+    rafgl_raster_t temp_raster;
+    raster_pool_acquire_raster(&frame_pool, &temp_raster, raster.width, raster.height);
+
+    radial_blur_params_t params = {NULL, center_x << 16, center_y << 16};
+    rafgl_raster_t *from = &raster, *to = &temp_raster;
+    float spacing = 1.0f;
+    for (int i = 0; i < passes; i++) {
+        for (int k = 0; k < RADIAL_BLUR_TAPS; k++) {
+            params.scale[k] = (int)(powf(q, k * spacing) * 65536.0f + 0.5f);
         }
+        params.source = from;
+        radial_blur_kernel(to, KERNEL_WHOLE(to), &params);
+
+        rafgl_raster_t *swap = from;
+        from = to;
+        to = swap;
+        spacing *= RADIAL_BLUR_TAPS;
+    }
+
+    if (from != &raster) rafgl_raster_copy_pixels(&raster, from);
+    raster_pool_release_raster(&frame_pool, &temp_raster);
+}
+
+typedef struct {
+    const rafgl_raster_t *source;
+    const float *kernel;
+    int radius;
+} blur_params_t;
+
+KERNEL_INLINE void blur_horizontal_pixel(const blur_params_t *p, rafgl_pixel_rgb_t *pixel, int x, int y) {
+    const rafgl_pixel_rgb_t *row = rafgl_row_pm(p->source, y);
+    int last = p->source->width - 1;
+    float r = 0.0f, g = 0.0f, b = 0.0f;
+    for (int k = -p->radius; k <= p->radius; k++) {
+        rafgl_pixel_rgb_t sample = row[rafgl_min_m(last, rafgl_max_m(0, x + k))];
+        r += sample.r * p->kernel[k + p->radius];
+        g += sample.g * p->kernel[k + p->radius];
+        b += sample.b * p->kernel[k + p->radius];
+    }
+    *pixel = (rafgl_pixel_rgb_t){(unsigned char)r, (unsigned char)g, (unsigned char)b};
+}
+
+KERNEL_INLINE void blur_vertical_pixel(const blur_params_t *p, rafgl_pixel_rgb_t *pixel, int x, int y) {
+    int last = p->source->height - 1;
+    float r = 0.0f, g = 0.0f, b = 0.0f;
+    for (int k = -p->radius; k <= p->radius; k++) {
+        rafgl_pixel_rgb_t sample = pixel_at_pm(p->source, x, rafgl_min_m(last, rafgl_max_m(0, y + k)));
+        r += sample.r * p->kernel[k + p->radius];
+        g += sample.g * p->kernel[k + p->radius];
+        b += sample.b * p->kernel[k + p->radius];
+    }
+    *pixel = (rafgl_pixel_rgb_t){(unsigned char)r, (unsigned char)g, (unsigned char)b};
+}
+
+#ifdef __SSE2__
+/// The blur of four neighbouring pixels. Tap k of all four is one load, step pixels after tap
+/// k - 1, weighed and summed as the scalar version does it, so the result is the same to the bit.
+KERNEL_INLINE void blur_lanes(const blur_params_t *p, rafgl_pixel_rgb_t *pixels, const rafgl_pixel_rgb_t *tap, int step) {
+    __m128 sum[KERNEL_LANES], sample[KERNEL_LANES];
+    for (int lane = 0; lane < KERNEL_LANES; lane++) sum[lane] = _mm_setzero_ps();
+
+    for (int k = 0; k <= 2 * p->radius; k++, tap += step) {
+        __m128 weight = _mm_set1_ps(p->kernel[k]);
+        kernel_unpack_ps(_mm_loadu_si128((const __m128i *)tap), sample);
+        for (int lane = 0; lane < KERNEL_LANES; lane++) sum[lane] = _mm_add_ps(sum[lane], _mm_mul_ps(sample[lane], weight));
+    }
+    _mm_storeu_si128((__m128i *)pixels, _mm_and_si128(kernel_pack_ps(sum), KERNEL_RGB_MASK));
+}
+
+/// groups whose taps reach past the edge are clamped pixel by pixel
+KERNEL_INLINE void blur_horizontal_lanes(const blur_params_t *p, rafgl_pixel_rgb_t *pixels, int x, int y) {
+    if (x < p->radius || x + KERNEL_LANES + p->radius > p->source->width) {
+        for (int lane = 0; lane < KERNEL_LANES; lane++) blur_horizontal_pixel(p, &pixels[lane], x + lane, y);
+        return;
     }
+    blur_lanes(p, pixels, &pixel_at_pm(p->source, x - p->radius, y), 1);
 }
 
+KERNEL_INLINE void blur_vertical_lanes(const blur_params_t *p, rafgl_pixel_rgb_t *pixels, int x, int y) {
+    if (y < p->radius || y + p->radius >= p->source->height) {
+        for (int lane = 0; lane < KERNEL_LANES; lane++) blur_vertical_pixel(p, &pixels[lane], x + lane, y);
+        return;
+    }
+    blur_lanes(p, pixels, &pixel_at_pm(p->source, x, y - p->radius), p->source->stride);
+}
+#endif
+
+PIXEL_KERNEL_LANES(blur_horizontal_kernel, blur_params_t, blur_horizontal_pixel, blur_horizontal_lanes, 1)
+PIXEL_KERNEL_LANES(blur_vertical_kernel, blur_params_t, blur_vertical_pixel, blur_vertical_lanes, 1)
+
 void apply_gaussian_blur(rafgl_raster_t raster, int radius) {
-    int width = raster.width;
-    int height = raster.height;
     rafgl_raster_t temp_raster;
-    rafgl_raster_init(&temp_raster, width, height);
+    raster_pool_acquire_raster(&frame_pool, &temp_raster, raster.width, raster.height);
 
     float sigma = radius / 2.0f;
     int kernel_size = 2 * radius + 1;
-    float *kernel = (float *)malloc(kernel_size * sizeof(float));
+    float *kernel = scratch_alloc(&frame_scratch, kernel_size * sizeof(float));
 
     float sum = 0.0f;
     for (int i = -radius; i <= radius; i++) {
@@ -528,62 +672,189 @@ void apply_gaussian_blur(rafgl_raster_t raster, int radius) {
         kernel[i] /= sum;
     }
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            float r = 0.0f, g = 0.0f, b = 0.0f;
-            for (int k = -radius; k <= radius; k++) {
-                int pixel_x = fmin(width - 1, fmax(0, x + k));
-                rafgl_pixel_rgb_t pixel = pixel_at_m(raster, pixel_x, y);
-                r += pixel.r * kernel[k + radius];
-                g += pixel.g * kernel[k + radius];
-                b += pixel.b * kernel[k + radius];
-            }
-            pixel_at_m(temp_raster, x, y) = (rafgl_pixel_rgb_t){(unsigned char)r, (unsigned char)g, (unsigned char)b};
-        }
+    blur_params_t horizontal = {&raster, kernel, radius};
+    blur_horizontal_kernel(&temp_raster, KERNEL_WHOLE(&temp_raster), &horizontal);
+
+    blur_params_t vertical = {&temp_raster, kernel, radius};
+    blur_vertical_kernel(&raster, KERNEL_WHOLE(&raster), &vertical);
+
+    raster_pool_release_raster(&frame_pool, &temp_raster);
+}
+
+void reduced_raster_begin(reduced_raster_t *reduced, rafgl_raster_t *frame, int shift) {
+    reduced->raster = *frame;
+    reduced->shift = shift;
+
+    for (int i = 0; i < shift; i++) {
+        rafgl_raster_t half;
+        raster_pool_acquire_raster(&frame_pool, &half, (reduced->raster.width + 1) / 2, (reduced->raster.height + 1) / 2);
+        rafgl_raster_box_downsample(&half, &reduced->raster);
+        if (i > 0) raster_pool_release_raster(&frame_pool, &reduced->raster);
+        reduced->raster = half;
     }
+}
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            float r = 0.0f, g = 0.0f, b = 0.0f;
-            for (int k = -radius; k <= radius; k++) {
-                int pixel_y = fmin(height - 1, fmax(0, y + k));
-                rafgl_pixel_rgb_t pixel = pixel_at_m(temp_raster, x, pixel_y);
-                r += pixel.r * kernel[k + radius];
-                g += pixel.g * kernel[k + radius];
-                b += pixel.b * kernel[k + radius];
-            }
-            pixel_at_m(raster, x, y) = (rafgl_pixel_rgb_t){(unsigned char)r, (unsigned char)g, (unsigned char)b};
-        }
+void reduced_raster_end(reduced_raster_t *reduced, rafgl_raster_t *frame) {
+    if (reduced->shift == 0) return;
+
+    rafgl_raster_bilinear_upsample(frame, &reduced->raster);
+    raster_pool_release_raster(&frame_pool, &reduced->raster);
+}
+
+typedef struct {
+    const rafgl_raster_t *source;
+} bloom_extract_params_t;
+
+/// adds the light of p past BLOOM_THRESHOLD, ramping in from none at the threshold to all of it
+/// at 255 on its brightest channel, weighted out of 256
+KERNEL_INLINE void bloom_bright(rafgl_pixel_rgb_t p, unsigned *r, unsigned *g, unsigned *b) {
+    int brightest = rafgl_max_m(p.r, rafgl_max_m(p.g, p.b));
+    if (brightest <= BLOOM_THRESHOLD) return;
+
+    unsigned weight = (brightest - BLOOM_THRESHOLD) * 256 / (255 - BLOOM_THRESHOLD);
+    *r += p.r * weight;
+    *g += p.g * weight;
+    *b += p.b * weight;
+}
+
+/// keeps the bright part of every source pixel, then averages 2x2 of them, so a star one pixel
+/// wide still makes it into the half size level
+KERNEL_INLINE void bloom_extract_pixel(const bloom_extract_params_t *p, rafgl_pixel_rgb_t *pixel, int x, int y) {
+    const rafgl_pixel_rgb_t *top = rafgl_row_pm(p->source, 2 * y);
+    const rafgl_pixel_rgb_t *bottom = rafgl_row_pm(p->source, rafgl_min_m(2 * y + 1, p->source->height - 1));
+    int x0 = 2 * x, x1 = rafgl_min_m(2 * x + 1, p->source->width - 1);
+    unsigned r = 0, g = 0, b = 0;
+
+    bloom_bright(top[x0], &r, &g, &b);
+    bloom_bright(top[x1], &r, &g, &b);
+    bloom_bright(bottom[x0], &r, &g, &b);
+    bloom_bright(bottom[x1], &r, &g, &b);
+
+    *pixel = (rafgl_pixel_rgb_t){{(r + 512) >> 10, (g + 512) >> 10, (b + 512) >> 10}};
+}
+
+PIXEL_KERNEL(bloom_extract_kernel, bloom_extract_params_t, bloom_extract_pixel, 1)
+
+typedef struct {
+    const rafgl_raster_t *source;       /// the level below, half the size rounded up
+    int keep, weight;                   /// of the pixel and of the sampled light, out of 256
+} bloom_add_params_t;
+
+/// pixel * keep + the level below stretched 2x at the pixel's centre * weight. At exactly twice
+/// the size the centre always falls a quarter of the way from the nearest source pixel to the
+/// one on the pixel's side, so the bilinear weights are fixed at 9, 3, 3 and 1 out of 16 and the
+/// sample is summed in 16 bit lanes, red with blue and green with alpha. An odd last row or
+/// column lands back on the source pixel the box downsample made from it alone.
+KERNEL_INLINE void bloom_add_pixel(const bloom_add_params_t *p, rafgl_pixel_rgb_t *pixel, int x, int y) {
+    const rafgl_raster_t *source = p->source;
+    int near_x = rafgl_min_m(x >> 1, source->width - 1), near_y = rafgl_min_m(y >> 1, source->height - 1);
+    int far_x = (x & 1) ? rafgl_min_m(near_x + 1, source->width - 1) : rafgl_max_m(near_x - 1, 0);
+    int far_y = (y & 1) ? rafgl_min_m(near_y + 1, source->height - 1) : rafgl_max_m(near_y - 1, 0);
+    const rafgl_pixel_rgb_t *near_row = rafgl_row_pm(source, near_y), *far_row = rafgl_row_pm(source, far_y);
+    uint32_t a = near_row[near_x].rgba, b = near_row[far_x].rgba, c = far_row[near_x].rgba, d = far_row[far_x].rgba;
+
+    /// most of the sky has no glow to add
+    if (p->keep == 256 && ((a | b | c | d) & 0xffffff) == 0) return;
+
+    uint32_t rb = (a & 0x00ff00ff) * 9 + ((b & 0x00ff00ff) + (c & 0x00ff00ff)) * 3 + (d & 0x00ff00ff);
+    uint32_t ga = ((a >> 8) & 0x00ff00ff) * 9 + (((b >> 8) & 0x00ff00ff) + ((c >> 8) & 0x00ff00ff)) * 3 + ((d >> 8) & 0x00ff00ff);
+    rafgl_pixel_rgb_t sample;
+    sample.rgba = (((rb + 0x00080008) >> 4) & 0x00ff00ff) | ((((ga + 0x00080008) >> 4) & 0x00ff00ff) << 8);
+
+    pixel->r = rafgl_min_m(255, (pixel->r * p->keep + sample.r * p->weight + 128) >> 8);
+    pixel->g = rafgl_min_m(255, (pixel->g * p->keep + sample.g * p->weight + 128) >> 8);
+    pixel->b = rafgl_min_m(255, (pixel->b * p->keep + sample.b * p->weight + 128) >> 8);
+}
+
+#ifdef __SSE2__
+/// bloom_add_pixel for four pixels starting at an even x. Between them they stretch the source
+/// columns x / 2 - 1 to x / 2 + 2 of two rows, so those are loaded once and shuffled into each
+/// pixel's near and far taps; the light is summed in 16 bit lanes and weighed in 32.
+KERNEL_INLINE void bloom_add_lanes(const bloom_add_params_t *p, rafgl_pixel_rgb_t *pixels, int x, int y) {
+    const rafgl_raster_t *source = p->source;
+    int half = x >> 1;
+
+    /// taps clamped at the edges, and weights past a 16 bit multiply, go pixel by pixel
+    if ((x & 1) || half < 1 || half + 2 >= source->width || p->weight > INT16_MAX) {
+        for (int lane = 0; lane < KERNEL_LANES; lane++) bloom_add_pixel(p, &pixels[lane], x + lane, y);
+        return;
+    }
+
+    int near_y = rafgl_min_m(y >> 1, source->height - 1);
+    int far_y = (y & 1) ? rafgl_min_m(near_y + 1, source->height - 1) : rafgl_max_m(near_y - 1, 0);
+    __m128i near = _mm_loadu_si128((const __m128i *)&pixel_at_pm(source, half - 1, near_y));
+    __m128i far = _mm_loadu_si128((const __m128i *)&pixel_at_pm(source, half - 1, far_y));
+    __m128i pixel = _mm_loadu_si128((const __m128i *)pixels);
+    const __m128i zero = _mm_setzero_si128();
+
+    if (p->keep == 256 && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(_mm_or_si128(near, far), KERNEL_RGB_MASK), zero)) == 0xffff) return;
+
+    /// near taps are source columns 1, 1, 2, 2 of the four loaded, far ones 0, 2, 1, 3
+    __m128i a = _mm_shuffle_epi32(near, _MM_SHUFFLE(2, 2, 1, 1)), b = _mm_shuffle_epi32(near, _MM_SHUFFLE(3, 1, 2, 0));
+    __m128i c = _mm_shuffle_epi32(far, _MM_SHUFFLE(2, 2, 1, 1)), d = _mm_shuffle_epi32(far, _MM_SHUFFLE(3, 1, 2, 0));
+    const __m128i nine = _mm_set1_epi16(9), three = _mm_set1_epi16(3), round = _mm_set1_epi16(8);
+    const __m128i weights = _mm_set1_epi32(p->keep | (p->weight << 16));
+    const __m128i half_up = _mm_set1_epi32(128);
+    __m128i result[2];
+
+    for (int h = 0; h < 2; h++) {
+        __m128i a16 = h ? _mm_unpackhi_epi8(a, zero) : _mm_unpacklo_epi8(a, zero);
+        __m128i b16 = h ? _mm_unpackhi_epi8(b, zero) : _mm_unpacklo_epi8(b, zero);
+        __m128i c16 = h ? _mm_unpackhi_epi8(c, zero) : _mm_unpacklo_epi8(c, zero);
+        __m128i d16 = h ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+        __m128i p16 = h ? _mm_unpackhi_epi8(pixel, zero) : _mm_unpacklo_epi8(pixel, zero);
+
+        __m128i sample = _mm_add_epi16(_mm_mullo_epi16(a16, nine), _mm_mullo_epi16(_mm_add_epi16(b16, c16), three));
+        sample = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(sample, d16), round), 4);
+
+        /// pixel * keep + sample * weight, channel by channel
+        __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(p16, sample), weights);
+        __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(p16, sample), weights);
+        lo = _mm_srai_epi32(_mm_add_epi32(lo, half_up), 8);
+        hi = _mm_srai_epi32(_mm_add_epi32(hi, half_up), 8);
+        result[h] = _mm_packs_epi32(lo, hi);
     }
 
-    free(kernel);
-    rafgl_raster_cleanup(&temp_raster);
+    __m128i packed = _mm_packus_epi16(result[0], result[1]);
+    packed = _mm_or_si128(_mm_and_si128(packed, KERNEL_RGB_MASK), _mm_andnot_si128(KERNEL_RGB_MASK, pixel));
+    _mm_storeu_si128((__m128i *)pixels, packed);
 }
+#endif
 
-void render_proximity_vignette(rafgl_raster_t raster, int cx, int cy, float vignette_factor, float rocket_sun_dist, float vignette_r, float vignette_g, float vignette_b, float r) {
-    for (int i = 0; i < raster.width; i++) {
-        for (int j = 0; j < raster.height; j++) {
-            float dist = rafgl_distance2D(i, j, cx, cy) / r;
+PIXEL_KERNEL_LANES(bloom_add_kernel, bloom_add_params_t, bloom_add_pixel, bloom_add_lanes, 1)
 
-            dist = powf(dist, 1.8f);
+static void bloom_add(rafgl_raster_t *to, const rafgl_raster_t *from, int keep, int weight) {
+    bloom_add_params_t params = {from, keep, weight};
+    bloom_add_kernel(to, KERNEL_WHOLE(to), &params);
+}
 
-            rafgl_pixel_rgb_t sampled = pixel_at_m(raster, i, j);
-            rafgl_pixel_rgb_t result;
+/// Level 0 is the bright part of the frame at half size, every further level half the last.
+/// The levels past the first are blurred, which at their size is cheap and reaches far, and
+/// then folded back up, each level keeping BLOOM_LEVEL_KEEP of its own light and taking the
+/// rest from the stretched level below. With k that share, level i is weighed k(1 - k)^i and
+/// the deepest gets what is left, so the glow hugs its source and still reaches far out. The
+/// weights sum to 1, so the frame gets strength times the extracted light.
+void apply_bloom(rafgl_raster_t raster, int levels, float strength) {
+    levels = rafgl_min_m(levels, BLOOM_MAX_LEVELS);
+    if (levels < 1 || strength <= 0.0f) return;
+
+    rafgl_raster_t pyramid[BLOOM_MAX_LEVELS];
+    raster_pool_acquire_raster(&frame_pool, &pyramid[0], (raster.width + 1) / 2, (raster.height + 1) / 2);
+    bloom_extract_params_t extract = {&raster};
+    bloom_extract_kernel(&pyramid[0], KERNEL_WHOLE(&pyramid[0]), &extract);
+
+    for (int i = 1; i < levels; i++) {
+        raster_pool_acquire_raster(&frame_pool, &pyramid[i], (pyramid[i - 1].width + 1) / 2, (pyramid[i - 1].height + 1) / 2);
+        rafgl_raster_box_downsample(&pyramid[i], &pyramid[i - 1]);
+        apply_gaussian_blur(pyramid[i], BLOOM_BLUR_RADIUS);
+    }
 
-            float tint_factor = dist * vignette_factor;
+    for (int i = levels - 2; i >= 0; i--) {
+        bloom_add(&pyramid[i], &pyramid[i + 1], BLOOM_LEVEL_KEEP, 256 - BLOOM_LEVEL_KEEP);
+    }
+    bloom_add(&raster, &pyramid[0], 256, (int)(strength * 256));
 
-            if (rocket_sun_dist < 100.0) {
-                float proximity_factor = 1.0 - (rocket_sun_dist / 100.0);
-                tint_factor *= proximity_factor;
-                result.r = rafgl_saturatei(sampled.r * (1.0f - tint_factor) + vignette_r * tint_factor * 255);
-                result.g = rafgl_saturatei(sampled.g * (1.0f - tint_factor) + vignette_g * tint_factor * 255);
-                result.b = rafgl_saturatei(sampled.b * (1.0f - tint_factor) + vignette_b * tint_factor * 255);
-            } else {
-                result.r = rafgl_saturatei(sampled.r * (1.0f - tint_factor));
-                result.g = rafgl_saturatei(sampled.g * (1.0f - tint_factor));
-                result.b = rafgl_saturatei(sampled.b * (1.0f - tint_factor));
-            }
-            pixel_at_m(raster, i, j) = result;
-        }
+    for (int i = levels - 1; i >= 0; i--) {
+        raster_pool_release_raster(&frame_pool, &pyramid[i]);
     }
 }